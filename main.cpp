@@ -1,5 +1,6 @@
 #include <string>
 #include <iostream>
+#include <csignal>
 
 #include <boost/thread.hpp>
 #include <boost/chrono.hpp>
@@ -10,12 +11,15 @@
 #include <wayver-audio.hpp>
 #include <wayver-ui.hpp>
 #include <wayver-bus.hpp>
+#include <wayver-bench.hpp>
 
 /***
  * Main Fn Headers
 */
 std::shared_ptr<spdlog::logger> initLogging();
 void printHelp();
+int renderOffline( Wayver::Audio::AudioEngine &engine, const std::string &out_path );
+void onStatsSignal( int );
 
 
 /****
@@ -24,7 +28,28 @@ void printHelp();
 int main(int argc, char *argv[])
 {
 
-    std::string path;
+    std::vector<std::string> playlist;
+    std::string out_path;
+    size_t ring_frames = DECODER_RING_FRAMES;
+    std::string host_api;
+    std::string device;
+    std::string buffer;
+    unsigned long buffer_frames = 0;
+    double latency_ms = 0;
+    std::string rate;
+    int output_rate = OUTPUT_RATE_NATIVE;
+    Wayver::Audio::ResampleQuality quality = Wayver::Audio::RESAMPLE_GOOD;
+    Wayver::Audio::StretchMode stretch_mode = Wayver::Audio::STRETCH_VOCODER;
+
+    // no file needed
+    if ( argc == 2 && strcmp(argv[1],"-b") == 0 ){
+        return Wayver::Bench::run( initLogging() );
+    }
+
+    if ( argc == 2 && strcmp(argv[1],"-L") == 0 ){
+        Wayver::Audio::PortAudioBackend( initLogging() ).listDevices();
+        return 0;
+    }
 
     // check argvd
     if (argc < 3 || strcmp(argv[1],"-h") == 0) {
@@ -32,23 +57,135 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    if ( strcmp(argv[1],"-f") == 0 ){
-        path = argv[2];
+    for (int i = 1; i < argc - 1; i += 2){
+        if ( strcmp(argv[i],"-f") == 0 ){
+            playlist.push_back( argv[i + 1] );
+        } else if ( strcmp(argv[i],"-r") == 0 ){
+            try {
+                ring_frames = std::stoul( argv[i + 1] );
+            } catch ( const std::logic_error & ){
+                ring_frames = 0;
+            }
+
+            // the decoder writes DECODER_CHUNK_FRAMES at a time - a smaller ring never fills
+            if ( ring_frames < DECODER_CHUNK_FRAMES ){
+                printHelp();
+                return 1;
+            }
+        } else if ( strcmp(argv[i],"-o") == 0 ){
+            out_path = argv[i + 1];
+        } else if ( strcmp(argv[i],"-a") == 0 ){
+            host_api = argv[i + 1];
+        } else if ( strcmp(argv[i],"-d") == 0 ){
+            device = argv[i + 1];
+        } else if ( strcmp(argv[i],"-l") == 0 ){
+            try {
+                latency_ms = std::stod( argv[i + 1] );
+            } catch ( const std::logic_error & ){
+                latency_ms = -1;
+            }
+
+            if ( latency_ms < 0 ){
+                printHelp();
+                return 1;
+            }
+        } else if ( strcmp(argv[i],"-B") == 0 ){
+            buffer = argv[i + 1];
+
+            if ( buffer != "auto" ){
+                try {
+                    buffer_frames = std::stoul( buffer );
+                } catch ( const std::logic_error & ){
+                    buffer_frames = 0;
+                }
+
+                if ( buffer_frames == 0 ){
+                    printHelp();
+                    return 1;
+                }
+            }
+        } else if ( strcmp(argv[i],"-R") == 0 ){
+            rate = argv[i + 1];
+
+            if ( rate != "native" && rate != "file" ){
+                try {
+                    output_rate = std::stoi( rate );
+                } catch ( const std::logic_error & ){
+                    output_rate = 0;
+                }
+
+                if ( output_rate <= 0 ){
+                    printHelp();
+                    return 1;
+                }
+            }
+        } else if ( strcmp(argv[i],"-q") == 0 && !Wayver::Audio::parseResampleQuality( argv[i + 1], &quality ) ){
+            printHelp();
+            return 1;
+        } else if ( strcmp(argv[i],"-t") == 0 && !Wayver::Audio::parseStretchMode( argv[i + 1], &stretch_mode ) ){
+            printHelp();
+            return 1;
+        }
     }
 
+    if ( playlist.empty() ){
+        printHelp();
+        return 1;
+    }
+
+    const std::string &path = playlist[0];
+
     auto logger = initLogging();
     logger->debug("Opening {}", path);
 
     Wayver::Bus::Queues queues;
     Wayver::Audio::AudioEngine engine;
 
+    engine.setRingFrames( ring_frames );
+    engine.setLatency( latency_ms / 1e3 );
+    engine.setResampleQuality( quality );
+    engine.setStretchMode( stretch_mode );
+
+    if ( buffer == "auto" ){
+        engine.setAutoBuffer( true );
+    } else if ( buffer_frames != 0 ){
+        engine.setFramesPerBuffer( buffer_frames );
+    }
+
+    // a render has no device to match, it keeps the file's rate unless told
+    if ( rate == "file" || ( rate.empty() && !out_path.empty() ) ){
+        engine.setOutputRate( OUTPUT_RATE_FILE );
+    } else if ( output_rate > 0 ){
+        engine.setOutputRate( output_rate );
+    }
+
+    // before the file: it opens at this device's rate
+    if ( out_path.empty() && ( !host_api.empty() || !device.empty() ) ){
+        engine.setBackend( new Wayver::Audio::PortAudioBackend( logger, host_api, device ) );
+    }
+
     engine.loadFile(path.c_str());
+
+    // played back to back, gapless where the format allows
+    for ( size_t i = 1; i < playlist.size(); i++ ){
+        engine.queueFile( playlist[i] );
+    }
+
+    // headless - no window, no device
+    if ( !out_path.empty() ){
+        return renderOffline( engine, out_path );
+    }
+
     SF_INFO sound_file_info = engine.getSoundFileInfo();
 
     engine.registerQueues( &queues );
 
+    // kill -USR1 <pid> logs the callback stats
+    signal( SIGUSR1, onStatsSignal );
+
     Wayver::UI::WayverUi ui;
 
+    ui.setPlaylist( playlist );
     ui.initUiState(
         &queues,
         sound_file_info,
@@ -65,6 +202,8 @@ int main(int argc, char *argv[])
     // block until finished
     playT.join();
     ui.stop();
+
+    logger->info("Decoder ring fill at exit: {}", engine.getRingFillLevel());
     
     logger->info("Joined threads");
     logger->flush();
@@ -72,6 +211,11 @@ int main(int argc, char *argv[])
 	return 0;
 }
 
+void onStatsSignal( int )
+{
+    Wayver::Audio::AudioEngine::requestStatsDump();
+}
+
 std::shared_ptr<spdlog::logger> initLogging()
 {
     std::shared_ptr<spdlog::logger> _logger;
@@ -85,9 +229,34 @@ std::shared_ptr<spdlog::logger> initLogging()
 
 }
 
+int renderOffline( Wayver::Audio::AudioEngine &engine, const std::string &out_path )
+{
+    Wayver::Audio::RenderReport r = engine.render( out_path );
+
+    printf("Rendered %lld frames (%.2f s) to %s in %.3f s\n", 
+        (long long)r.frames, r.audio_seconds, out_path.c_str(), r.wall_seconds);
+    printf("  real-time factor    %8.1fx\n", r.audio_seconds / r.wall_seconds);
+    printf("  callback only       %8.1fx\n", r.audio_seconds / r.callback_seconds);
+    printf("  block (%lu frames)  p50 %.2f us  p99 %.2f us  p99.9 %.2f us  max %.2f us  budget %.2f us\n",
+        engine.getFramesPerBuffer(), r.block_p50_us, r.block_p99_us, r.block_p999_us, r.block_max_us, r.block_budget_us);
+
+    return 0;
+}
+
 void printHelp(){
     printf("Please supply a set of valid options:\n\n");
-    printf("-f [filename]         -   reads and plays audio file\n");
+    printf("-f [filename]         -   reads and plays audio file, repeat to play several back to back\n");
+    printf("-r [frames]           -   decode-ahead ring depth, at least %d (default %d)\n", DECODER_CHUNK_FRAMES, DECODER_RING_FRAMES);
+    printf("-o [filename]         -   render to a float WAV instead of playing, no window or device\n");
+    printf("-B [frames|auto]      -   callback buffer size (default %d), auto tunes it while playing\n", FRAMES_IN_BUFFER);
+    printf("-q [fast|good|best]   -   varispeed resampling quality (default good)\n");
+    printf("-t [wsola|vocoder]    -   time-stretch method, wsola for speech (default vocoder)\n");
+    printf("-R [native|file|hz]   -   output rate, files are converted to it (default native, file for -o)\n");
+    printf("-l [ms]               -   suggested output latency (default: the device's low latency)\n");
+    printf("-a [host api]         -   host API to play through, e.g. ALSA or JACK\n");
+    printf("-d [index|name]       -   output device, see -L\n");
+    printf("-L                    -   list output devices\n");
+    printf("-b                    -   benchmark the audio callback on a null device\n");
     printf("-h                    -   display this message\n");
 
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include <wayver-alloc.hpp>
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local uint64_t _thread_allocs = 0;
+}
+
+uint64_t Wayver::Alloc::threadCount()
+{
+    return _thread_allocs;
+}
+
+bool Wayver::Alloc::counting()
+{
+#ifdef WAYVER_COUNT_ALLOCS
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef WAYVER_COUNT_ALLOCS
+
+/***
+ * Thread local, so counting costs the callback nothing it would
+ * not already pay for the allocation itself. Aligned new is left
+ * to the library and not counted.
+*/
+void *operator new( size_t size )
+{
+    _thread_allocs++;
+
+    void *p = malloc( size ? size : 1 );
+    if ( p == NULL ){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[]( size_t size )
+{
+    return operator new( size );
+}
+
+void operator delete( void *p ) noexcept { free( p ); }
+void operator delete[]( void *p ) noexcept { free( p ); }
+void operator delete( void *p, size_t ) noexcept { free( p ); }
+void operator delete[]( void *p, size_t ) noexcept { free( p ); }
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Wayver {
+
+    /***
+     * Heap allocation counting, for the benchmarks.
+     * Only built with -DWAYVER_COUNT_ALLOCS (make bench), which
+     * replaces the global operator new - otherwise the counts stay 0.
+    */
+    namespace Alloc {
+
+        // operator new calls made by the calling thread so far
+        uint64_t threadCount();
+
+        // false when the build does not count
+        bool counting();
+    }
+}
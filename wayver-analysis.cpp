@@ -0,0 +1,286 @@
+#include <wayver-analysis.hpp>
+#include <wayver-fft.hpp>
+#include <wayver-cache.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+using namespace Wayver::Audio;
+
+SpectrumAnalyser::SpectrumAnalyser(
+    const SF_INFO &info,
+    const std::atomic<int64_t> *play_head,
+    int64_t max_lead,
+    std::shared_ptr<spdlog::logger> logger
+):_samplerate(info.samplerate),
+_channels(info.channels),
+_max_lead(max_lead),
+_total_frames(info.frames),
+_play_head(play_head),
+_logger(logger)
+{
+    // enough resolution for the lowest band: ~ samplerate / 20 Hz, as a power of 2
+    _fft_size = 1024;
+    while ( _fft_size < _samplerate / ANALYSIS_MIN_HZ ){
+        _fft_size *= 2;
+    }
+
+    _history.assign( _fft_size, 0 );
+
+    _window.resize( _fft_size );
+    for ( int i = 0; i < _fft_size; i++ ){
+        _window[i] = 0.5f - 0.5f * cosf( 2 * M_PI * i / (_fft_size - 1) );
+        _window_sum += _window[i];
+    }
+
+    _fft_in = fftwf_alloc_real( _fft_size );
+    _fft_out = fftwf_alloc_complex( _fft_size / 2 + 1 );
+    _plan = Fft::planR2C( _fft_size );
+
+    _initBands();
+
+    _logger->debug("SpectrumAnalyser - fft size {} at {} Hz", _fft_size, _samplerate);
+}
+
+SpectrumAnalyser::~SpectrumAnalyser()
+{
+    stop();
+    fftwf_free( _fft_in );
+    fftwf_free( _fft_out );
+}
+
+/***
+ * Band j spans MIN * (MAX/MIN)^(j/N) -> MIN * (MAX/MIN)^((j+1)/N).
+ * Low bands can be narrower than a bin - those take the nearest one.
+*/
+void SpectrumAnalyser::_initBands()
+{
+    const float ratio = (float)ANALYSIS_MAX_HZ / ANALYSIS_MIN_HZ;
+    const float hz_per_bin = (float)_samplerate / _fft_size;
+    const int last_bin = _fft_size / 2;
+
+    _band_lo.resize( FFT_OUT_BANDS );
+    _band_hi.resize( FFT_OUT_BANDS );
+
+    for ( int j = 0; j < FFT_OUT_BANDS; j++ ){
+
+        float lo_hz = ANALYSIS_MIN_HZ * powf( ratio, (float)j / FFT_OUT_BANDS );
+        float hi_hz = ANALYSIS_MIN_HZ * powf( ratio, (float)(j + 1) / FFT_OUT_BANDS );
+
+        int lo = (int)ceilf( lo_hz / hz_per_bin );
+        int hi = (int)floorf( hi_hz / hz_per_bin );
+
+        if ( lo > hi ){
+            lo = hi = (int)roundf( sqrtf( lo_hz * hi_hz ) / hz_per_bin );
+        }
+
+        // above nyquist -> empty band
+        _band_lo[j] = std::min( lo, last_bin + 1 );
+        _band_hi[j] = std::min( hi, last_bin );
+    }
+}
+
+void SpectrumAnalyser::onDecoded( const float *frames, size_t n_frames, int64_t frame )
+{
+    AnalysisBlock block;
+    block.frame = frame;
+    block.n_frames = std::min( n_frames, (size_t)DECODER_CHUNK_FRAMES );
+
+    const float scale = 1.0f / _channels;
+    const int metered = std::min( _channels, VIS_MAX_CHANNELS );
+    float sum_sq[VIS_MAX_CHANNELS] = {0};
+
+    for ( int c = 0; c < metered; c++ ){
+        block.peak[c] = 0;
+    }
+
+    for ( int f = 0; f < block.n_frames; f++ ){
+        float sum = 0;
+        for ( int c = 0; c < _channels; c++ ){
+            const float x = frames[ f * _channels + c ];
+            sum += x;
+            if ( c < metered ){
+                block.peak[c] = std::max( block.peak[c], fabsf( x ) );
+                sum_sq[c] += x * x;
+            }
+        }
+        block.mono[f] = sum * scale;
+    }
+
+    for ( int c = 0; c < metered; c++ ){
+        block.rms[c] = sqrtf( sum_sq[c] / std::max( 1, block.n_frames ) );
+    }
+
+    // full -> the analyser is behind, it will resync on the gap
+    _blocks.push( block );
+
+    {
+        boost::lock_guard<boost::mutex> lock( _park_mutex );
+    }
+    _park_cond.notify_one();
+}
+
+void SpectrumAnalyser::start( Bus::Queues *q_ptr )
+{
+    _queues = q_ptr;
+    _running = true;
+    _thread = boost::thread( &SpectrumAnalyser::_loop, this );
+}
+
+void SpectrumAnalyser::stop()
+{
+    if ( _running ){
+        {
+            boost::lock_guard<boost::mutex> lock( _park_mutex );
+            _running = false;
+        }
+        _park_cond.notify_one();
+        _thread.join();
+        _storeSummary();
+    }
+}
+
+void SpectrumAnalyser::wantSummary( const std::string &path )
+{
+    _summary_wanted = true;
+    _summary_path = path;
+}
+
+void SpectrumAnalyser::_storeSummary()
+{
+    if ( !_summary_wanted || _summary_frames < 0.9 * _total_frames ){
+        return;
+    }
+
+    float bands[FFT_OUT_BANDS];
+    for ( int j = 0; j < FFT_OUT_BANDS; j++ ){
+        bands[j] = _summary[j] / _summary_frames;
+    }
+
+    if ( Cache::store( _summary_path, Cache::SPECTRUM, bands, sizeof(bands) ) ){
+        _logger->debug("SpectrumAnalyser - cached the average spectrum of {}", _summary_path);
+    }
+    _summary_wanted = false;
+}
+
+void SpectrumAnalyser::_loop()
+{
+    const int64_t publish_lag = _samplerate / 10;
+
+    while ( _running ){
+
+        // everything decoded has been heard - nothing moves until the decoder does
+        if ( _blocks.read_available() == 0 ){
+            _publish();
+            boost::unique_lock<boost::mutex> lock( _park_mutex );
+            while ( _running && _blocks.read_available() == 0 ){
+                _park_cond.wait( lock );
+            }
+            continue;
+        }
+
+        const AnalysisBlock &block = _blocks.front();
+        const int64_t end = block.frame + block.n_frames;
+        const int64_t head = _play_head->load( std::memory_order_relaxed );
+
+        // decoded before a backwards seek - will never be played
+        if ( end - head > _max_lead ){
+            _blocks.pop();
+            _next_frame = -1;
+            continue;
+        }
+
+        // not audible yet - wait for the play head (also parks us while paused)
+        if ( end > head ){
+            _publish();
+            int wait_ms = (int)( 1000 * (end - head) / _samplerate );
+            wait_ms = std::min( std::max( wait_ms, 1 ), ANALYSIS_MAX_WAIT_MS );
+
+            boost::unique_lock<boost::mutex> lock( _park_mutex );
+            _park_cond.wait_for( lock, boost::chrono::milliseconds( wait_ms ), [this]{ return !_running; } );
+            continue;
+        }
+
+        _analyse( block );
+
+        // long gone (forward seek) -> keep the window warm but draw nothing
+        if ( head - end < publish_lag ){
+            _shown_block = block;
+            _analysis_seq++;
+            _publish();
+        }
+
+        _blocks.pop();
+    }
+}
+
+void SpectrumAnalyser::_analyse( const AnalysisBlock &block )
+{
+    const int n = block.n_frames;
+
+    if ( block.frame != _next_frame ){
+        std::fill( _history.begin(), _history.end(), 0 );
+    }
+    _next_frame = block.frame + n;
+
+    // slide the window along by one block
+    memmove( _history.data(), _history.data() + n, (_fft_size - n) * sizeof(float) );
+    memcpy( _history.data() + _fft_size - n, block.mono, n * sizeof(float) );
+
+    for ( int i = 0; i < _fft_size; i++ ){
+        _fft_in[i] = _history[i] * _window[i];
+    }
+
+    fftwf_execute_dft_r2c( _plan, _fft_in, _fft_out );
+
+    const float fall = ANALYSIS_FALL_PER_SEC * n / _samplerate;
+
+    for ( int j = 0; j < FFT_OUT_BANDS; j++ ){
+
+        float peak = 0;
+        for ( int k = _band_lo[j]; k <= _band_hi[j]; k++ ){
+            float re = _fft_out[k][0], im = _fft_out[k][1];
+            peak = std::max( peak, re * re + im * im );
+        }
+
+        // amplitude of a full scale sine -> 1
+        float amp = 2 * sqrtf( peak ) / _window_sum;
+        float db = 20 * log10f( amp + 1e-12f );
+        float level = std::min( 1.0f, std::max( 0.0f, 1 - db / ANALYSIS_FLOOR_DB ) );
+
+        _bands[j] = std::max( level, _bands[j] - fall );
+        _summary[j] += level * n;
+    }
+
+    _summary_frames += n;
+}
+
+/***
+ * Fill the producer slot of the triple buffer in place and flip it.
+ * Cheap enough to do on every pass, so the play position keeps
+ * moving even while there is nothing new to analyse.
+*/
+void SpectrumAnalyser::_publish()
+{
+    Bus::VisFrame &vis = _queues->_vis_to_ui.writeBuffer();
+
+    vis.frame = _play_head->load( std::memory_order_relaxed );
+
+    // slots rotate - only refill the ones holding an older analysis
+    if ( vis.analysis_seq != _analysis_seq ){
+
+        vis.analysis_seq = _analysis_seq;
+        vis.n_samples = _shown_block.n_frames;
+        memcpy( vis.samples, _shown_block.mono, _shown_block.n_frames * sizeof(float) );
+        memcpy( vis.bands, _bands, sizeof(_bands) );
+
+        vis.channels = std::min( _channels, VIS_MAX_CHANNELS );
+        for ( int c = 0; c < vis.channels; c++ ){
+            vis.peak[c] = _shown_block.peak[c];
+            vis.rms[c] = _shown_block.rms[c];
+        }
+    }
+
+    _queues->_vis_to_ui.publish();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+#include <wayver-bus.hpp>
+#include <wayver-decoder.hpp>
+
+#include <sndfile.hh>
+#include <fftw3.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        // decoded audio, down-mixed to mono, on its way to the analyser
+        struct AnalysisBlock {
+            int64_t frame = 0;
+            int n_frames = 0;
+            float mono[DECODER_CHUNK_FRAMES];
+
+            // per channel, before the down-mix
+            float peak[VIS_MAX_CHANNELS];
+            float rms[VIS_MAX_CHANNELS];
+        };
+
+        /***
+         * Spectrum analysis, on its own thread.
+         * 
+         *      - Taps the decoder, so the callback pays nothing
+         *      - Slides a Hann window over the stream one decoder chunk
+         *      at a time, runs a cached FFTW plan, folds bins into
+         *      FFT_OUT_BANDS log-spaced bands
+         *      - Holds every frame back until the play head gets there,
+         *      so what is drawn is what is heard
+         *      - Sole producer of Bus::VisFrame, which it republishes
+         *      with a fresh play position on every pass
+        */
+        class SpectrumAnalyser : public DecodeTap {
+
+            int _samplerate;
+            int _channels;
+            int _fft_size;
+
+            // blocks further ahead of the play head than this are pre-seek leftovers
+            int64_t _max_lead;
+
+            boost::lockfree::spsc_queue<AnalysisBlock,boost::lockfree::capacity<ANALYSIS_QUEUE_BLOCKS>> _blocks;
+
+            // last _fft_size mono samples
+            std::vector<float> _history;
+            int64_t _next_frame = -1;
+
+            std::vector<float> _window;
+            float _window_sum = 0;
+
+            float *_fft_in = NULL;
+            fftwf_complex *_fft_out = NULL;
+            fftwf_plan _plan;
+
+            // bin range of every band, inclusive
+            std::vector<int> _band_lo;
+            std::vector<int> _band_hi;
+
+            // survives between analyses, copied into every VisFrame
+            float _bands[FFT_OUT_BANDS] = {0};
+            uint64_t _analysis_seq = 0;
+            AnalysisBlock _shown_block;
+
+            // long-term average spectrum, for the cache when it has none
+            bool _summary_wanted = false;
+            std::string _summary_path;
+            int64_t _total_frames;
+            double _summary[FFT_OUT_BANDS] = {0};
+            int64_t _summary_frames = 0;
+
+            const std::atomic<int64_t> *_play_head;
+            Bus::Queues *_queues = NULL;
+
+            boost::thread _thread;
+            std::atomic<bool> _running{false};
+
+            // nothing queued - parked until onDecoded() or stop()
+            boost::mutex _park_mutex;
+            boost::condition_variable _park_cond;
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            void _initBands();
+            void _loop();
+            void _analyse( const AnalysisBlock &block );
+            void _publish();
+            void _storeSummary();
+
+            public:
+
+                SpectrumAnalyser(
+                    const SF_INFO &info,
+                    const std::atomic<int64_t> *play_head,
+                    int64_t max_lead,
+                    std::shared_ptr<spdlog::logger> logger
+                );
+
+                ~SpectrumAnalyser();
+
+                // DecodeTap - decoder thread
+                void onDecoded( const float *frames, size_t n_frames, int64_t frame ) override;
+
+                // average what gets played and cache it on stop(),
+                // if most of the file was heard - call before start()
+                void wantSummary( const std::string &path );
+
+                void start( Bus::Queues *q_ptr );
+                void stop();
+
+                int fftSize() const { return _fft_size; }
+        };
+
+    }
+}
@@ -1,19 +1,75 @@
 #include <wayver-audio.hpp>
+#include <wayver-fft.hpp>
+#include <wayver-stats.hpp>
 #include <string>
 #include <filesystem>
 #include <math.h>
+#include <algorithm>
 
 using namespace Wayver::Audio;
 
+/*static*/ std::atomic<bool> AudioEngine::_stats_dump_requested{false};
 
 
+LoadedSource::LoadedSource(
+    Source *s,
+    const std::string &p,
+    size_t ring_frames,
+    std::shared_ptr<spdlog::logger> logger
+):info(s->info()),
+file_path(p),
+track_frames(s->info().frames)
+{
+    decoder = new Decoder( s, ring_frames, logger );
+
+    analyser = new SpectrumAnalyser( 
+        info, 
+        &readHead, 
+        ring_frames + 2 * DECODER_CHUNK_FRAMES, 
+        logger );
+
+    decoder->addTap( analyser );
+}
+
+LoadedSource::~LoadedSource(){
+    // decoder feeds the analyser, so it goes first
+    delete decoder;
+    delete analyser;
+}
+
 InternalAudioData::InternalAudioData(
-    const std::string &p
-):file(sf_open( p.c_str(), SFM_READ, &info)),
-_logger(spdlog::basic_logger_mt("AUDIO INTERNAL", "wayver.log"))
-{}
+    LoadedSource *s,
+    std::shared_ptr<spdlog::logger> logger,
+    ResampleQuality quality,
+    StretchMode stretch_mode
+):info(s->info),
+source(s),
+rt_log(logger),
+grains(s->info.channels, s->info.samplerate),
+varispeed(s->info.channels, quality),
+varispeed_in(VARISPEED_CHUNK_FRAMES * s->info.channels),
+stretch(s->info.channels, s->info.samplerate, stretch_mode, logger),
+stretch_in(STRETCH_CHUNK_FRAMES * s->info.channels)
+{
+}
 
-InternalAudioData::~InternalAudioData(){}
+InternalAudioData::~InternalAudioData(){
+    delete source;
+    delete source_slot.load();
+
+    LoadedSource *old;
+    while ( retired.pop( old ) ){
+        delete old;
+    }
+
+    delete loop;
+    delete loop_slot.load();
+
+    LoopRegion *old_loop;
+    while ( loops_retired.pop( old_loop ) ){
+        delete old_loop;
+    }
+}
 
 
 
@@ -23,9 +79,11 @@ InternalAudioData::~InternalAudioData(){}
  * core
 */
 AudioEngine::AudioEngine()
-:_logger(spdlog::basic_logger_mt("AUDIO ENGINE", "wayver.log"))
+:_logger(Bus::fileLogger("AUDIO ENGINE")),
+_blocks(_logger),
+_loop_builder(_logger)
 {
-    _logger->debug( "Constructed" );
+    _logger->debug( "Constructed - DSP kernels: {}", Dsp::isaName() );
     _logger->flush();
 }
 
@@ -33,6 +91,8 @@ AudioEngine::~AudioEngine(){
     _logger->info("~AudioEngine()");
     _logger->flush();
     delete _data;
+    delete _backend;
+    Fft::releasePlans();
 }
 
 
@@ -40,23 +100,342 @@ void AudioEngine::loadFile( const std::string& path){
 
     _logger->debug("loadFile()");
 
+    // counted even when it fails - the UI matches loads to its requests
+    _loads++;
+
+    Source *source = _openSource( path );
+    const char *kind = source->kind();
+
+    _playlist.assign( 1, path );
+    _next_track = 1;
+    _needs_new_stream = false;
+
+    _load( source, path, 0 );
+
+    /* only schedule analysis the cache cannot answer */
+    _cache = Cache::lookup( path );
+
+    Cache::Loudness loudness;
+    if ( getLoudness( loudness ) ){
+        _logger->info("Cached loudness: peak={} rms={}", loudness.peak, loudness.rms);
+    }
+
+    if ( _cache == NULL || !_cache->has( Cache::SPECTRUM ) ){
+        _loaded->analyser->wantSummary( path );
+    }
+
+    _logger ->info(
+        "Successfully loaded file:\n  channels= {}\n  sample rate= {}\n  total Frames= {}\n  sections= {}\n  seekable= {}\n  format={}\n  read via= {}",
+        _loaded->info.channels,
+        _loaded->info.samplerate, 
+        _loaded->info.frames,
+        _loaded->info.sections,
+        _loaded->info.seekable,
+        _loaded->info.format,
+        kind );
+
+    _logger->flush();
+}
+
+void AudioEngine::queueFile( const std::string &path )
+{
+    _playlist.push_back( path );
+}
+
+void AudioEngine::loadSource( Source *source, const std::string &label )
+{
+    _logger->debug("loadSource() - {}", label);
+
+    _loads++;
+
+    _playlist.clear();
+    _next_track = 0;
+    _needs_new_stream = false;
+
+    _load( source, label, 0 );
+    _cache = NULL;
+}
+
+/***
+ * Before run() there is no stream yet - the source simply becomes
+ * the one run() or render() starts with. While run() plays, it is
+ * decoding before this returns, then goes through the source slot,
+ * or onto a new stream if the format differs or the old one ended.
+*/
+void AudioEngine::_load( Source *source, const std::string &label, int track )
+{
+    LoadedSource *next = new LoadedSource( source, label, _ring_frames, _logger );
+    next->track = track;
+    next->load = _loads;
+
+    // loadSource() has no file for scrubbing to read from
+    if ( !_playlist.empty() ){
+        _blocks.setFile( BlockCache::fileId( next->load, track ), label, next->info.samplerate );
+    }
+
+    if ( !_streaming ){
+        _install( next );
+        return;
+    }
+
+    next->decoder->prefill();
+    next->decoder->start();
+
+    const bool same_format = next->info.channels == _data->info.channels 
+        && next->info.samplerate == _data->info.samplerate;
+
+    if ( same_format && !_stream_done ){
+        _swapSource( next );
+    } else {
+        _restartStream( next );
+    }
+}
+
+// next plays from the start of a new InternalAudioData - no stream yet
+void AudioEngine::_install( LoadedSource *next )
+{
     if (_data != NULL){
         _closeFile();
         delete _data;
     }
 
-    _data = new InternalAudioData( path );
+    _data = new InternalAudioData( next, _logger, _quality, _stretch_mode );
+    _data->_q_ptr = _queues_ptr;
+    _data->grains.setCache( &_blocks );
+
+    // a new stream carries on at the engine's gain, speed and tempo
+    _data->GAIN = _data->gain_now = _data->gain_from = _gain;
+    _data->STOPPED = _paused;
+    _data->varispeed.setSpeed( _speed, 0 );
+    _data->resampling = _speed != 1;
+    _data->stretch.setTempo( _tempo );
+    _data->stretch.want( _tempo != 1 );
+    _data->stretching = _tempo != 1;
+
+    _loaded = next;
+    _analyser_waiting = false;
+}
 
-    _logger ->info(
-        "Successfully loaded file:\n  channels= {}\n  sample rate= {}\n  total Frames= {}\n  sections= {}\n  seekable= {}\n  format={}",
-        _data->info.channels,
-        _data->info.samplerate, 
-        _data->info.frames,
-        _data->info.sections,
-        _data->info.seekable,
-        _data->info.format );
+/***
+ * Hands next, already decoding, to the running callback without
+ * stopping the stream:
+ *
+ *      - Playing: glide to silence, and let the callback take next
+ *      once the glide has run out - a buffer later, glide back up
+ *      - Paused: take it at the next buffer, nobody hears it
+ *      - Whatever still sat unclaimed in the slot never played
+ *      and is freed right here
+ *
+ * The source it replaces comes back through retired, see
+ * _reclaimSources(). Never blocks on the callback.
+*/
+void AudioEngine::_swapSource( LoadedSource *next )
+{
+    const int64_t now = getStreamFrame();
 
-    _logger->flush();
+    next->swap_at = _paused ? 0 : now + GAIN_RAMP_FRAMES + _frames_per_buffer;
+
+    if ( !_paused ){
+        Bus::Message fade;
+        fade.cmd = Bus::Command::SET_GAIN;
+        fade.value = 0;
+        schedule( fade );
+    }
+
+    LoadedSource *stale = _data->source_slot.exchange( next, std::memory_order_acq_rel );
+    if ( stale != NULL ){
+        _logger->debug("_swapSource() - {} was never taken, freeing it", stale->file_path);
+        delete stale;
+    }
+
+    if ( !_paused ){
+        Bus::Message fade;
+        fade.cmd = Bus::Command::SET_GAIN;
+        fade.at_frame = next->swap_at + _frames_per_buffer;
+        fade.value = _gain;
+        schedule( fade );
+    }
+
+    _logger->info("_swapSource() - {} from stream frame {}", next->file_path, next->swap_at);
+
+    _loaded = next;
+    _analyser_waiting = true;
+}
+
+/***
+ * Frees what the callback swapped out. Both analysers publish to the
+ * same triple buffer, so the new one only starts once the callback
+ * has taken its source - by then the one it replaced is in retired
+ * and goes first.
+*/
+void AudioEngine::_reclaimSources()
+{
+    const bool taken = _analyser_waiting && _loaded->taken.load( std::memory_order_acquire );
+
+    LoadedSource *old;
+    while ( _data->retired.pop( old ) ){
+        _logger->debug("_reclaimSources() - freeing {}", old->file_path);
+        delete old;
+    }
+
+    LoopRegion *old_loop;
+    while ( _data->loops_retired.pop( old_loop ) ){
+        delete old_loop;
+    }
+
+    if ( taken ){
+        _loaded->analyser->start( _queues_ptr );
+        _analyser_waiting = false;
+    }
+}
+
+/***
+ * Hands the region to the loop builder - _publishLoop() picks it up
+ * once decoded. Only files can loop: what loadSource() plays has
+ * nothing to read twice.
+*/
+void AudioEngine::_setLoop( const Bus::Message &msg )
+{
+    if ( msg.track < 0 || msg.track >= (int)_playlist.size() ){
+        _logger->warn("_setLoop() - track {} is not a file, not looping", msg.track);
+        return;
+    }
+
+    _loop_builder.request( _playlist[msg.track], msg.position, msg.end, _data->info.samplerate,
+        _loaded->load, msg.track, &_queues_ptr->_engine_wakeup );
+
+    _logger->debug("_setLoop() - track {}, {} -> {}, decoding", msg.track, msg.position, msg.end);
+}
+
+// a built region goes to the callback - see InternalAudioData::loop_slot
+void AudioEngine::_publishLoop()
+{
+    LoopRegion *next = _loop_builder.take();
+    if ( next == NULL ){
+        return;
+    }
+
+    LoopRegion *stale = _data->loop_slot.exchange( next, std::memory_order_acq_rel );
+    delete stale;
+
+    _logger->info("_publishLoop() - track {}, {} -> {}, {} frames in memory", 
+        next->track, next->a(), next->b(), next->headFrames());
+}
+
+// next is decoding already - it gets a stream of its own
+void AudioEngine::_restartStream( LoadedSource *next )
+{
+    _logger->info("_restartStream() - {}, {} ch at {} Hz", next->file_path, next->info.channels, next->info.samplerate);
+
+    _stopStream();
+    _closeStream();
+
+    _install( next );
+    _data->rt_log.start();
+    _loaded->analyser->start( _queues_ptr );
+
+    // a reopen still waiting on the old stream is overtaken - this one opens at its size
+    const bool resized = _reopen_frames != 0;
+    if ( resized ){
+        _frames_per_buffer = _reopen_frames;
+        _reopen_frames = 0;
+    }
+
+    _openStream();
+    _startStream();
+    _stream_done = false;
+
+    if ( resized ){
+        _tuner.reopened( _frames_per_buffer, _data->underflows.load( std::memory_order_relaxed ) );
+    }
+}
+
+// everything but the stream, for whatever _data holds now
+void AudioEngine::_startFile()
+{
+    _data->rt_log.start();
+    _loaded->analyser->start( _queues_ptr );
+    _loaded->decoder->prefill();
+    _feedDecoder();
+    _loaded->decoder->start();
+}
+
+/***
+ * Opens the next playlist entry and hands it to the decoder, which
+ * reads its start ahead and chains it on where the current one ends.
+ * Called every tick - the decoder takes one at a time, so this runs
+ * about one track ahead of what is playing.
+*/
+void AudioEngine::_feedDecoder()
+{
+    if ( _needs_new_stream || _next_track >= _playlist.size() || !_loaded->decoder->wantsNext() ){
+        return;
+    }
+
+    const std::string &path = _playlist[_next_track];
+    Source *next;
+
+    try {
+        next = _openSource( path );
+    } catch ( const std::runtime_error &e ){
+        _logger->warn("_feedDecoder() - skipping {}: {}", path, e.what());
+        _next_track++;
+        return;
+    }
+
+    const SF_INFO &info = next->info();
+
+    if ( info.channels != _data->info.channels || info.samplerate != _data->info.samplerate ){
+        _logger->info("_feedDecoder() - {} is {} ch at {} Hz, plays on a new stream after this one", 
+            path, info.channels, info.samplerate);
+        delete next;
+        _needs_new_stream = true;
+        return;
+    }
+
+    _loaded->decoder->setNext( next, _next_track );
+    _blocks.setFile( BlockCache::fileId( _loaded->load, _next_track ), path, info.samplerate );
+    _logger->info("_feedDecoder() - track {} queued: {}", _next_track, path);
+    _next_track++;
+}
+
+// the stream ran out on a track that could not be chained on
+void AudioEngine::_playOnNewStream()
+{
+    const int track = _next_track;
+    const std::string path = _playlist[_next_track++];
+
+    _logger->info("_playOnNewStream() - track {}: {}", track, path);
+
+    _needs_new_stream = false;
+    try {
+        _load( _openSource( path ), path, track );
+    } catch ( const std::runtime_error &e ){
+        _logger->warn("_playOnNewStream() - skipping {}: {}", path, e.what());
+    }
+}
+
+/***
+ * The index comes from the analysis cache when an earlier run built
+ * it, otherwise it builds in the background - seeks before it is
+ * ready go through libsndfile as they always did. It indexes the
+ * file's own frames, so it holds under a rate conversion too.
+*/
+Source *AudioEngine::_openSource( const std::string &path )
+{
+    Source *source = openSource( path, _logger, _streamRate() );
+
+    if ( SeekIndex::covers( source->info() ) ){
+        std::shared_ptr<SeekIndex> index( new SeekIndex( _logger ) );
+        std::shared_ptr<Cache::Entry> cached = Cache::lookup( path );
+
+        if ( cached == NULL || !index->loadFrom( *cached ) ){
+            index->buildAsync( path );
+        }
+        source->useSeekIndex( index );
+    }
+
+    return source;
 }
 
 /*static*/
@@ -71,199 +450,974 @@ int AudioEngine::_paStreamCallback(
 
     float *out;
     InternalAudioData *p_data = (InternalAudioData*)userData;
-    sf_count_t num_read;
 
-    out = (float*)output;
-    p_data = (InternalAudioData*)userData;
+    const boost::chrono::steady_clock::time_point called = boost::chrono::steady_clock::now();
+
+    Dsp::disableDenormals();
+
+    out = (float*)output;
+    p_data = (InternalAudioData*)userData;
+
+    const int64_t buffer_start = p_data->stream_frame.load( std::memory_order_relaxed );
+    unsigned long pos = 0;
+
+    _recordStatus( p_data, statusFlags, timeInfo, buffer_start );
+    _takeSource( p_data, buffer_start );
+    _takeLoop( p_data, buffer_start );
+
+    /* 
+     * Walk the buffer message by message: everything due at or before
+     * a frame is applied, then the run up to the next message is rendered.
+     * Messages for later frames wait in rt_pending, so one dated ahead
+     * never holds back those queued behind it.
+    */
+    while ( pos < frameCount ){
+
+        int64_t next = frameCount;
+        int kept = 0;
+
+        // set aside earlier than anything still queued - they go first
+        for ( int i = 0; i < p_data->rt_pending_count; i++ ){
+            const Bus::Message &msg = p_data->rt_pending[i];
+
+            if ( msg.at_frame - buffer_start <= (int64_t)pos ){
+                _applyMessage( p_data, msg );
+            } else {
+                p_data->rt_pending[kept++] = msg;
+            }
+        }
+        p_data->rt_pending_count = kept;
+
+        while ( p_data->rt_commands.read_available() > 0 ){
+
+            const Bus::Message &msg = p_data->rt_commands.front();
+
+            if ( msg.at_frame < 0 || msg.at_frame - buffer_start <= (int64_t)pos ){
+                _applyMessage( p_data, msg );
+            } else if ( p_data->rt_pending_count < RT_QUEUE_SIZE ){
+                p_data->rt_pending[p_data->rt_pending_count++] = msg;
+            } else {
+                // nowhere to put it - it waits at the head until it is due
+                next = std::min( next, msg.at_frame - buffer_start );
+                break;
+            }
+            p_data->rt_commands.pop();
+        }
+
+        for ( int i = 0; i < p_data->rt_pending_count; i++ ){
+            next = std::min( next, p_data->rt_pending[i].at_frame - buffer_start );
+        }
+
+        _renderSegment( p_data, out + pos * p_data->info.channels, next - pos );
+        pos = next;
+    }
+
+    p_data->stream_frame.store( buffer_start + frameCount, std::memory_order_relaxed );
+
+    int result = paContinue;
+
+    /*  Ring ran dry and the decoder has nothing more -> EOF, unless another source is on its way */
+    if (p_data->source->seek_ticket == 0 
+        && !p_data->scrubbing
+        && p_data->loop_offset < 0
+        && !_loopsHere( p_data )
+        && p_data->source->decoder->isFinished() 
+        && ( !p_data->stretching || p_data->stretch.drained() )
+        && p_data->source_slot.load( std::memory_order_acquire ) == NULL)
+    {
+        p_data->rt_log.log( Bus::RT_END_OF_STREAM, p_data->source->readHead.load( std::memory_order_relaxed ) );
+
+        result = paComplete;
+    }
+
+    // render() runs without queues
+    if ( p_data->_q_ptr != NULL ){
+        _publishClock( p_data, timeInfo, frameCount, called );
+    }
+
+    p_data->callback_ns.record( 
+        boost::chrono::duration_cast<boost::chrono::nanoseconds>( 
+            boost::chrono::steady_clock::now() - called ).count() );
+    
+    return result;
+}
+
+/***
+ * xruns straight from the flags. Drift: the DAC time of frame 0 is
+ * pinned on the first callback that reports one; after that, a
+ * buffer's DAC time minus origin minus frames / rate is how far the
+ * device clock has walked from the sample clock. Some host APIs
+ * report 0 for DAC time - those never get a drift.
+*/
+/*static*/
+void AudioEngine::_recordStatus( 
+    InternalAudioData *p_data, 
+    PaStreamCallbackFlags flags, 
+    const PaStreamCallbackTimeInfo *time_info, 
+    int64_t buffer_start )
+{
+    if ( flags & paOutputUnderflow ){
+        p_data->underflows.fetch_add( 1, std::memory_order_relaxed );
+    }
+    if ( flags & paOutputOverflow ){
+        p_data->overflows.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    if ( time_info == NULL || time_info->outputBufferDacTime <= 0 ){
+        return;
+    }
+
+    const double rendered = (double)buffer_start / p_data->info.samplerate;
+
+    if ( p_data->dac_origin < 0 ){
+        p_data->dac_origin = time_info->outputBufferDacTime - rendered;
+    }
+
+    p_data->dac_drift.store( 
+        time_info->outputBufferDacTime - p_data->dac_origin - rendered, 
+        std::memory_order_relaxed );
+    p_data->output_latency.store( 
+        time_info->outputBufferDacTime - time_info->currentTime, 
+        std::memory_order_relaxed );
+}
+
+/***
+ * Anchors the UI's idea of "now playing" to this buffer. Mid-buffer
+ * seeks and pauses make it one buffer off until the next callback.
+ * Host APIs without a DAC time get no latency compensation.
+*/
+/*static*/
+void AudioEngine::_publishClock( 
+    InternalAudioData *p_data, 
+    const PaStreamCallbackTimeInfo *time_info, 
+    unsigned long frames, 
+    boost::chrono::steady_clock::time_point called )
+{
+    const bool playing = !p_data->STOPPED && !p_data->scrubbing && p_data->source->seek_ticket == 0;
+    const double tempo = p_data->stretching ? p_data->stretch.tempo() : 1;
+    const double speed = ( p_data->resampling ? p_data->varispeed.speed() : 1 ) * tempo;
+    Bus::AudioClock &clock = p_data->_q_ptr->_clock_to_ui.writeBuffer();
+
+    // in file frames - at speed, they go by that much faster than the stream's
+    clock.span = playing ? (int64_t)( frames * speed ) : 0;
+    clock.frame = p_data->source->readHead.load( std::memory_order_relaxed ) - clock.span;
+    clock.rate = playing ? p_data->info.samplerate * speed : 0;
+
+    // what the resampler and the stretcher took in but have not played yet
+    if ( p_data->resampling ){
+        clock.frame -= (int64_t)( p_data->varispeed.buffered() * tempo );
+    }
+    if ( p_data->stretching ){
+        clock.frame -= p_data->stretch.behind();
+    }
+    clock.load = p_data->source->load;
+    clock.track = p_data->source->track;
+    clock.track_frames = p_data->source->track_frames;
+    clock.track_channels = p_data->info.channels;
+    clock.track_samplerate = p_data->info.samplerate;
+
+    clock.stream_time = time_info->currentTime;
+    clock.dac_time = time_info->outputBufferDacTime > 0 ? time_info->outputBufferDacTime : time_info->currentTime;
+    clock.wall_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>( called.time_since_epoch() ).count();
+
+    p_data->_q_ptr->_clock_to_ui.publish();
+}
+
+/*static*/
+void AudioEngine::_applyMessage( InternalAudioData *p_data, const Bus::Message &msg )
+{
+    switch ( msg.cmd ){
+
+        case Bus::Command::SET_GAIN:
+            p_data->gain_from = p_data->gain_now;
+            p_data->GAIN = msg.value;
+            p_data->ramp_left = GAIN_RAMP_FRAMES;
+            break;
+
+        case Bus::Command::SET_PAUSED:
+            p_data->STOPPED = msg.value != 0;
+            break;
+
+        case Bus::Command::SEEK:
+            p_data->loop_offset = -1;
+            p_data->source->seek_ticket = p_data->source->decoder->requestSeek( msg.position );
+            p_data->source->seek_position = msg.position;
+            break;
+
+        // the ring stays where it was - only SCRUB_END moves it
+        case Bus::Command::SCRUB:
+            if ( !p_data->scrubbing ){
+                p_data->grains.reset();
+                p_data->scrubbing = true;
+                p_data->loop_offset = -1;
+                _dropQueued( p_data );
+            }
+            p_data->grains.moveTo( 
+                BlockCache::fileId( p_data->source->load, p_data->source->track ), 
+                msg.position, 
+                msg.value );
+            p_data->source->readHead.store( msg.position, std::memory_order_relaxed );
+            break;
+
+        case Bus::Command::SCRUB_END:
+            p_data->scrubbing = false;
+            p_data->source->seek_ticket = p_data->source->decoder->requestSeek( msg.position );
+            p_data->source->seek_position = msg.position;
+            break;
+
+        case Bus::Command::CLEAR_LOOP:
+            p_data->loop_armed = false;
+            break;
+
+        // into the stretcher from nothing, out of it back to what was heard
+        case Bus::Command::SET_TEMPO:
+            if ( msg.value != 1 && !p_data->stretching ){
+                p_data->stretch.flush();
+            } else if ( msg.value == 1 && p_data->stretching ){
+                _leaveStretch( p_data );
+            }
+            p_data->stretching = msg.value != 1;
+            p_data->stretch.setTempo( msg.value );
+            break;
+
+        // the direct path kept the resampler's history, it glides off from there
+        case Bus::Command::SET_SPEED:
+            p_data->varispeed.setSpeed( msg.value, (int64_t)p_data->info.samplerate * VARISPEED_GLIDE_MS / 1000 );
+            p_data->resampling = true;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*static*/
+void AudioEngine::_renderSegment( InternalAudioData *p_data, float *out, unsigned long frames )
+{
+    const int channels = p_data->info.channels;
+    LoadedSource *source = p_data->source;
+    size_t num_read = 0;
+
+    /* waiting on the decoder to land a seek - drop what is stale */
+    if ( source->seek_ticket != 0 && source->decoder->seekServed( source->seek_ticket ) ){
+        source->decoder->ring().skipTo( source->decoder->seekRingPosition() );
+        source->decoder->consumed();
+        source->seek_ticket = 0;
+
+        // the ring is getting ready for when the loop head runs out
+        if ( p_data->loop_offset < 0 ){
+            source->readHead.store( source->seek_position, std::memory_order_relaxed );
+            _dropQueued( p_data );
+        }
+
+        p_data->rt_log.log( Bus::RT_SEEK_LANDED, p_data->stream_frame.load( std::memory_order_relaxed ), source->seek_position );
+    }
+
+    /* scrubbing plays paused too - it is what the pointer asks for */
+    if ( p_data->scrubbing ){
+        p_data->grains.render( out, frames );
+        _applyGain( p_data, out, out, frames );
+        return;
+    }
+
+    if ( !p_data->STOPPED ){
+
+        if ( p_data->resampling ){
+            num_read = _renderVarispeed( p_data, out, frames );
+        }
+
+        if ( !p_data->resampling ){
+            num_read += _readSource( p_data, out + num_read * channels, frames - num_read, true );
+        }
+    }
+
+    /* pad whatever the ring could not supply with silence */
+    memset( out + num_read * channels, 0, sizeof(float) * (frames - num_read) * channels );
+}
+
+/***
+ * Frames of the source, through the stretcher while the tempo is off
+ * 1x. direct -> they go straight out, gain applied on the way, and
+ * the resampler keeps the last few in case the speed changes next.
+ * Otherwise they come out as they are, for the resampler.
+*/
+/*static*/
+size_t AudioEngine::_readSource( InternalAudioData *p_data, float *out, size_t frames, bool direct )
+{
+    if ( p_data->stretching ){
+        return _readStretched( p_data, out, frames, direct );
+    }
+    return _walkSource( p_data, out, frames, direct );
+}
+
+// the source as playback walks it - ring, track boundaries, loop
+/*static*/
+size_t AudioEngine::_walkSource( InternalAudioData *p_data, float *out, size_t frames, bool direct )
+{
+    const int channels = p_data->info.channels;
+    LoadedSource *source = p_data->source;
+    Bus::FrameRing &ring = source->decoder->ring();
+    TrackBoundary boundary;
+    size_t num_read = 0;
+
+    /* 
+     * One run per track: up to the next boundary, across it, on
+     * from the new track's frame 0. The frames either side are
+     * adjacent in the ring, so nothing is dropped or inserted.
+     * A loop cuts the run at B, and goes on from its head.
+    */
+    while ( num_read < frames ){
+
+        if ( p_data->loop_offset >= 0 ){
+            num_read += _renderLoopHead( p_data, out + num_read * channels, frames - num_read, direct );
+            continue;
+        }
+
+        if ( source->seek_ticket != 0 ){
+            break;
+        }
+
+        size_t want = frames - num_read;
+
+        if ( _loopsHere( p_data ) ){
+            const int64_t to_b = p_data->loop->b() - source->readHead.load( std::memory_order_relaxed );
+            if ( to_b == 0 ){
+                _wrapLoop( p_data );
+                continue;
+            }
+            want = std::min<int64_t>( want, to_b );
+        }
+
+        const bool ahead = source->decoder->boundaryAhead( &boundary );
+
+        if ( ahead ){
+            const uint64_t left = boundary.ring_pos - ring.readPosition();
+            if ( left == 0 ){
+                _crossBoundary( p_data, boundary );
+                continue;
+            }
+            want = std::min<uint64_t>( want, left );
+        }
+
+        const float *a, *b;
+        size_t n_a, n_b;
+
+        /* pre-decoded frames only - never touch the file from here */
+        const size_t n = ring.peek( want, &a, &n_a, &b, &n_b );
+
+        float *dst = out + num_read * channels;
+
+        /* copy out of the ring and apply gain in the same pass */
+        if ( direct ){
+            _applyGain( p_data, a, dst, n_a );
+            _applyGain( p_data, b, dst + n_a * channels, n_b );
+            p_data->varispeed.remember( a, n_a );
+            p_data->varispeed.remember( b, n_b );
+        } else {
+            memcpy( dst, a, sizeof(float) * n_a * channels );
+            memcpy( dst + n_a * channels, b, sizeof(float) * n_b * channels );
+        }
+
+        ring.consume( n );
+        source->readHead.store( 
+            source->readHead.load( std::memory_order_relaxed ) + n, 
+            std::memory_order_relaxed );
+        num_read += n;
+
+        if ( n < want ){
+            break;
+        }
+    }
+
+    source->decoder->consumed();
+
+    /* short, and not because the file ended or a seek is on its way - decoder fell behind */
+    const bool underrun = num_read < frames && source->seek_ticket == 0 && !source->decoder->isFinished();
+    if ( underrun && !source->underrun ){
+        p_data->rt_log.log( 
+            Bus::RT_RING_UNDERRUN, 
+            source->readHead.load( std::memory_order_relaxed ), 
+            (double)(frames - num_read) );
+    }
+    source->underrun = underrun;
+
+    return num_read;
+}
+
+/***
+ * The source through the resampler, pulled VARISPEED_CHUNK_FRAMES at
+ * a time, gain on what comes out. Back at 1x, once what it holds has
+ * played, it drops out and the direct path carries on.
+*/
+/*static*/
+size_t AudioEngine::_renderVarispeed( InternalAudioData *p_data, float *out, size_t frames )
+{
+    Resampler &rs = p_data->varispeed;
+    const int channels = p_data->info.channels;
+    size_t done = 0;
+
+    while ( done < frames ){
+
+        if ( rs.settled() && rs.buffered() == 0 ){
+            p_data->resampling = false;
+            break;
+        }
+
+        done += rs.read( out + done * channels, frames - done );
+        if ( done == frames || rs.settled() ){
+            continue;
+        }
+
+        const size_t want = std::min<size_t>( rs.space(), VARISPEED_CHUNK_FRAMES );
+        const size_t got = _readSource( p_data, p_data->varispeed_in.data(), want, false );
+        if ( got == 0 ){
+            break;
+        }
+        rs.write( p_data->varispeed_in.data(), got );
+    }
+
+    _applyGain( p_data, out, out, done );
+    return done;
+}
+
+/***
+ * Tops the stretcher's input up off the source, then takes what it
+ * has finished. Once the file is done, it plays out what it holds.
+*/
+/*static*/
+size_t AudioEngine::_readStretched( InternalAudioData *p_data, float *out, size_t frames, bool direct )
+{
+    Stretcher &stretch = p_data->stretch;
+    LoadedSource *source = p_data->source;
+    float *in = p_data->stretch_in.data();
+
+    for ( size_t room = stretch.space(); room > 0; ){
+        const size_t want = std::min<size_t>( room, STRETCH_CHUNK_FRAMES );
+        const size_t got = _walkSource( p_data, in, want, false );
+
+        stretch.push( in, got );
+        room -= got;
+
+        if ( got < want ){
+            break;
+        }
+    }
+
+    if ( source->seek_ticket == 0 
+        && p_data->loop_offset < 0 
+        && !_loopsHere( p_data ) 
+        && source->decoder->isFinished() ){
+        stretch.drain();
+    }
+
+    const size_t n = stretch.pull( out, frames );
+
+    if ( direct ){
+        p_data->varispeed.remember( out, n );
+        _applyGain( p_data, out, out, n );
+    }
+    return n;
+}
+
+/***
+ * The ring ran on ahead of what was heard, by what the stretcher
+ * held - back to where playback is. Inside a loop head the jump is
+ * small, and the head goes on from where it got to.
+*/
+/*static*/
+void AudioEngine::_leaveStretch( InternalAudioData *p_data )
+{
+    LoadedSource *source = p_data->source;
+
+    if ( p_data->loop_offset >= 0 || source->seek_ticket != 0 ){
+        return;
+    }
+
+    source->seek_position = std::max<int64_t>( 0, 
+        source->readHead.load( std::memory_order_relaxed ) - p_data->stretch.behind() );
+    source->seek_ticket = source->decoder->requestSeek( source->seek_position );
+}
+
+// what the resampler and the stretcher hold is from before a jump
+/*static*/
+void AudioEngine::_dropQueued( InternalAudioData *p_data )
+{
+    p_data->varispeed.reset();
+    p_data->resampling = !p_data->varispeed.settled();
+
+    if ( p_data->stretching ){
+        p_data->stretch.flush();
+    }
+}
+
+/***
+ * The slot is emptied before anything in it is looked at - from then
+ * on the engine cannot free it under us. Too early, it goes back; if
+ * the engine published a newer one meanwhile, this one is stale and
+ * is retired unplayed.
+*/
+/*static*/
+void AudioEngine::_takeSource( InternalAudioData *p_data, int64_t buffer_start )
+{
+    if ( p_data->source_slot.load( std::memory_order_relaxed ) == NULL || p_data->retired.write_available() == 0 ){
+        return;
+    }
+
+    LoadedSource *next = p_data->source_slot.exchange( NULL, std::memory_order_acq_rel );
+    if ( next == NULL ){
+        return;
+    }
+
+    if ( buffer_start < next->swap_at ){
+        LoadedSource *expected = NULL;
+        if ( !p_data->source_slot.compare_exchange_strong( expected, next, std::memory_order_acq_rel ) ){
+            p_data->retired.push( next );
+        }
+        return;
+    }
+
+    p_data->retired.push( p_data->source );
+    p_data->source = next;
+    next->taken.store( true, std::memory_order_release );
+
+    // a loop head belongs to the old one, so does what the resampler holds
+    p_data->loop_offset = -1;
+    _dropQueued( p_data );
+
+    p_data->rt_log.log( Bus::RT_SOURCE_SWAP, buffer_start, next->load );
+}
+
+/***
+ * Same handover as _takeSource(), minus the wait. A cleared loop goes
+ * back once playback is out of it; one replaced while its head plays
+ * sends the ring to where the head had got to.
+*/
+/*static*/
+void AudioEngine::_takeLoop( InternalAudioData *p_data, int64_t buffer_start )
+{
+    if ( p_data->loops_retired.write_available() == 0 ){
+        return;
+    }
+
+    if ( p_data->loop != NULL && !p_data->loop_armed && p_data->loop_offset < 0 ){
+        p_data->loops_retired.push( p_data->loop );
+        p_data->loop = NULL;
+    }
+
+    if ( p_data->loop_slot.load( std::memory_order_relaxed ) == NULL || p_data->loops_retired.write_available() == 0 ){
+        return;
+    }
+
+    LoopRegion *next = p_data->loop_slot.exchange( NULL, std::memory_order_acq_rel );
+    if ( next == NULL ){
+        return;
+    }
 
-    const int buffer_length = frameCount * p_data->info.channels;
-    /* clear output buffer */
-    memset( out, 0, sizeof(float) * buffer_length );
-    
-    if (!p_data->STOPPED){
+    if ( p_data->loop != NULL ){
+        _leaveLoop( p_data );
+        p_data->loops_retired.push( p_data->loop );
+    }
 
-        // write silence;
-        /* read directly into output buffer */
-        num_read = sf_read_float(p_data->file, out, buffer_length );
+    p_data->loop = next;
+    p_data->loop_armed = true;
 
-        _applyGain(p_data->GAIN, out, buffer_length);
+    p_data->rt_log.log( Bus::RT_LOOP_SET, buffer_start, next->a(), next->b(), next->headFrames() );
+}
 
-        p_data->readHead += (num_read / p_data->info.channels);
-        p_data->_q_ptr->head = p_data->readHead;
+// armed, for what is playing, and playback is between A and B
+/*static*/
+bool AudioEngine::_loopsHere( InternalAudioData *p_data )
+{
+    const LoopRegion *loop = p_data->loop;
 
+    if ( loop == NULL || !p_data->loop_armed 
+        || loop->load != p_data->source->load 
+        || loop->track != p_data->source->track 
+        || loop->channels() != p_data->info.channels ){
+        return false;
     }
-    
 
+    const int64_t head = p_data->source->readHead.load( std::memory_order_relaxed );
+    return head >= loop->a() && head <= loop->b();
+}
 
+/***
+ * The ring reached B: on from A, out of memory. The ring seeks to
+ * where the head ends, and has the whole head to get there - unless
+ * the head ends at B, where the ring already is.
+*/
+/*static*/
+void AudioEngine::_wrapLoop( InternalAudioData *p_data )
+{
+    const LoopRegion *loop = p_data->loop;
+    LoadedSource *source = p_data->source;
 
-    // float val;
-    // int pushedItems;
+    p_data->loop_offset = 0;
+    source->readHead.store( loop->a(), std::memory_order_relaxed );
 
-    // OUTPUT
-    
-    // if (p_data->_q_ptr->_queue_audio_to_ui.read_available() == 0){
-    
-    // for (int i = 0; i < frameCount * p_data->info.channels; i++)
-    // {
-    //     val = out[i];
-    //     pushedItems = p_data->_q_ptr->_queue_audio_to_ui.read_available();
-    //     p_data->readHead++;
+    if ( !loop->whole() ){
+        source->seek_position = loop->a() + loop->headFrames();
+        source->seek_ticket = source->decoder->requestSeek( source->seek_position );
+    }
+}
 
-    //     p_data->_logger->debug("_paStreamCallback - pushedItems={} - read head={}",pushedItems, p_data->readHead);
+// out of the head wherever it was - the ring goes on from there
+/*static*/
+void AudioEngine::_leaveLoop( InternalAudioData *p_data )
+{
+    if ( p_data->loop_offset < 0 ){
+        return;
+    }
 
-    //     if (pushedItems == W_QUEUE_SIZE){
-    //         p_data->_logger->debug("Queue full, popping");
-    //         if (!p_data->_q_ptr->_queue_audio_to_ui.pop()){
-    //             p_data->_logger->error("Error popping...");
-    //         }
-    //     }
+    LoadedSource *source = p_data->source;
 
-    //     if (!p_data->_q_ptr->_queue_audio_to_ui.push( val )){
+    source->seek_position = p_data->loop->a() + p_data->loop_offset;
+    source->seek_ticket = source->decoder->requestSeek( source->seek_position );
+    p_data->loop_offset = -1;
+}
 
-    //         int writespace = p_data->_q_ptr->_queue_audio_to_ui.write_available();
+/***
+ * Plays the head, and wraps inside it while the loop is whole and
+ * armed. Once the head runs out, the ring takes over. direct as in
+ * _readSource().
+*/
+/*static*/
+size_t AudioEngine::_renderLoopHead( InternalAudioData *p_data, float *out, size_t frames, bool direct )
+{
+    const LoopRegion *loop = p_data->loop;
+    const int64_t n = loop->read( p_data->loop_offset, out, frames );
 
-    //         printf("Failed to push value %f into position %d.\n", val, i);
-    //         printf("Queue already had %d items. And can take %d.\n", pushedItems, writespace );
-    //         return paAbort;
-        
-    //     }
+    if ( direct ){
+        p_data->varispeed.remember( out, n );
+        _applyGain( p_data, out, out, n );
+    }
+    p_data->loop_offset += n;
 
-    // }
-    // }
+    if ( p_data->loop_offset == loop->headFrames() ){
+        p_data->loop_offset = p_data->loop_armed && loop->whole() ? 0 : -1;
+    }
 
-    
-    // p_data->_logger->flush();
+    p_data->source->readHead.store( 
+        p_data->loop_offset < 0 ? loop->a() + loop->headFrames() : loop->a() + p_data->loop_offset, 
+        std::memory_order_relaxed );
 
-    /*  If we couldn't read a full frameCount of samples we've reached EOF */
-    if (num_read < frameCount)
-    {
-        p_data->_logger->debug("File reached the end");
-        p_data->_logger->flush();
+    return n;
+}
 
-        return paComplete;
-    }
-    
-    return paContinue;
+/*static*/
+void AudioEngine::_crossBoundary( InternalAudioData *p_data, const TrackBoundary &boundary )
+{
+    p_data->source->decoder->crossBoundary();
+
+    p_data->source->readHead.store( 0, std::memory_order_relaxed );
+    p_data->source->track = boundary.track;
+    p_data->source->track_frames = boundary.frames;
+
+    p_data->rt_log.log( 
+        Bus::RT_TRACK_CHANGE, 
+        p_data->stream_frame.load( std::memory_order_relaxed ), 
+        boundary.track, 
+        (double)boundary.frames );
 }
 
 // https://github.com/hosackm/wavplayer/blob/master/src/wavplay.c
 void AudioEngine::run(){
 
     _logger->debug("Starting playFile()");
-    
-    if ( Pa_Initialize() != paNoError){
-        _logger->error("run() : Error initing the AudioEngine");
-        throw std::runtime_error("Error initing the AudioEngine");
-    }
 
     if ( _data == NULL ){
-        Pa_Terminate();
         _logger->error("run() : No data to play, shutting down.");
         throw std::runtime_error("No data to play, shutting down.");
     }
 
+    _startFile();
+
+    if ( _backend == NULL ){
+        _backend = new PortAudioBackend( _logger );
+    }
+
+    if ( _auto_buffer ){
+        _frames_per_buffer = _tuner.start();
+    }
+
     _openStream();
     _startStream();
+    _streaming = true;
+    _stream_done = false;
     
     bool _QUIT_SIG = false;
+
+    // ticks keep time on their own - a stream of commands must not hold them off
+    boost::chrono::steady_clock::time_point next_tick = boost::chrono::steady_clock::now() + boost::chrono::milliseconds( ENGINE_TICK_MS );
     
-    /* Main Event Loop */
+    /* Main Event Loop - sleeps until a command, end of stream or tick */
     while (!_QUIT_SIG){
 
-        Bus::Command _cmd;
+        int64_t wait_ms = boost::chrono::duration_cast<boost::chrono::milliseconds>( 
+            next_tick - boost::chrono::steady_clock::now() ).count();
+
+        // a reopen waits on the callback, a buffer or so - look again soon
+        if ( _reopen_frames != 0 ){
+            wait_ms = std::min<int64_t>( wait_ms, 1 );
+        }
+
+        if ( wait_ms > 0 ){
+            _queues_ptr->_engine_wakeup.waitFor( (int)wait_ms );
+        }
+
+        const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+        if ( now >= next_tick ){
+            _onTick();
+            next_tick = now + boost::chrono::milliseconds( ENGINE_TICK_MS );
+        }
+
+        if ( _reopen_frames != 0 
+            && ( getStreamFrame() >= _reopen_silent_from || now >= _reopen_deadline ) ){
+            _finishReopen();
+        }
+
+        if ( _stats_dump_requested.exchange( false ) ){
+            _dumpStats( "on request" );
+        }
+
+        _reclaimSources();
+        _publishLoop();
+
+        if ( _data->FINISHED.exchange(false) ){
+            _logger->info("run() - stream finished");
+            _stream_done = true;
+
+            // loaded just as the old source ran out - it never got taken
+            LoadedSource *pending = _data->source_slot.exchange( NULL, std::memory_order_acq_rel );
+
+            if ( pending != NULL ){
+                _restartStream( pending );
+            } else if ( _next_track < _playlist.size() ){
+                _playOnNewStream();
+            }
+        }
+
+        std::string *path;
+        while ( _queues_ptr->_load_requests.pop( path ) ){
+            try {
+                loadFile( *path );
+            } catch ( const std::runtime_error &e ){
+                _logger->warn("run() - could not load {}: {}", *path, e.what());
+            }
+            delete path;
+        }
+
+        Bus::Message _msg;
         // Process User Actions
-        while ( _queues_ptr->_queue_commands.pop(_cmd)) {
+        while ( _queues_ptr->_queue_commands.pop(_msg)) {
+
+            const Bus::Command _cmd = _msg.cmd;
             
             if ( _cmd == Bus::Command::QUIT ){
 
                 _QUIT_SIG = true;
 
-                // stop stream from Callback
-                if (!_data->STOPPED){
-                    _data->STOPPED = true;
-                }
+                // silence the callback before the stream drains
+                Bus::Message pause;
+                pause.cmd = Bus::Command::SET_PAUSED;
+                pause.value = 1;
+                schedule( pause );
 
                 _stopStream();
             } else if ( _cmd == Bus::Command::PAUSE_PLAY ){
 
-                if (!_data->STOPPED){
-                    _logger->debug("run() - cmd == Bus::Command::PAUSE_PLAY, PAUSING");
-                    _data->STOPPED = true;
-                } else {
-                    _logger->debug("run() - cmd == Bus::Command::PAUSE_PLAY, PLAYING");
-                    _data->STOPPED = false;
-                }
+                _paused = !_paused;
+                _logger->debug("run() - cmd == Bus::Command::PAUSE_PLAY, {}", _paused ? "PAUSING" : "PLAYING");
+
+                Bus::Message pause;
+                pause.cmd = Bus::Command::SET_PAUSED;
+                pause.at_frame = _msg.at_frame;
+                pause.value = _paused ? 1 : 0;
+                schedule( pause );
             
             } else if ( _cmd == Bus::Command::NUDGE_GAIN_DWN || _cmd == Bus::Command::NUDGE_GAIN_UP ){
                 _nudgeGain( _cmd == Bus::Command::NUDGE_GAIN_DWN );
+
+            } else if ( _cmd == Bus::Command::SET_PAUSED ){
+                _paused = _msg.value != 0;
+                schedule( _msg );
+
+            } else if ( _cmd == Bus::Command::SET_GAIN ){
+                _gain = std::min( 1.0f, std::max( 0.0f, _msg.value ) );
+                _msg.value = _gain;
+                schedule( _msg );
+
+            } else if ( _cmd == Bus::Command::SET_LOOP ){
+                _setLoop( _msg );
+
+            } else if ( _cmd == Bus::Command::SET_TEMPO ){
+                _setTempo( _msg.value );
+
+            } else if ( _cmd == Bus::Command::SET_SPEED ){
+                setSpeed( _msg.value );
+                _msg.value = _speed;
+                _logger->debug("run() - speed {:.3f}x", _speed);
+                schedule( _msg );
+
+            } else if ( _cmd == Bus::Command::SEEK 
+                || _cmd == Bus::Command::SCRUB 
+                || _cmd == Bus::Command::SCRUB_END 
+                || _cmd == Bus::Command::CLEAR_LOOP ){
+
+                // the block readers sleep while nobody scrubs
+                if ( _cmd == Bus::Command::SCRUB ){
+                    _blocks.wake();
+                }
+
+                // a loop still decoding is not wanted either
+                if ( _cmd == Bus::Command::CLEAR_LOOP ){
+                    _loop_builder.cancel();
+                }
+                schedule( _msg );
             }
         }
     }
 
+    _dumpStats( "at exit" );
+
     _closeStream();
+    _streaming = false;
     _closeFile();
 
 }
 
-void AudioEngine::_openStream()
+/***
+ * Same callback the device would call, fed a synthetic clock. The
+ * decoder is topped up on this thread before every block, so the
+ * callback never sees an underrun; the last block is trimmed to
+ * the file's length. Timing covers only the callback itself.
+*/
+RenderReport AudioEngine::render( const std::string &out_path )
 {
-    _logger->debug("AudioEngine::_openStream()");
+    if ( _data == NULL ){
+        _logger->error("render() : No data to render, shutting down.");
+        throw std::runtime_error("No data to render, shutting down.");
+    }
+
+    const int channels = _data->info.channels;
+    const double sr = _data->info.samplerate;
+
+    SF_INFO out_info;
+    memset( &out_info, 0, sizeof(out_info) );
+    out_info.samplerate = _data->info.samplerate;
+    out_info.channels = channels;
+    out_info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+
+    SNDFILE *out_file = sf_open( out_path.c_str(), SFM_WRITE, &out_info );
+    if ( out_file == NULL ){
+        throw std::runtime_error("Could not open " + out_path + ": " + sf_strerror(NULL));
+    }
+
+    std::vector<float> block( _frames_per_buffer * channels );
+    Stats::Timings timings;
+    timings.reserve( _data->info.frames / _frames_per_buffer + 1 );
+
+    RenderReport report;
+    report.block_budget_us = 1e6 * _frames_per_buffer / sr;
+
+    PaStreamCallbackTimeInfo time_info;
+    memset( &time_info, 0, sizeof(time_info) );
+
+    _data->rt_log.start();
+
+    const boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    int result = paContinue;
+
+    while ( result == paContinue ){
 
-    PaError e = Pa_OpenDefaultStream(
-        &stream,
-        0,
-        _data->info.channels,
-        paFloat32,
-        _data->info.samplerate,
-        FRAMES_IN_BUFFER,
-        _paStreamCallback,
-        _data
-    );
+        _feedDecoder();
+        _loaded->decoder->topUp();
 
-    if (e != paNoError){
-        std::string msg = Pa_GetErrorText( e );
-        _logger->error( "Error opening stream. msg; {}", msg );
-        throw std::runtime_error("Could not Open stream.");
+        time_info.currentTime = report.frames / sr;
+        time_info.outputBufferDacTime = time_info.currentTime;
+
+        const uint64_t consumed = _loaded->decoder->ring().readPosition();
+
+        const boost::chrono::steady_clock::time_point t0 = boost::chrono::steady_clock::now();
+        result = _paStreamCallback( NULL, block.data(), _frames_per_buffer, &time_info, 0, _data );
+        const boost::chrono::steady_clock::time_point t1 = boost::chrono::steady_clock::now();
+
+        timings.add( boost::chrono::duration<double, boost::micro>( t1 - t0 ).count() );
+
+        // the last block is only as long as what was left in the ring
+        const int64_t keep = result == paContinue 
+            ? (int64_t)_frames_per_buffer 
+            : (int64_t)( _loaded->decoder->ring().readPosition() - consumed );
+        sf_writef_float( out_file, block.data(), keep );
+
+        report.frames += keep;
+        report.blocks++;
+    }
+
+    report.wall_seconds = boost::chrono::duration<double>( boost::chrono::steady_clock::now() - start ).count();
+    sf_close( out_file );
+    _data->rt_log.stop();
+
+    if ( _next_track < _playlist.size() ){
+        _logger->warn("render() - stopped at track {}, the rest does not match {} ch at {} Hz", 
+            _next_track, channels, _data->info.samplerate);
     }
+
+    report.audio_seconds = report.frames / sr;
+    report.callback_seconds = timings.total() / 1e6;
+    report.block_p50_us = timings.percentile( 50 );
+    report.block_p99_us = timings.percentile( 99 );
+    report.block_p999_us = timings.percentile( 99.9 );
+    report.block_max_us = timings.max();
+
+    _logger->info(
+        "render() - {} frames to {}, {:.1f}x real time ({:.1f}x in the callback)",
+        report.frames,
+        out_path,
+        report.audio_seconds / report.wall_seconds,
+        report.audio_seconds / report.callback_seconds );
+
+    return report;
+}
+
+void AudioEngine::_openStream()
+{
+    _logger->debug("AudioEngine::_openStream() - {}, {} frames per buffer", _backend->name(), _frames_per_buffer);
+
+    StreamConfig config;
+    config.channels = _data->info.channels;
+    config.samplerate = _data->info.samplerate;
+    config.frames_per_buffer = _frames_per_buffer;
+    config.suggested_latency = _latency;
+
+    _backend->open( config, _paStreamCallback, _paStreamFinished, _data );
+}
+
+/*static*/
+void AudioEngine::_paStreamFinished( void *userData )
+{
+    InternalAudioData *p_data = (InternalAudioData*)userData;
+
+    p_data->FINISHED = true;
+    p_data->_q_ptr->_engine_wakeup.notify();
 }
 
 void AudioEngine::_startStream()
 {
     _logger->debug("AudioEngine::_startStream()");
-    PaError e = Pa_StartStream(stream);
-
-    if (e != paNoError){
-        std::string msg = Pa_GetErrorText( e );
-        _logger->error( "Error starting stream. msg; {}", msg );
-        throw std::runtime_error("Could not Start stream.");
-    }
+    _backend->start();
 }
 
 void AudioEngine::_stopStream()
 {
     _logger->debug("AudioEngine::_stopStream()");
-    PaError e = Pa_StopStream(stream);
-
-    if (e != paNoError){
-        std::string msg = Pa_GetErrorText( e );
-        _logger->error( "Error stopping stream. msg; {}", msg );
-        throw std::runtime_error("Could not Stop stream.");
-    }
+    _backend->stop();
 }
 
 void AudioEngine::_closeStream()
 {
     _logger->debug("AudioEngine::_closeStream()");
-    PaError e = Pa_CloseStream(stream);
-
-    stream = NULL; 
-
-    if (e != paNoError){
-        std::string msg = Pa_GetErrorText( e );
-        _logger->error( "Error closing stream. msg; {}", msg );
-        throw std::runtime_error("Could not close stream.");
-    }
-
+    _backend->close();
 }
 
 void AudioEngine::_closeFile()
@@ -271,26 +1425,111 @@ void AudioEngine::_closeFile()
     _logger->info("Closing File");
     _logger->flush();
     
-    /* Close the soundfile */
-    sf_close(_data->file);
-    
-    PaError err = Pa_Terminate();
-    if(err != paNoError)
-    {
-        throw std::runtime_error("Error terminating Portaudio.\n");
-    }
-
+    /* Decoder thread goes first, it is still reading the file */
+    _data->source->decoder->stop();
+    _data->source->analyser->stop();
+    _data->rt_log.stop();
 }
 
 
 const SF_INFO &AudioEngine::getSoundFileInfo()
 {
-    return _data->info;
+    return _loaded->info;
 }
 
 const std::string &AudioEngine::getPathToFile()
 {
-    return _data->file_path;
+    return _loaded->file_path;
+}
+
+void AudioEngine::setRingFrames( size_t frames )
+{
+    _ring_frames = std::max<size_t>( frames, DECODER_CHUNK_FRAMES );
+}
+
+void AudioEngine::setFramesPerBuffer( unsigned long frames )
+{
+    _frames_per_buffer = frames;
+}
+
+void AudioEngine::setLatency( double seconds )
+{
+    _latency = seconds;
+}
+
+void AudioEngine::setAutoBuffer( bool on )
+{
+    _auto_buffer = on;
+}
+
+void AudioEngine::setResampleQuality( ResampleQuality quality )
+{
+    _quality = quality;
+}
+
+void AudioEngine::setSpeed( double speed )
+{
+    _speed = std::min( VARISPEED_MAX, std::max( VARISPEED_MIN, speed ) );
+}
+
+void AudioEngine::setStretchMode( StretchMode mode )
+{
+    _stretch_mode = mode;
+}
+
+void AudioEngine::setOutputRate( int samplerate )
+{
+    _output_rate = samplerate;
+}
+
+/***
+ * What files open at - asks the device, so the backend is made
+ * here if nothing has set one yet. The filters for the usual pairs
+ * into a rate are built the first time it comes up, not when the
+ * first file at one of them is opened.
+*/
+int AudioEngine::_streamRate()
+{
+    int rate = _output_rate;
+
+    if ( rate == OUTPUT_RATE_NATIVE ){
+        if ( _backend == NULL ){
+            _backend = new PortAudioBackend( _logger );
+        }
+        rate = _backend->nativeRate();
+    }
+
+    if ( rate > 0 && rate != _prebuilt_rate ){
+        RatioFilter::prebuild( rate );
+        _prebuilt_rate = rate;
+        _logger->info("_streamRate() - playing at {} Hz", rate);
+    }
+
+    return std::max( rate, 0 );
+}
+
+void AudioEngine::setBackend( Backend *backend )
+{
+    delete _backend;
+    _backend = backend;
+}
+
+bool AudioEngine::getLoudness( Cache::Loudness &out )
+{
+    size_t size;
+    const uint8_t *p = _cache != NULL ? _cache->section( Cache::LOUDNESS, &size ) : NULL;
+
+    if ( p == NULL || size != sizeof(Cache::Loudness) ){
+        return false;
+    }
+
+    memcpy( &out, p, sizeof(out) );
+    return true;
+}
+
+float AudioEngine::getRingFillLevel()
+{
+    return _loaded->decoder->ring().fillLevel();
 }
 
 void AudioEngine::registerQueues( Bus::Queues *q_ptr )
@@ -299,15 +1538,226 @@ void AudioEngine::registerQueues( Bus::Queues *q_ptr )
     _data->_q_ptr = q_ptr;
 }
 
+bool AudioEngine::schedule( const Bus::Message &msg )
+{
+    if ( !_data->rt_commands.push( msg ) ){
+        _logger->warn("schedule() - callback queue full, dropping command {}", (int)msg.cmd);
+        return false;
+    }
+    return true;
+}
+
+int64_t AudioEngine::getStreamFrame()
+{
+    return _data->stream_frame.load( std::memory_order_relaxed );
+}
+
+/*static*/
+void AudioEngine::requestStatsDump()
+{
+    _stats_dump_requested.store( true );
+}
+
+Wayver::Bus::CallbackStats AudioEngine::_callbackStats()
+{
+    Bus::CallbackStats stats;
+    const Stats::Histogram &h = _data->callback_ns;
+
+    stats.callbacks = h.count();
+    stats.underflows = _data->underflows.load( std::memory_order_relaxed );
+    stats.overflows = _data->overflows.load( std::memory_order_relaxed );
+
+    stats.p50_us = h.percentile( 50 ) / 1e3;
+    stats.p99_us = h.percentile( 99 ) / 1e3;
+    stats.p999_us = h.percentile( 99.9 ) / 1e3;
+    stats.max_us = h.max() / 1e3;
+    stats.budget_us = 1e6 * _frames_per_buffer / _data->info.samplerate;
+
+    stats.cpu_load = _backend != NULL ? _backend->cpuLoad() : 0;
+    stats.dac_drift_ms = 1e3 * _data->dac_drift.load( std::memory_order_relaxed );
+    stats.output_latency_ms = 1e3 * _data->output_latency.load( std::memory_order_relaxed );
+
+    return stats;
+}
+
+void AudioEngine::_publishStats()
+{
+    _queues_ptr->_stats_to_ui.writeBuffer() = _callbackStats();
+    _queues_ptr->_stats_to_ui.publish();
+}
+
+void AudioEngine::_dumpStats( const char *why )
+{
+    const Bus::CallbackStats s = _callbackStats();
+
+    _logger->info(
+        "Callback stats ({}) - {} callbacks of {} frames via {}\n"
+        "  time    p50={:.1f}us p99={:.1f}us p99.9={:.1f}us max={:.1f}us budget={:.1f}us\n"
+        "  xruns   underflow={} overflow={}\n"
+        "  device  cpu load={:.1f}% output latency={:.2f}ms dac drift={:.3f}ms",
+        why, s.callbacks, _frames_per_buffer, _backend != NULL ? _backend->name() : "-",
+        s.p50_us, s.p99_us, s.p999_us, s.max_us, s.budget_us,
+        s.underflows, s.overflows,
+        100 * s.cpu_load, s.output_latency_ms, s.dac_drift_ms );
+    _logger->flush();
+}
+
+void AudioEngine::_onTick()
+{
+    _publishStats();
+    _feedDecoder();
+
+    if ( _auto_buffer && _reopen_frames == 0 && !_loaded->decoder->isFinished() ){
+        const unsigned long frames = _tuner.observe( 
+            _data->underflows.load( std::memory_order_relaxed ), 
+            _backend->cpuLoad() );
+
+        if ( frames != 0 ){
+            _reopenStream( frames );
+        }
+    }
+
+    float fill = _loaded->decoder->ring().fillLevel();
+
+    if ( !_paused && !_loaded->decoder->isFinished() && fill < 0.25 ){
+        _logger->warn("_onTick() - decoder ring running low: {}", fill);
+    }
+}
+
+/***
+ * Swap the stream for one with a different buffer size, without a
+ * click and without skipping audio:
+ *
+ *      - Playing: glide to silence, then pause the callback once the
+ *      glide is done - paused, it stops consuming the ring. run()
+ *      keeps handling commands meanwhile, and calls _finishReopen()
+ *      once that buffer has been rendered
+ *      - Already paused: the gap is silent anyway, just reopen
+*/
+void AudioEngine::_reopenStream( unsigned long frames )
+{
+    _logger->info("_reopenStream() - {} -> {} frames per buffer", _frames_per_buffer, frames);
+
+    _reopen_frames = frames;
+
+    if ( _paused ){
+        _finishReopen();
+        return;
+    }
+
+    Bus::Message fade;
+    fade.cmd = Bus::Command::SET_GAIN;
+    fade.value = 0;
+    schedule( fade );
+
+    Bus::Message pause;
+    pause.cmd = Bus::Command::SET_PAUSED;
+    pause.at_frame = getStreamFrame() + GAIN_RAMP_FRAMES + _frames_per_buffer;
+    pause.value = 1;
+    schedule( pause );
+
+    // a stream that stops on its own never gets there - give up after a second
+    _reopen_silent_from = pause.at_frame + _frames_per_buffer;
+    _reopen_deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds( 1 );
+}
+
+/***
+ * Pa_StopStream plays out what is left, then the new size opens;
+ * unpause and glide back to the engine's gain, unless a pause came
+ * in while it waited. A size the device refuses puts the old one
+ * back and ends tuning.
+*/
+void AudioEngine::_finishReopen()
+{
+    const unsigned long old_frames = _frames_per_buffer;
+    const unsigned long frames = _reopen_frames;
+    _reopen_frames = 0;
+
+    _stopStream();
+    _closeStream();
+
+    // the new stream brings its own DAC clock
+    _data->dac_origin = -1;
+    _frames_per_buffer = frames;
+
+    try {
+        _openStream();
+    } catch ( const std::runtime_error & ){
+        _logger->warn("_reopenStream() - {} frames refused, staying at {} and no more tuning", frames, old_frames);
+        _auto_buffer = false;
+        _frames_per_buffer = old_frames;
+        _openStream();
+    }
+
+    _startStream();
+    _tuner.reopened( _frames_per_buffer, _data->underflows.load( std::memory_order_relaxed ) );
+
+    if ( !_paused ){
+        Bus::Message resume;
+        resume.cmd = Bus::Command::SET_PAUSED;
+        resume.value = 0;
+        schedule( resume );
+
+        Bus::Message fade;
+        fade.cmd = Bus::Command::SET_GAIN;
+        fade.value = _gain;
+        schedule( fade );
+    }
+}
+
+/***
+ * Into or out of the stretcher the audio jumps - it starts from
+ * nothing, or what it held is dropped - so that happens under a
+ * fade, as in _reopenStream(). From one tempo off 1x to another it
+ * just carries on.
+*/
+void AudioEngine::_setTempo( double tempo )
+{
+    tempo = std::min( STRETCH_MAX_TEMPO, std::max( STRETCH_MIN_TEMPO, tempo ) );
+
+    const bool switches = ( tempo != 1 ) != ( _tempo != 1 );
+    _tempo = tempo;
+    _logger->debug("_setTempo() - {:.2f}x", _tempo);
+
+    // worker up before the callback needs it, let go once it is back at 1x
+    _data->stretch.want( _tempo != 1 );
+
+    Bus::Message msg;
+    msg.cmd = Bus::Command::SET_TEMPO;
+    msg.value = _tempo;
+
+    if ( !switches || _paused ){
+        schedule( msg );
+        return;
+    }
+
+    Bus::Message fade;
+    fade.cmd = Bus::Command::SET_GAIN;
+    fade.value = 0;
+    schedule( fade );
+
+    msg.at_frame = getStreamFrame() + GAIN_RAMP_FRAMES + _frames_per_buffer;
+    schedule( msg );
+
+    fade.at_frame = msg.at_frame;
+    fade.value = _gain;
+    schedule( fade );
+}
+
 void AudioEngine::_nudgeGain( bool DOWN )
 {
-    if ( !DOWN && _data->GAIN < 1 ){
-        _logger->debug("_nudgeGain UP - current: {}", _data->GAIN );
-        _data->GAIN += _GAIN_STEP;
-    } else if ( DOWN ) {
-        _logger->debug("_nudgeGain DWN - current: {}", _data->GAIN );
-        _data->GAIN -= _GAIN_STEP;
+    if ( !DOWN && _gain < 1 ){
+        _logger->debug("_nudgeGain UP - current: {}", _gain );
+        _gain = std::min( 1.0f, _gain + _GAIN_STEP );
+    } else if ( DOWN && _gain > 0 ) {
+        _logger->debug("_nudgeGain DWN - current: {}", _gain );
+        _gain = std::max( 0.0f, _gain - _GAIN_STEP );
     }
+
+    Bus::Message msg;
+    msg.cmd = Bus::Command::SET_GAIN;
+    msg.value = _gain;
+    schedule( msg );
 }
 
 
@@ -356,10 +1806,36 @@ std::string AudioEngine::_arrayToString(float *arr, int len){
     return retval;
 }
 
+/***
+ * out = in * gain, ramping towards GAIN over GAIN_RAMP_FRAMES 
+ * after every SET_GAIN instead of jumping - jumps click.
+*/
 /*static*/
-void AudioEngine::_applyGain( float gain, float *arr, int size ){
-    assert(gain<=1);
-    for (int i=0;i<size;i++){
-        arr[i] = gain * arr[i];
+void AudioEngine::_applyGain( InternalAudioData *p_data, const float *in, float *out, size_t frames )
+{
+    const int channels = p_data->info.channels;
+    size_t done = 0;
+
+    if ( p_data->ramp_left > 0 ){
+
+        done = std::min( frames, (size_t)p_data->ramp_left );
+        p_data->ramp_left -= done;
+
+        float g_end = Dsp::rampValue( 
+            p_data->gain_from, 
+            p_data->GAIN, 
+            1 - (float)p_data->ramp_left / GAIN_RAMP_FRAMES, 
+            p_data->ramp_shape );
+
+        Dsp::gainRamp( in, out, done, channels, p_data->gain_now, g_end, p_data->ramp_shape );
+        p_data->gain_now = g_end;
     }
+
+    Dsp::gainRamp( 
+        in + done * channels, 
+        out + done * channels, 
+        frames - done, 
+        channels, 
+        p_data->gain_now, 
+        p_data->gain_now );
 }
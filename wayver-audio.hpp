@@ -3,6 +3,19 @@
 #include <wayver-defines.hpp>
 #include <wayver-ui.hpp>
 #include <wayver-bus.hpp>
+#include <wayver-rtlog.hpp>
+#include <wayver-decoder.hpp>
+#include <wayver-analysis.hpp>
+#include <wayver-cache.hpp>
+#include <wayver-dsp.hpp>
+#include <wayver-backend.hpp>
+#include <wayver-loop.hpp>
+#include <wayver-resampler.hpp>
+#include <wayver-scrub.hpp>
+#include <wayver-source.hpp>
+#include <wayver-stretch.hpp>
+#include <wayver-stats.hpp>
+#include <wayver-tuner.hpp>
 
 #include <portaudio.h>
 #include <sndfile.hh>
@@ -19,6 +32,7 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <boost/lockfree/spsc_queue.hpp>
+#include <boost/chrono.hpp>
 
 
 // about FFTs:
@@ -27,30 +41,195 @@ namespace Wayver {
 
     namespace Audio {
 
+        /***
+         * One loaded source as the callback plays it: its decoder,
+         * analyser and how far into it playback is. Built and torn
+         * down off the audio thread - the callback only switches
+         * from one to the next, see InternalAudioData::source_slot
+        */
+        struct LoadedSource {
+
+            // takes ownership of source, via the decoder
+            LoadedSource( 
+                Source *source, 
+                const std::string &path, 
+                size_t ring_frames, 
+                std::shared_ptr<spdlog::logger> logger );
+            ~LoadedSource();
+
+            /* The first track's format and length */
+            SF_INFO info;
+
+            std::string file_path;
+
+            /* Reads ahead of the callback, which only touches its ring */
+            Decoder *decoder = NULL;
+
+            /* Spectrum off the decoder, paced by readHead */
+            SpectrumAnalyser *analyser = NULL;
+
+            /* Frames read - written by the callback only */
+            std::atomic<int64_t> readHead{0};
+
+            // which loadFile() / loadSource() this is, counted from 1
+            uint32_t load = 0;
+
+            // stream frame the callback may take it over at
+            int64_t swap_at = 0;
+
+            // set by the callback once it plays this one
+            std::atomic<bool> taken{false};
+
+            /* Callback-owned once it is playing */
+            // playlist index of what is playing and its length - the
+            // callback moves them on at each track boundary
+            int track = 0;
+            int64_t track_frames = 0;
+
+            // outstanding decoder seek, 0 -> none
+            uint32_t seek_ticket = 0;
+            int64_t seek_position = 0;
+
+            // ring ran short last segment - log the first one only
+            bool underrun = false;
+        };
+
         /***
          * Object that is passed to paCallback,
          * used to exchange data between Audio Thread
-         * and outside world
+         * and outside world. Lives as long as the stream
         */
         struct InternalAudioData {
 
-            InternalAudioData( const std::string &path );
+            // takes ownership of source, which starts out playing
+            InternalAudioData( 
+                LoadedSource *source, 
+                std::shared_ptr<spdlog::logger> logger, 
+                ResampleQuality quality, 
+                StretchMode stretch_mode );
             ~InternalAudioData();
 
-            SNDFILE* file = NULL;
+            /* The stream's format - every source played on it matches it */
             SF_INFO  info;
 
-            std::string file_path;
+            /***
+             * RCU-style source slot.
+             * 
+             *      - source is what the callback plays, callback-owned
+             *      - The engine publishes a replacement in source_slot;
+             *      the callback exchanges it out at the start of a buffer
+             *      once its swap_at is reached, and hands the one it
+             *      replaced back through retired - never frees it
+             *      - The engine frees whatever comes out of retired, and
+             *      anything it finds still unclaimed in the slot
+            */
+            LoadedSource *source = NULL;
+            std::atomic<LoadedSource*> source_slot{NULL};
+            boost::lockfree::spsc_queue<LoadedSource*,boost::lockfree::capacity<RETIRE_QUEUE_SIZE>> retired;
 
-            /* Frames read */
-            int readHead = 0;
             Bus::Queues *_q_ptr = NULL;
-            std::shared_ptr<spdlog::logger> _logger;
 
+            /* the callback logs through this, never spdlog */
+            Bus::RtLog rt_log;
+
+            /* 
+             * Callback-owned: only the callback writes STOPPED and GAIN,
+             * everyone else goes through rt_commands
+            */
             // set to true when stopping -> avoid pop
             bool STOPPED = false;
-
             float GAIN = 1;
+
+            // GAIN is where we are heading, gain_now where we are
+            float gain_now = 1;
+            float gain_from = 1;
+            int ramp_left = 0;
+            Dsp::RampShape ramp_shape = Dsp::RAMP_EXPONENTIAL;
+
+            // dragging on the scrubber - grains instead of the ring
+            bool scrubbing = false;
+            GrainPlayer grains;
+
+            /***
+             * A/B loop, handed over like the source: the engine publishes
+             * a region in loop_slot, the callback takes it at the start
+             * of a buffer and hands back the one it held through
+             * loops_retired. Callback-owned:
+             * 
+             *      - loop_armed -> wraps at B. CLEAR_LOOP only disarms,
+             *      so what is playing runs on past B without a seek
+             *      - loop_offset -> where in the region's head playback
+             *      is, -1 while it plays from the ring
+            */
+            LoopRegion *loop = NULL;
+            std::atomic<LoopRegion*> loop_slot{NULL};
+            boost::lockfree::spsc_queue<LoopRegion*,boost::lockfree::capacity<RETIRE_QUEUE_SIZE>> loops_retired;
+            bool loop_armed = false;
+            int64_t loop_offset = -1;
+
+            /***
+             * Varispeed, callback-owned. resampling -> the source goes
+             * out through varispeed, fed VARISPEED_CHUNK_FRAMES at a
+             * time through varispeed_in. Off at a settled 1x, where the
+             * ring copies straight out.
+            */
+            Resampler varispeed;
+            bool resampling = false;
+            std::vector<float> varispeed_in;
+
+            /***
+             * Time-stretch, ahead of varispeed. stretching -> the source
+             * goes through stretch, handed over STRETCH_CHUNK_FRAMES at
+             * a time through stretch_in; off at 1x
+            */
+            Stretcher stretch;
+            bool stretching = false;
+            std::vector<float> stretch_in;
+
+            // engine -> callback, applied at the frame they ask for
+            boost::lockfree::spsc_queue<Bus::Message,boost::lockfree::capacity<RT_QUEUE_SIZE>> rt_commands;
+
+            // callback-owned: taken off rt_commands but not due yet, in the order they came
+            Bus::Message rt_pending[RT_QUEUE_SIZE];
+            int rt_pending_count = 0;
+
+            // frames rendered since the stream started
+            std::atomic<int64_t> stream_frame{0};
+
+            // set by PortAudio once the stream has run to its end
+            std::atomic<bool> FINISHED{false};
+
+            /* Instrumentation - callback writes, engine reads */
+            // callback execution time, ns
+            Stats::Histogram callback_ns;
+            std::atomic<uint64_t> underflows{0};
+            std::atomic<uint64_t> overflows{0};
+
+            // DAC time of stream frame 0, < 0 until the first callback says
+            double dac_origin = -1;
+            std::atomic<double> dac_drift{0};
+            std::atomic<double> output_latency{0};
+        };
+
+        // what an offline render() measured
+        struct RenderReport {
+            int64_t frames = 0;
+            int64_t blocks = 0;
+
+            // audio rendered, wall clock for the whole run, and the
+            // part of it spent inside the callback
+            double audio_seconds = 0;
+            double wall_seconds = 0;
+            double callback_seconds = 0;
+
+            // per block, in microseconds
+            double block_p50_us = 0;
+            double block_p99_us = 0;
+            double block_p999_us = 0;
+            double block_max_us = 0;
+
+            // what a block may take to keep up in real time
+            double block_budget_us = 0;
         };
 
         /***
@@ -64,10 +243,21 @@ namespace Wayver {
             private:
                 
                 InternalAudioData* _data = NULL;
-                PaStream *stream = NULL;
+
+                // what earlier runs already worked out about this file
+                std::shared_ptr<Cache::Entry> _cache;
+
+                // PortAudio unless setBackend() said otherwise, owned
+                Backend *_backend = NULL;
                 std::shared_ptr<spdlog::logger> _logger;
                 Bus::Queues *_queues_ptr;
 
+                // decoded blocks scrub grains play from, outlives streams
+                BlockCache _blocks;
+
+                // SET_LOOP decodes here, _publishLoop() hands the result to the callback
+                LoopBuilder _loop_builder;
+
                 static int _paStreamCallback( 
                     const void *inputBuffer,
                     void *outputBuffer,
@@ -77,6 +267,35 @@ namespace Wayver {
                     void *userData
                 );
 
+                static void _paStreamFinished( void *userData );
+
+                // callback helpers - run on the audio thread
+                static void _applyMessage( InternalAudioData *p_data, const Bus::Message &msg );
+                static void _renderSegment( InternalAudioData *p_data, float *out, unsigned long frames );
+                static void _crossBoundary( InternalAudioData *p_data, const TrackBoundary &boundary );
+                static void _takeSource( InternalAudioData *p_data, int64_t buffer_start );
+                static void _takeLoop( InternalAudioData *p_data, int64_t buffer_start );
+                static bool _loopsHere( InternalAudioData *p_data );
+                static void _wrapLoop( InternalAudioData *p_data );
+                static void _leaveLoop( InternalAudioData *p_data );
+                static size_t _renderLoopHead( InternalAudioData *p_data, float *out, size_t frames, bool direct );
+                static size_t _readSource( InternalAudioData *p_data, float *out, size_t frames, bool direct );
+                static size_t _walkSource( InternalAudioData *p_data, float *out, size_t frames, bool direct );
+                static size_t _readStretched( InternalAudioData *p_data, float *out, size_t frames, bool direct );
+                static size_t _renderVarispeed( InternalAudioData *p_data, float *out, size_t frames );
+                static void _leaveStretch( InternalAudioData *p_data );
+                static void _dropQueued( InternalAudioData *p_data );
+                static void _recordStatus( 
+                    InternalAudioData *p_data, 
+                    PaStreamCallbackFlags flags, 
+                    const PaStreamCallbackTimeInfo *time_info, 
+                    int64_t buffer_start );
+                static void _publishClock( 
+                    InternalAudioData *p_data, 
+                    const PaStreamCallbackTimeInfo *time_info, 
+                    unsigned long frames, 
+                    boost::chrono::steady_clock::time_point called );
+
                 void _openStream();
                 void _closeStream();
                 void _startStream();
@@ -84,30 +303,181 @@ namespace Wayver {
                 
                 void _closeFile();
 
+                /***
+                 * Playlist: every entry loadFile() / queueFile() was given.
+                 * _next_track is the first one not yet handed to a decoder.
+                 * One that does not match the stream's format waits for
+                 * the stream to end and gets a new one, see run()
+                */
+                std::vector<std::string> _playlist;
+                size_t _next_track = 0;
+                bool _needs_new_stream = false;
+
+                /***
+                 * The newest source handed to the callback - it is either
+                 * playing or about to. Only what the callback retired
+                 * is ever freed, so this stays valid on the engine side.
+                */
+                LoadedSource *_loaded = NULL;
+
+                // loadFile() / loadSource() calls so far, LoadedSource::load
+                uint32_t _loads = 0;
+
+                // run() has a stream open - a load then goes through the source
+                // slot, unless the stream already played to its end
+                bool _streaming = false;
+                bool _stream_done = false;
+
+                // the newest source's analyser waits for the old one to go
+                bool _analyser_waiting = false;
+
+                void _load( Source *source, const std::string &label, int track );
+                void _install( LoadedSource *next );
+                void _swapSource( LoadedSource *next );
+                void _reclaimSources();
+                void _setLoop( const Bus::Message &msg );
+                void _publishLoop();
+                void _restartStream( LoadedSource *next );
+                void _startFile();
+                void _feedDecoder();
+                void _playOnNewStream();
+
+                // openSource() plus a seek index where the format wants one
+                Source *_openSource( const std::string &path );
+
+                // see setOutputRate(); what files are converted to, 0 -> their own rate
+                int _output_rate = OUTPUT_RATE_NATIVE;
+                int _prebuilt_rate = 0;
+                int _streamRate();
+
+                size_t _ring_frames = DECODER_RING_FRAMES;
+                unsigned long _frames_per_buffer = FRAMES_IN_BUFFER;
+                double _latency = 0;
+
+                // -B auto: the tuner picks _frames_per_buffer as it goes
+                bool _auto_buffer = false;
+                BufferTuner _tuner;
+                void _reopenStream( unsigned long frames );
+
+                /***
+                 * A reopen waiting for its fade to play out: the size it
+                 * is for, 0 -> none, the stream frame the callback is
+                 * silent from, and when to stop waiting for it
+                */
+                unsigned long _reopen_frames = 0;
+                int64_t _reopen_silent_from = 0;
+                boost::chrono::steady_clock::time_point _reopen_deadline;
+                void _finishReopen();
+
+                // what the engine has asked the callback for
+                float _gain = 1;
+                bool _paused = false;
+                double _speed = 1;
+                double _tempo = 1;
+
+                ResampleQuality _quality = RESAMPLE_GOOD;
+                StretchMode _stretch_mode = STRETCH_VOCODER;
+
+                void _setTempo( double tempo );
+
                 const float _GAIN_STEP = 0.1;
                 void _nudgeGain( bool DOWN = true );
 
+                // periodic housekeeping, runs every ENGINE_TICK_MS
+                void _onTick();
+
+                // callback instrumentation -> ui, and -> log on request
+                static std::atomic<bool> _stats_dump_requested;
+                Bus::CallbackStats _callbackStats();
+                void _publishStats();
+                void _dumpStats( const char *why );
+
 
 
                 // Utility
                 static void _applyFadeOut( float *samples_arr, int channels, int frames_in_buffer );
                 static std::string _arrayToString(float *array, int length);
-                static void _applyGain( float gain, float *arr, int size );
+                static void _applyGain( InternalAudioData *p_data, const float *in, float *out, size_t frames );
 
             public:
 
                 AudioEngine();
                 ~AudioEngine();
 
-                // Player Actions
+                /***
+                 * Player Actions - loadFile() starts a new playlist.
+                 * On the engine thread while run() plays, it swaps the
+                 * source under the running stream, see _swapSource()
+                */
                 void loadFile(const std::string& path);
+
+                // played gapless after what is already there, when the format matches
+                void queueFile( const std::string &path );
+
+                // play a Source that is not a file - takes ownership
+                void loadSource( Source *source, const std::string &label );
                 void registerQueues(Bus::Queues *_q_ptr);
 
+                // depth of the decode-ahead ring, at least DECODER_CHUNK_FRAMES, applies to the next loadFile()
+                void setRingFrames( size_t frames );
+
+                // callback block size, applies to the next run() / render()
+                void setFramesPerBuffer( unsigned long frames );
+                unsigned long getFramesPerBuffer() const { return _frames_per_buffer; }
+
+                // suggested output latency in seconds, 0 -> the device's low default
+                void setLatency( double seconds );
+
+                // let run() find the smallest buffer that plays without xruns
+                void setAutoBuffer( bool on );
+
+                // varispeed filters, for streams started after the call
+                void setResampleQuality( ResampleQuality quality );
+
+                // speed the next stream starts at, clamped to VARISPEED_MIN -> VARISPEED_MAX
+                void setSpeed( double speed );
+
+                // time-stretch method, for streams started after the call
+                void setStretchMode( StretchMode mode );
+
+                /***
+                 * The rate files are converted to as they are opened:
+                 * OUTPUT_RATE_NATIVE the device's own, OUTPUT_RATE_FILE
+                 * none, each plays at its rate - or a rate in Hz.
+                 * Applies from the next file opened on
+                */
+                void setOutputRate( int samplerate );
+
+                // what run() plays through - takes ownership, call before run() and loadFile()
+                void setBackend( Backend *backend );
+
                 // Audio Thread
                 void run();
 
+                /***
+                 * Headless: drives the stream callback on this thread as
+                 * fast as it goes, no PortAudio device, and writes a float
+                 * WAV. Blocks until the whole file is rendered.
+                */
+                RenderReport render( const std::string &out_path );
+
+                // hand a timestamped message straight to the callback
+                bool schedule( const Bus::Message &msg );
+
+                // frames rendered since the stream started
+                int64_t getStreamFrame();
+
+                // async-signal-safe: log the callback stats on the next tick
+                static void requestStatsDump();
+
                 const SF_INFO &getSoundFileInfo(); 
                 const std::string &getPathToFile();
+
+                // 0 -> empty, 1 -> full
+                float getRingFillLevel();
+
+                // false until some run has measured this file
+                bool getLoudness( Cache::Loudness &out );
         };
 
     }
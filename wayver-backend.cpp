@@ -0,0 +1,339 @@
+#include <wayver-backend.hpp>
+#include <wayver-alloc.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <strings.h>
+#include <vector>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+using namespace Wayver::Audio;
+
+PortAudioBackend::PortAudioBackend( 
+    std::shared_ptr<spdlog::logger> logger,
+    const std::string &host_api,
+    const std::string &device )
+:_logger(logger)
+{
+    if ( Pa_Initialize() != paNoError ){
+        _logger->error("PortAudioBackend() : Error initing PortAudio");
+        throw std::runtime_error("Error initing the AudioEngine");
+    }
+
+    _device = _findDevice( host_api, device );
+
+    if ( _device == paNoDevice ){
+        Pa_Terminate();
+        _logger->error("PortAudioBackend() : no output device for host api '{}', device '{}'", host_api, device);
+        throw std::runtime_error("No such output device.");
+    }
+
+    const PaDeviceInfo *info = Pa_GetDeviceInfo( _device );
+    _logger->info(
+        "PortAudioBackend() - output on {} ({}), default latency {:.1f} - {:.1f} ms",
+        info->name,
+        Pa_GetHostApiInfo( info->hostApi )->name,
+        1e3 * info->defaultLowOutputLatency,
+        1e3 * info->defaultHighOutputLatency );
+}
+
+PortAudioBackend::~PortAudioBackend()
+{
+    if ( _stream != NULL ){
+        Pa_CloseStream( _stream );
+    }
+
+    PaError err = Pa_Terminate();
+    if ( err != paNoError ){
+        _logger->error("~PortAudioBackend() : Error terminating PortAudio: {}", Pa_GetErrorText( err ));
+    }
+}
+
+PaDeviceIndex PortAudioBackend::_findDevice( const std::string &host_api, const std::string &device ) const
+{
+    PaHostApiIndex api = -1;
+
+    if ( !host_api.empty() ){
+        for ( PaHostApiIndex i = 0; i < Pa_GetHostApiCount(); i++ ){
+            if ( strcasecmp( Pa_GetHostApiInfo( i )->name, host_api.c_str() ) == 0 ){
+                api = i;
+            }
+        }
+        if ( api < 0 ){
+            return paNoDevice;
+        }
+    }
+
+    if ( device.empty() ){
+        return api < 0 ? Pa_GetDefaultOutputDevice() : Pa_GetHostApiInfo( api )->defaultOutputDevice;
+    }
+
+    // all digits -> an index as listDevices() prints it
+    if ( device.find_first_not_of( "0123456789" ) == std::string::npos ){
+        const PaDeviceIndex i = std::stoi( device );
+        return i < Pa_GetDeviceCount() && Pa_GetDeviceInfo( i )->maxOutputChannels > 0 ? i : paNoDevice;
+    }
+
+    for ( PaDeviceIndex i = 0; i < Pa_GetDeviceCount(); i++ ){
+        const PaDeviceInfo *info = Pa_GetDeviceInfo( i );
+
+        if ( info->maxOutputChannels > 0 
+            && ( api < 0 || info->hostApi == api ) 
+            && strstr( info->name, device.c_str() ) != NULL ){
+            return i;
+        }
+    }
+
+    return paNoDevice;
+}
+
+void PortAudioBackend::listDevices() const
+{
+    for ( PaDeviceIndex i = 0; i < Pa_GetDeviceCount(); i++ ){
+        const PaDeviceInfo *info = Pa_GetDeviceInfo( i );
+
+        if ( info->maxOutputChannels <= 0 ){
+            continue;
+        }
+
+        printf("%3d %c %-10s %-40s %2d ch %6.0f Hz  latency %5.1f - %5.1f ms\n",
+            i,
+            i == _device ? '*' : ' ',
+            Pa_GetHostApiInfo( info->hostApi )->name,
+            info->name,
+            info->maxOutputChannels,
+            info->defaultSampleRate,
+            1e3 * info->defaultLowOutputLatency,
+            1e3 * info->defaultHighOutputLatency );
+    }
+}
+
+void PortAudioBackend::open(
+    const StreamConfig &config,
+    PaStreamCallback *callback,
+    PaStreamFinishedCallback *finished,
+    void *user_data )
+{
+    PaStreamParameters out;
+    out.device = _device;
+    out.channelCount = config.channels;
+    out.sampleFormat = paFloat32;
+    out.suggestedLatency = config.suggested_latency > 0 
+        ? config.suggested_latency 
+        : Pa_GetDeviceInfo( _device )->defaultLowOutputLatency;
+    out.hostApiSpecificStreamInfo = NULL;
+
+    PaError e = Pa_OpenStream(
+        &_stream,
+        NULL,
+        &out,
+        config.samplerate,
+        config.frames_per_buffer,
+        paNoFlag,
+        callback,
+        user_data
+    );
+
+    if (e != paNoError){
+        std::string msg = Pa_GetErrorText( e );
+        _logger->error( "Error opening stream. msg; {}", msg );
+        _stream = NULL;
+        throw std::runtime_error("Could not Open stream.");
+    }
+
+    Pa_SetStreamFinishedCallback( _stream, finished );
+
+    _logger->info(
+        "PortAudioBackend::open() - {} frames per buffer, asked {:.1f} ms, got {:.1f} ms output latency",
+        config.frames_per_buffer,
+        1e3 * out.suggestedLatency,
+        1e3 * Pa_GetStreamInfo( _stream )->outputLatency );
+}
+
+void PortAudioBackend::start()
+{
+    PaError e = Pa_StartStream(_stream);
+
+    if (e != paNoError){
+        std::string msg = Pa_GetErrorText( e );
+        _logger->error( "Error starting stream. msg; {}", msg );
+        throw std::runtime_error("Could not Start stream.");
+    }
+}
+
+void PortAudioBackend::stop()
+{
+    PaError e = Pa_StopStream(_stream);
+
+    if (e != paNoError){
+        std::string msg = Pa_GetErrorText( e );
+        _logger->error( "Error stopping stream. msg; {}", msg );
+        throw std::runtime_error("Could not Stop stream.");
+    }
+}
+
+void PortAudioBackend::close()
+{
+    PaError e = Pa_CloseStream(_stream);
+
+    _stream = NULL;
+
+    if (e != paNoError){
+        std::string msg = Pa_GetErrorText( e );
+        _logger->error( "Error closing stream. msg; {}", msg );
+        throw std::runtime_error("Could not close stream.");
+    }
+}
+
+double PortAudioBackend::cpuLoad() const
+{
+    return _stream != NULL ? Pa_GetStreamCpuLoad( _stream ) : 0;
+}
+
+// the host API's default for the device - what its mixer runs at, or the hardware's own
+int PortAudioBackend::nativeRate() const
+{
+    return (int)Pa_GetDeviceInfo( _device )->defaultSampleRate;
+}
+
+NullBackend::NullBackend(
+    double speed,
+    double jitter_us,
+    uint32_t seed,
+    std::shared_ptr<spdlog::logger> logger )
+:_speed(speed),
+_jitter_us(jitter_us),
+_seed(seed),
+_logger(logger)
+{}
+
+NullBackend::~NullBackend()
+{
+    stop();
+}
+
+void NullBackend::open(
+    const StreamConfig &config,
+    PaStreamCallback *callback,
+    PaStreamFinishedCallback *finished,
+    void *user_data )
+{
+    _config = config;
+    _callback = callback;
+    _finished = finished;
+    _user_data = user_data;
+
+    _report = NullDeviceReport();
+    _report.budget_us = 1e6 * config.frames_per_buffer / config.samplerate;
+    _done = false;
+}
+
+void NullBackend::start()
+{
+    if ( _callback == NULL ){
+        throw std::runtime_error("Could not Start stream.");
+    }
+
+    _running = true;
+    _thread = boost::thread( &NullBackend::_loop, this );
+}
+
+void NullBackend::stop()
+{
+    _running = false;
+
+    if ( _thread.joinable() ){
+        _thread.join();
+    }
+}
+
+void NullBackend::close()
+{
+    stop();
+    _callback = NULL;
+}
+
+void NullBackend::waitFinished()
+{
+    boost::unique_lock<boost::mutex> lock( _done_mutex );
+    while ( !_done ){
+        _done_cond.wait( lock );
+    }
+}
+
+void NullBackend::_loop()
+{
+    typedef boost::chrono::steady_clock Clock;
+
+    const double period = (double)_config.frames_per_buffer / _config.samplerate;
+
+    std::minstd_rand rng( _seed );
+    std::uniform_real_distribution<double> late( 0, _jitter_us * 1e-6 );
+
+    std::vector<float> buffer( _config.frames_per_buffer * _config.channels );
+    _timings = Stats::Timings();
+    _timings.reserve( 1 << 16 );
+
+    PaStreamCallbackTimeInfo time_info = { 0, 0, 0 };
+    PaStreamCallbackFlags flags = 0;
+    double sim_time = 0;
+
+    const Clock::time_point wall_start = Clock::now();
+    int result = paContinue;
+
+    while ( _running && result == paContinue ){
+
+        const double woke = sim_time + late( rng );
+
+        if ( _speed > 0 ){
+            boost::this_thread::sleep_until( wall_start
+                + boost::chrono::duration_cast<Clock::duration>(
+                    boost::chrono::duration<double>( woke / _speed ) ) );
+        }
+
+        // one buffer of output latency
+        time_info.currentTime = woke;
+        time_info.outputBufferDacTime = sim_time + period;
+
+        const uint64_t allocs = Alloc::threadCount();
+        const Clock::time_point t0 = Clock::now();
+
+        result = _callback( NULL, buffer.data(), _config.frames_per_buffer, &time_info, flags, _user_data );
+
+        const double took = boost::chrono::duration<double>( Clock::now() - t0 ).count();
+        _report.allocations += Alloc::threadCount() - allocs;
+
+        _timings.add( took * 1e6 );
+        _load.store( 0.9 * _load.load( std::memory_order_relaxed ) + 0.1 * took / period, std::memory_order_relaxed );
+        _report.callbacks++;
+        _report.frames += _config.frames_per_buffer;
+
+        flags = 0;
+        if ( woke - sim_time + took > period ){
+            _report.missed_deadlines++;
+            flags = paOutputUnderflow;
+        }
+
+        sim_time += period;
+    }
+
+    _report.callback_seconds = _timings.total() / 1e6;
+    _report.p50_us = _timings.percentile( 50 );
+    _report.p99_us = _timings.percentile( 99 );
+    _report.p999_us = _timings.percentile( 99.9 );
+    _report.max_us = _timings.max();
+
+    _logger->debug("NullBackend::_loop() - {} callbacks, {} late", _report.callbacks, _report.missed_deadlines);
+
+    if ( result != paContinue && _finished != NULL ){
+        _finished( _user_data );
+    }
+
+    boost::lock_guard<boost::mutex> lock( _done_mutex );
+    _done = true;
+    _done_cond.notify_all();
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <wayver-stats.hpp>
+
+#include <portaudio.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <boost/thread.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        // what the engine asks a backend for - always float32, output only
+        struct StreamConfig {
+            int channels;
+            double samplerate;
+            unsigned long frames_per_buffer;
+
+            // seconds, 0 -> the device's default low latency
+            double suggested_latency = 0;
+        };
+
+        /***
+         * Whatever drives the stream callback.
+         * Calls map one to one onto the PortAudio stream lifecycle,
+         * and errors throw std::runtime_error the same way.
+        */
+        class Backend {
+            public:
+                virtual ~Backend() {}
+
+                virtual void open(
+                    const StreamConfig &config,
+                    PaStreamCallback *callback,
+                    PaStreamFinishedCallback *finished,
+                    void *user_data
+                ) = 0;
+
+                virtual void start() = 0;
+                virtual void stop() = 0;
+                virtual void close() = 0;
+
+                virtual const char *name() const = 0;
+
+                // share of the buffer period the callback uses, 0 -> 1
+                virtual double cpuLoad() const = 0;
+
+                // the rate the device runs at unconverted, 0 -> no preference
+                virtual int nativeRate() const { return 0; }
+        };
+
+        /***
+         * A PortAudio output device.
+         * PortAudio lives as long as this object - one
+         * Pa_Initialize / Pa_Terminate pair, however many streams.
+         *
+         *      - host_api picks the host API by name (ALSA, JACK ..),
+         *      empty -> PortAudio's default one
+         *      - device is an index from listDevices() or part of a
+         *      device name, empty -> the host API's default output
+        */
+        class PortAudioBackend : public Backend {
+
+            PaStream *_stream = NULL;
+            PaDeviceIndex _device = paNoDevice;
+            std::shared_ptr<spdlog::logger> _logger;
+
+            PaDeviceIndex _findDevice( const std::string &host_api, const std::string &device ) const;
+
+            public:
+                PortAudioBackend( 
+                    std::shared_ptr<spdlog::logger> logger,
+                    const std::string &host_api = "",
+                    const std::string &device = ""
+                );
+                ~PortAudioBackend();
+
+                // every output device, one line each, to stdout
+                void listDevices() const;
+
+                void open(
+                    const StreamConfig &config,
+                    PaStreamCallback *callback,
+                    PaStreamFinishedCallback *finished,
+                    void *user_data
+                ) override;
+
+                void start() override;
+                void stop() override;
+                void close() override;
+
+                const char *name() const override { return "PortAudio"; }
+                double cpuLoad() const override;
+                int nativeRate() const override;
+        };
+
+        // what NullBackend measured, over a whole stream
+        struct NullDeviceReport {
+            int64_t callbacks = 0;
+            int64_t frames = 0;
+
+            // wall clock spent inside the callback
+            double callback_seconds = 0;
+
+            // per callback, in microseconds
+            double p50_us = 0;
+            double p99_us = 0;
+            double p999_us = 0;
+            double max_us = 0;
+            double budget_us = 0;
+
+            // buffers that would have reached the DAC late
+            int64_t missed_deadlines = 0;
+
+            // operator new calls inside the callback, see Alloc
+            int64_t allocations = 0;
+        };
+
+        /***
+         * A device that is not there.
+         *
+         *      - Runs the callback on its own thread against a simulated
+         *      clock: one buffer period per call, each wakeup late by a
+         *      random amount up to `jitter_us`, from a fixed seed
+         *      - speed 1 paces to real time, N runs N times faster,
+         *      0 as fast as the callback returns
+         *      - A callback is late when wakeup + run time exceeds the
+         *      period; the next call then sees paOutputUnderflow
+        */
+        class NullBackend : public Backend {
+
+            double _speed;
+            double _jitter_us;
+            uint32_t _seed;
+
+            StreamConfig _config;
+            PaStreamCallback *_callback = NULL;
+            PaStreamFinishedCallback *_finished = NULL;
+            void *_user_data = NULL;
+
+            boost::thread _thread;
+            std::atomic<bool> _running{false};
+
+            bool _done = false;
+            boost::mutex _done_mutex;
+            boost::condition_variable _done_cond;
+
+            Stats::Timings _timings;
+            NullDeviceReport _report;
+
+            // smoothed callback time / period
+            std::atomic<double> _load{0};
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            void _loop();
+
+            public:
+                NullBackend(
+                    double speed,
+                    double jitter_us,
+                    uint32_t seed,
+                    std::shared_ptr<spdlog::logger> logger
+                );
+                ~NullBackend();
+
+                void open(
+                    const StreamConfig &config,
+                    PaStreamCallback *callback,
+                    PaStreamFinishedCallback *finished,
+                    void *user_data
+                ) override;
+
+                void start() override;
+                void stop() override;
+                void close() override;
+
+                const char *name() const override { return "null device"; }
+                double cpuLoad() const override { return _load.load( std::memory_order_relaxed ); }
+
+                // blocks until the callback has completed the stream
+                void waitFinished();
+
+                // complete once waitFinished() or stop() returned
+                const NullDeviceReport &report() const { return _report; }
+        };
+    }
+}
@@ -0,0 +1,196 @@
+#include <wayver-bench.hpp>
+#include <wayver-audio.hpp>
+#include <wayver-alloc.hpp>
+#include <wayver-resampler.hpp>
+#include <wayver-stretch.hpp>
+
+#include <cstdio>
+#include <math.h>
+
+#include <boost/chrono.hpp>
+
+using namespace Wayver;
+
+namespace {
+
+    const unsigned long BUFFER_SIZES[] = { 64, 128, 256, 512, 1024 };
+    const int CHANNEL_COUNTS[] = { 1, 2, 6 };
+    const int SAMPLE_RATES[] = { 44100, 48000, 96000 };
+    const double SPEEDS[] = { 0.5, 1.1, 2.0, 4.0 };
+    const double TEMPOS[] = { STRETCH_MIN_TEMPO, 0.8, 1.25, STRETCH_MAX_TEMPO };
+
+    /***
+     * BENCH_SECONDS of stereo 48 kHz out of the resampler alone, at a
+     * fixed speed, fed and read a buffer at a time the way the callback
+     * does. Returns output frames per second of wall time.
+    */
+    double _resampleCase( Audio::ResampleQuality quality, double speed )
+    {
+        const int channels = 2, rate = 48000;
+        const size_t buffer = 256;
+
+        Audio::Resampler rs( channels, quality );
+        rs.setSpeed( speed, 0 );
+
+        std::vector<float> in( VARISPEED_CHUNK_FRAMES * channels ), out( buffer * channels );
+        for ( size_t f = 0; f < VARISPEED_CHUNK_FRAMES; f++ ){
+            in[f * channels] = in[f * channels + 1] = sinf( 2 * (float)M_PI * 1000 * f / rate );
+        }
+
+        const int64_t total = (int64_t)BENCH_SECONDS * rate;
+        int64_t done = 0;
+
+        const boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+        while ( done < total ){
+            size_t n = 0;
+            while ( n < buffer ){
+                n += rs.read( out.data() + n * channels, buffer - n );
+                if ( n < buffer ){
+                    rs.write( in.data(), std::min<size_t>( rs.space(), VARISPEED_CHUNK_FRAMES ) );
+                }
+            }
+            done += n;
+        }
+
+        return done / boost::chrono::duration<double>( boost::chrono::steady_clock::now() - start ).count();
+    }
+
+    /***
+     * BENCH_SECONDS of 6 channel 96 kHz tone through the stretcher,
+     * pulled as fast as its worker finishes it. Returns output frames
+     * per second of wall time - the worker's, as it sleeps whenever
+     * it gets STRETCH_AHEAD_MS ahead.
+    */
+    double _stretchCase( Audio::StretchMode mode, double tempo, std::shared_ptr<spdlog::logger> logger )
+    {
+        const int channels = 6, rate = 96000;
+        const size_t buffer = 256;
+
+        Audio::Stretcher stretch( channels, rate, mode, logger );
+        stretch.setTempo( tempo );
+        stretch.want( true );
+
+        std::vector<float> in( STRETCH_CHUNK_FRAMES * channels ), out( buffer * channels );
+        for ( size_t f = 0; f < STRETCH_CHUNK_FRAMES; f++ ){
+            for ( int c = 0; c < channels; c++ ){
+                in[f * channels + c] = sinf( 2 * (float)M_PI * 1000 * f / rate );
+            }
+        }
+
+        const int64_t total = (int64_t)BENCH_SECONDS * rate;
+        int64_t done = 0;
+
+        const boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+        while ( done < total ){
+            while ( stretch.space() > 0 ){
+                stretch.push( in.data(), std::min<size_t>( stretch.space(), STRETCH_CHUNK_FRAMES ) );
+            }
+
+            const size_t n = stretch.pull( out.data(), buffer );
+            if ( n == 0 ){
+                boost::this_thread::yield();
+            }
+            done += n;
+        }
+
+        return done / boost::chrono::duration<double>( boost::chrono::steady_clock::now() - start ).count();
+    }
+
+    Audio::NullDeviceReport _runCase(
+        Audio::AudioEngine &engine,
+        unsigned long frames_per_buffer,
+        int channels,
+        int samplerate,
+        std::shared_ptr<spdlog::logger> logger )
+    {
+        Audio::NullBackend *device = new Audio::NullBackend( BENCH_SPEED, BENCH_JITTER_US, 1, logger );
+
+        engine.setFramesPerBuffer( frames_per_buffer );
+        engine.setBackend( device );
+        engine.loadSource(
+            new Audio::ToneSource( channels, samplerate, (int64_t)BENCH_SECONDS * samplerate ),
+            "bench tone" );
+
+        Bus::Queues queues;
+        engine.registerQueues( &queues );
+
+        // a gain ramp every half second, so both gain paths get timed
+        for ( int i = 1; i < 2 * BENCH_SECONDS; i++ ){
+            Bus::Message msg;
+            msg.cmd = Bus::Command::SET_GAIN;
+            msg.at_frame = (int64_t)i * samplerate / 2;
+            msg.value = i % 2 ? 0.5f : 1.0f;
+            engine.schedule( msg );
+        }
+
+        boost::thread engine_thread( boost::bind( &Audio::AudioEngine::run, &engine ) );
+
+        device->waitFinished();
+        queues.pushCommand( Bus::Command::QUIT );
+        engine_thread.join();
+
+        return device->report();
+    }
+}
+
+int Bench::run( std::shared_ptr<spdlog::logger> logger )
+{
+    Audio::AudioEngine engine;
+    int64_t total_allocations = 0;
+
+    printf("Callback benchmark - %d s per case at %dx, %d us jitter, DSP kernels: %s\n\n",
+        BENCH_SECONDS, BENCH_SPEED, BENCH_JITTER_US, Dsp::isaName());
+    printf("%6s %3s %6s | %9s %9s %9s %9s %9s | %10s %8s | %5s %7s\n",
+        "buffer", "ch", "rate", "p50 us", "p99 us", "p99.9 us", "max us", "budget us",
+        "Mframes/s", "x rt", "late", "allocs");
+
+    for ( unsigned long buffer : BUFFER_SIZES ){
+        for ( int channels : CHANNEL_COUNTS ){
+            for ( int rate : SAMPLE_RATES ){
+
+                Audio::NullDeviceReport r = _runCase( engine, buffer, channels, rate, logger );
+
+                printf("%6lu %3d %6d | %9.2f %9.2f %9.2f %9.2f %9.2f | %10.1f %8.0f | %5lld %7s\n",
+                    buffer, channels, rate,
+                    r.p50_us, r.p99_us, r.p999_us, r.max_us, r.budget_us,
+                    r.frames / r.callback_seconds / 1e6,
+                    r.frames / (double)rate / r.callback_seconds,
+                    (long long)r.missed_deadlines,
+                    Alloc::counting() ? std::to_string( r.allocations ).c_str() : "n/a");
+
+                total_allocations += r.allocations;
+            }
+        }
+    }
+
+    printf("\nVarispeed resampler - stereo 48 kHz, %d s of output per case\n\n", BENCH_SECONDS);
+    printf("%7s %6s | %10s %8s\n", "quality", "speed", "Mframes/s", "x rt");
+
+    for ( int q = 0; q < Audio::RESAMPLE_QUALITY_COUNT; q++ ){
+        for ( double speed : SPEEDS ){
+            const double fps = _resampleCase( (Audio::ResampleQuality)q, speed );
+            printf("%7s %6.2f | %10.1f %8.0f\n",
+                Audio::resampleQualityName( (Audio::ResampleQuality)q ), speed, fps / 1e6, fps / 48000);
+        }
+    }
+
+    printf("\nTime-stretch worker - 6 ch 96 kHz, %d s of output per case\n\n", BENCH_SECONDS);
+    printf("%7s %6s | %10s %8s\n", "method", "tempo", "Mframes/s", "x rt");
+
+    for ( int m = 0; m < Audio::STRETCH_MODE_COUNT; m++ ){
+        for ( double tempo : TEMPOS ){
+            const double fps = _stretchCase( (Audio::StretchMode)m, tempo, logger );
+            printf("%7s %6.2f | %10.1f %8.1f\n",
+                Audio::stretchModeName( (Audio::StretchMode)m ), tempo, fps / 1e6, fps / 96000);
+        }
+    }
+
+    if ( total_allocations > 0 ){
+        printf("\n%lld allocations inside the callback\n", (long long)total_allocations);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    /***
+     * Callback benchmark on the null device - no sound card needed.
+     *
+     * Plays BENCH_SECONDS of tone through the full engine (decoder
+     * thread, analyser, gain ramps) for every combination of buffer
+     * size, channel count and sample rate, and prints one row each:
+     * callback latency percentiles, throughput, late buffers and
+     * allocations made inside the callback. Then the varispeed
+     * resampler on its own, per quality at a few speeds, and the
+     * time-stretch worker per method at 6 channels, 96 kHz.
+    */
+    namespace Bench {
+
+        // returns a process exit code - non zero if any callback allocated
+        int run( std::shared_ptr<spdlog::logger> logger );
+    }
+}
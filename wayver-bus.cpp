@@ -1,3 +1,78 @@
 #include <wayver-bus.hpp>
 
+#include <boost/chrono.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include <algorithm>
+
 using namespace Wayver::Bus;
+
+void Wakeup::notify()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(_mutex);
+        _pending = true;
+    }
+    _cv.notify_one();
+}
+
+bool Wakeup::waitFor( int timeout_ms )
+{
+    boost::unique_lock<boost::mutex> lock(_mutex);
+
+    _cv.wait_for( 
+        lock, 
+        boost::chrono::milliseconds( timeout_ms ), 
+        [this]{ return _pending; } 
+    );
+
+    bool woken = _pending;
+    _pending = false;
+    return woken;
+}
+
+bool Queues::pushCommand( Command cmd )
+{
+    Message msg;
+    msg.cmd = cmd;
+    return pushCommand( msg );
+}
+
+bool Queues::pushCommand( const Message &msg )
+{
+    bool pushed = _queue_commands.push( msg );
+    _engine_wakeup.notify();
+    return pushed;
+}
+
+bool Queues::pushLoad( const std::string &path )
+{
+    std::string *copy = new std::string( path );
+
+    if ( !_load_requests.push( copy ) ){
+        delete copy;
+        return false;
+    }
+
+    _engine_wakeup.notify();
+    return true;
+}
+
+Queues::~Queues()
+{
+    std::string *path;
+    while ( _load_requests.pop( path ) ){
+        delete path;
+    }
+}
+
+double AudioClock::audibleFrame( int64_t at_wall_ns ) const
+{
+    // the stream clock now, carried forward from the callback on the steady clock
+    const double now = stream_time + ( at_wall_ns - wall_ns ) * 1e-9;
+
+    // before dac_time the previous buffer is still playing - a negative step is right
+    const double ahead = std::min( ( now - dac_time ) * rate, 2.0 * span );
+
+    return std::max( 0.0, frame + ahead );
+}
@@ -1,6 +1,12 @@
 #pragma once
 
 #include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
 
 #include <wayver-defines.hpp>
 
@@ -12,16 +18,219 @@ namespace Wayver {
             STOP,
             QUIT,
             NUDGE_GAIN_UP,
-            NUDGE_GAIN_DWN
+            NUDGE_GAIN_DWN,
+
+            // carry a payload, see Message
+            SET_GAIN,
+            SET_PAUSED,
+            SEEK,
+            SCRUB,
+            SCRUB_END,
+            SET_LOOP,
+            CLEAR_LOOP,
+            SET_SPEED,
+            SET_TEMPO
+        };
+
+        /***
+         * A command plus when and with what to apply it.
+         * 
+         *      at_frame  -> frame on the stream clock (frames the callback
+         *                   has rendered since the stream started),
+         *                   -1 means at the start of the next buffer
+         *      value     -> SET_GAIN: absolute gain, SET_PAUSED: 0 / 1
+         *                   SET_SPEED: playback speed, 1 -> as recorded
+         *                   SET_TEMPO: the same, pitch kept
+         *      position  -> SEEK: target frame in the file
+         *                   SCRUB: frame under the pointer, value is how
+         *                   fast it moves, in frames per second
+         *                   SCRUB_END: where playback carries on from
+         *                   SET_LOOP: A, the first frame of the loop
+         *      end       -> SET_LOOP: B, the first frame after it
+         *      track     -> SET_LOOP: playlist index A and B are in
+        */
+        struct Message {
+            Command cmd;
+            int64_t at_frame = -1;
+            float value = 0;
+            int64_t position = 0;
+            int64_t end = 0;
+            int track = 0;
+        };
+
+        /***
+         * Everything the UI draws from, as one fixed-size frame.
+         * bands -> FFT_OUT_BANDS log-spaced bands between
+         * ANALYSIS_MIN_HZ and ANALYSIS_MAX_HZ, each in [0,1]
+         * (ANALYSIS_FLOOR_DB -> 0 dBFS)
+        */
+        struct VisFrame {
+            // play position, in file frames
+            int64_t frame = 0;
+
+            // bumped on every new analysis - unchanged -> same spectrum
+            uint64_t analysis_seq = 0;
+
+            // last analysed block, down-mixed to mono
+            int n_samples = 0;
+            float samples[VIS_SAMPLES] = {0};
+
+            float bands[FFT_OUT_BANDS] = {0};
+
+            // per channel, over the last analysed block
+            int channels = 0;
+            float peak[VIS_MAX_CHANNELS] = {0};
+            float rms[VIS_MAX_CHANNELS] = {0};
+        };
+
+        /***
+         * How the audio callback is keeping up, as the engine
+         * last summed it up - times are callback execution only.
+        */
+        struct CallbackStats {
+            uint64_t callbacks = 0;
+
+            // from the callback's statusFlags
+            uint64_t underflows = 0;
+            uint64_t overflows = 0;
+
+            double p50_us = 0;
+            double p99_us = 0;
+            double p999_us = 0;
+            double max_us = 0;
+
+            // one buffer's worth of real time
+            double budget_us = 0;
+
+            // 0 -> 1, as the backend reports it
+            double cpu_load = 0;
+
+            // DAC clock against frames rendered, and DAC time - now
+            double dac_drift_ms = 0;
+            double output_latency_ms = 0;
+        };
+
+        /***
+         * Where playback is on the audio clock, from the last callback.
+         *
+         *      - frame reaches the DAC at dac_time, both as PortAudio
+         *      saw them; stream_time was Pa_GetStreamTime() when the
+         *      callback ran, wall_ns the steady clock at that moment
+         *      - rate is how fast the position moves, 0 while paused
+         *
+         * Anyone with a steady clock can then tell which frame is
+         * audible without calling into PortAudio, see audibleFrame()
+        */
+        struct AudioClock {
+            int64_t frame = 0;
+            double dac_time = 0;
+            double stream_time = 0;
+            int64_t wall_ns = 0;
+            double rate = 0;
+
+            // frames the callback covered - the guess never runs further past them
+            int64_t span = 0;
+
+            // which load is playing, see AudioEngine::loadFile()
+            uint32_t load = 0;
+
+            // playlist index of what is playing, its length and format - frame is into it
+            int track = 0;
+            int64_t track_frames = 0;
+            int track_channels = 0;
+            int track_samplerate = 0;
+
+            // file frame coming out of the DAC at steady clock wall_ns
+            double audibleFrame( int64_t at_wall_ns ) const;
+        };
+
+        /***
+         * Wait-free single producer / single consumer handoff of
+         * whole frames. Three slots: one the producer fills, one
+         * the consumer reads, one in the middle holding the newest
+         * complete frame. Neither side ever waits or copies.
+        */
+        template <typename T>
+        class TripleBuffer {
+
+            static const uint8_t _FRESH = 4;
+
+            T _slots[3];
+
+            // index of the middle slot, | _FRESH once published
+            std::atomic<uint8_t> _middle{1};
+
+            uint8_t _back = 0;
+            uint8_t _front = 2;
+
+            public:
+
+                // Producer - fill in place, then publish()
+                T &writeBuffer() { return _slots[_back]; }
+
+                void publish() {
+                    _back = _middle.exchange( _back | _FRESH, std::memory_order_acq_rel ) & 3;
+                }
+
+                // Consumer - true when a newer frame was picked up
+                bool update() {
+                    if ( !( _middle.load( std::memory_order_relaxed ) & _FRESH ) ){
+                        return false;
+                    }
+                    _front = _middle.exchange( _front, std::memory_order_acq_rel ) & 3;
+                    return true;
+                }
+
+                const T &readBuffer() const { return _slots[_front]; }
+        };
+
+        /***
+         * Lets a consumer sleep until a producer has something for it.
+         * The data itself still travels through the lock-free queues,
+         * this only carries the "go look" edge.
+        */
+        class Wakeup {
+
+            boost::mutex _mutex;
+            boost::condition_variable _cv;
+            bool _pending = false;
+
+            public:
+
+                void notify();
+
+                // true when woken by notify(), false when timeout_ms ran out
+                bool waitFor( int timeout_ms );
         };
 
         struct Queues {
 
-            boost::lockfree::spsc_queue<float,boost::lockfree::capacity<W_QUEUE_SIZE>> _queue_audio_to_ui;
-            boost::lockfree::spsc_queue<Command,boost::lockfree::capacity<W_QUEUE_SIZE>> _queue_commands;
-            int head = 0;
+            // analyser -> ui, newest complete frame
+            TripleBuffer<VisFrame> _vis_to_ui;
+
+            // engine -> ui, refreshed every ENGINE_TICK_MS
+            TripleBuffer<CallbackStats> _stats_to_ui;
+
+            // callback -> ui, every buffer
+            TripleBuffer<AudioClock> _clock_to_ui;
+            boost::lockfree::spsc_queue<Message,boost::lockfree::capacity<W_QUEUE_SIZE>> _queue_commands;
+
+            // ui -> engine, files to load - whoever pops one deletes it
+            boost::lockfree::spsc_queue<std::string*,boost::lockfree::capacity<LOAD_QUEUE_SIZE>> _load_requests;
+
+            // wakes the engine control loop
+            Wakeup _engine_wakeup;
+
+            // push + wake the engine
+            bool pushCommand( Command cmd );
+            bool pushCommand( const Message &msg );
+
+            // push a file to play instead of the current one + wake the engine
+            bool pushLoad( const std::string &path );
+
+            ~Queues();
 
         };
 
     }
-}
\ No newline at end of file
+}
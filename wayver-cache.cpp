@@ -0,0 +1,318 @@
+#include <wayver-cache.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+using namespace Wayver;
+namespace fs = std::filesystem;
+
+namespace {
+
+    const char _MAGIC[8] = { 'W', 'A', 'Y', 'V', 'E', 'R', 'C', '\0' };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t section_count;
+        uint64_t size;
+        int64_t mtime;
+        uint64_t content_hash;
+        uint32_t path_length;
+        uint32_t reserved;
+    };
+
+    struct SectionEntry {
+        uint32_t id;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // writers in this process take turns
+    boost::mutex _store_mutex;
+
+    uint64_t _fnv1a( const void *data, size_t n, uint64_t h = 1469598103934665603ULL )
+    {
+        const uint8_t *p = (const uint8_t*)data;
+        for ( size_t i = 0; i < n; i++ ){
+            h = ( h ^ p[i] ) * 1099511628211ULL;
+        }
+        return h;
+    }
+
+    size_t _align8( size_t n )
+    {
+        return ( n + 7 ) & ~(size_t)7;
+    }
+
+    fs::path _cacheDir()
+    {
+        const char *xdg = getenv( "XDG_CACHE_HOME" );
+        const char *home = getenv( "HOME" );
+
+        if ( xdg != NULL && xdg[0] != '\0' ){
+            return fs::path( xdg ) / CACHE_DIR_NAME;
+        }
+        return fs::path( home != NULL ? home : "." ) / ".cache" / CACHE_DIR_NAME;
+    }
+
+    fs::path _cacheFileFor( const std::string &abs_path )
+    {
+        char name[32];
+        snprintf( name, sizeof(name), "%016llx.wvc", 
+            (unsigned long long)_fnv1a( abs_path.data(), abs_path.size() ) );
+        return _cacheDir() / name;
+    }
+
+    /***
+     * Content hash - first and last CACHE_HASH_BYTES plus the size.
+     * Cheap, and catches a rewrite that kept size and mtime.
+    */
+    uint64_t _contentHash( const std::string &path, uint64_t size )
+    {
+        std::vector<uint8_t> buf( CACHE_HASH_BYTES );
+        uint64_t h = _fnv1a( &size, sizeof(size) );
+
+        FILE *f = fopen( path.c_str(), "rb" );
+        if ( f == NULL ){
+            return h;
+        }
+
+        size_t n = fread( buf.data(), 1, buf.size(), f );
+        h = _fnv1a( buf.data(), n, h );
+
+        if ( size > 2 * (uint64_t)CACHE_HASH_BYTES ){
+            fseeko( f, -(off_t)CACHE_HASH_BYTES, SEEK_END );
+            n = fread( buf.data(), 1, buf.size(), f );
+            h = _fnv1a( buf.data(), n, h );
+        }
+
+        fclose( f );
+        return h;
+    }
+
+    const Header *_validHeader( const uint8_t *map, size_t map_size, const Cache::FileKey &key )
+    {
+        if ( map_size < sizeof(Header) ){
+            return NULL;
+        }
+
+        const Header *h = (const Header*)map;
+
+        bool ok = memcmp( h->magic, _MAGIC, sizeof(_MAGIC) ) == 0
+            && h->version == CACHE_VERSION
+            && h->size == key.size
+            && h->mtime == key.mtime
+            && h->content_hash == key.content_hash
+            && h->path_length == key.path.size()
+            && sizeof(Header) + _align8( h->path_length ) 
+                + h->section_count * sizeof(SectionEntry) <= map_size
+            && memcmp( map + sizeof(Header), key.path.data(), key.path.size() ) == 0;
+
+        return ok ? h : NULL;
+    }
+
+    const SectionEntry *_sectionTable( const uint8_t *map )
+    {
+        const Header *h = (const Header*)map;
+        return (const SectionEntry*)( map + sizeof(Header) + _align8( h->path_length ) );
+    }
+}
+
+
+
+
+/****
+ * Entry
+*/
+Cache::Entry::Entry( const uint8_t *map, size_t size )
+:_map(map),
+_map_size(size)
+{}
+
+Cache::Entry::~Entry()
+{
+    munmap( (void*)_map, _map_size );
+}
+
+const uint8_t *Cache::Entry::section( SectionId id, size_t *size ) const
+{
+    const Header *h = (const Header*)_map;
+    const SectionEntry *table = _sectionTable( _map );
+
+    for ( uint32_t i = 0; i < h->section_count; i++ ){
+        if ( table[i].id == id && table[i].offset + table[i].size <= _map_size ){
+            *size = table[i].size;
+            return _map + table[i].offset;
+        }
+    }
+
+    *size = 0;
+    return NULL;
+}
+
+bool Cache::Entry::has( SectionId id ) const
+{
+    size_t size;
+    return section( id, &size ) != NULL;
+}
+
+std::vector<Cache::SectionId> Cache::Entry::sectionIds() const
+{
+    const Header *h = (const Header*)_map;
+    const SectionEntry *table = _sectionTable( _map );
+
+    std::vector<SectionId> ids;
+    for ( uint32_t i = 0; i < h->section_count; i++ ){
+        ids.push_back( (SectionId)table[i].id );
+    }
+    return ids;
+}
+
+
+
+
+/****
+ * Lookup / store
+*/
+Cache::FileKey Cache::keyFor( const std::string &audio_path )
+{
+    FileKey key;
+    std::error_code ec;
+
+    key.path = fs::absolute( audio_path, ec ).lexically_normal().string();
+    key.size = fs::file_size( audio_path, ec );
+    key.mtime = fs::last_write_time( audio_path, ec ).time_since_epoch().count();
+    key.content_hash = _contentHash( audio_path, key.size );
+
+    return key;
+}
+
+namespace {
+
+    // the key hashes the audio file - store() works it out once for both steps
+    std::shared_ptr<Cache::Entry> _lookup( const Cache::FileKey &key )
+    {
+        const std::string cache_file = _cacheFileFor( key.path ).string();
+
+        int fd = open( cache_file.c_str(), O_RDONLY );
+        if ( fd < 0 ){
+            return NULL;
+        }
+
+        struct stat st;
+        if ( fstat( fd, &st ) != 0 || st.st_size == 0 ){
+            close( fd );
+            return NULL;
+        }
+
+        void *map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        close( fd );
+
+        if ( map == MAP_FAILED ){
+            return NULL;
+        }
+
+        if ( _validHeader( (const uint8_t*)map, st.st_size, key ) == NULL ){
+            munmap( map, st.st_size );
+            return NULL;
+        }
+
+        return std::make_shared<Cache::Entry>( (const uint8_t*)map, (size_t)st.st_size );
+    }
+}
+
+std::shared_ptr<Cache::Entry> Cache::lookup( const std::string &audio_path )
+{
+    return _lookup( keyFor( audio_path ) );
+}
+
+bool Cache::store( const std::string &audio_path, SectionId id, const void *data, size_t size )
+{
+    boost::lock_guard<boost::mutex> lock( _store_mutex );
+
+    const FileKey key = keyFor( audio_path );
+    std::shared_ptr<Entry> old = _lookup( key );
+
+    // what goes in: every old section but this one, then the new one
+    std::vector<std::pair<SectionId, std::pair<const void*, size_t>>> sections;
+
+    if ( old != NULL ){
+        for ( SectionId old_id : old->sectionIds() ){
+            size_t old_size;
+            const uint8_t *p = old->section( old_id, &old_size );
+            if ( old_id != id && p != NULL ){
+                sections.push_back( { old_id, { p, old_size } } );
+            }
+        }
+    }
+    sections.push_back( { id, { data, size } } );
+
+    Header h;
+    memcpy( h.magic, _MAGIC, sizeof(_MAGIC) );
+    h.version = CACHE_VERSION;
+    h.section_count = sections.size();
+    h.size = key.size;
+    h.mtime = key.mtime;
+    h.content_hash = key.content_hash;
+    h.path_length = key.path.size();
+    h.reserved = 0;
+
+    std::vector<SectionEntry> table( sections.size() );
+    uint64_t offset = sizeof(Header) + _align8( h.path_length ) + table.size() * sizeof(SectionEntry);
+
+    for ( size_t i = 0; i < sections.size(); i++ ){
+        table[i] = { sections[i].first, 0, offset, sections[i].second.second };
+        offset = _align8( offset + sections[i].second.second );
+    }
+
+    std::error_code ec;
+    const fs::path target = _cacheFileFor( key.path );
+    fs::create_directories( target.parent_path(), ec );
+
+    // a name of its own - another process may be writing the same entry
+    std::string tmp = target.string() + ".XXXXXX";
+    const int fd = mkstemp( &tmp[0] );
+    if ( fd < 0 ){
+        return false;
+    }
+
+    FILE *f = fdopen( fd, "wb" );
+    if ( f == NULL ){
+        close( fd );
+        remove( tmp.c_str() );
+        return false;
+    }
+
+    const char pad[8] = {0};
+    bool ok = fwrite( &h, sizeof(h), 1, f ) == 1
+        && fwrite( key.path.data(), 1, key.path.size(), f ) == key.path.size()
+        && fwrite( pad, 1, _align8( key.path.size() ) - key.path.size(), f ) == _align8( key.path.size() ) - key.path.size()
+        && fwrite( table.data(), sizeof(SectionEntry), table.size(), f ) == table.size();
+
+    for ( size_t i = 0; ok && i < sections.size(); i++ ){
+        const size_t n = sections[i].second.second;
+        ok = fwrite( sections[i].second.first, 1, n, f ) == n
+            && fwrite( pad, 1, _align8( n ) - n, f ) == _align8( n ) - n;
+    }
+
+    ok = ( fclose( f ) == 0 ) && ok;
+
+    // readers keep their old mapping, new lookups see the new file
+    if ( !ok || rename( tmp.c_str(), target.c_str() ) != 0 ){
+        remove( tmp.c_str() );
+        return false;
+    }
+
+    return true;
+}
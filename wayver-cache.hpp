@@ -0,0 +1,79 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Wayver {
+
+    namespace Cache {
+
+        enum SectionId : uint32_t {
+            OVERVIEW = 1,
+            LOUDNESS = 2,
+            SPECTRUM = 3,
+            SEEK_INDEX = 4
+        };
+
+        /***
+         * Identity of an audio file - a cache entry is only good while
+         * all four still match
+        */
+        struct FileKey {
+            std::string path;        // absolute
+            uint64_t size = 0;
+            int64_t mtime = 0;       // file clock ticks
+            uint64_t content_hash = 0;
+        };
+
+        // LOUDNESS section
+        struct Loudness {
+            float peak;
+            float rms;
+        };
+
+        /***
+         * Read-only view of a cache file, mmap'ed.
+         * Section pointers stay valid for the life of the Entry,
+         * even if the file is rewritten meanwhile.
+        */
+        class Entry {
+
+            const uint8_t *_map = NULL;
+            size_t _map_size = 0;
+
+            public:
+
+                Entry( const uint8_t *map, size_t size );
+                ~Entry();
+
+                Entry( const Entry & ) = delete;
+                Entry &operator=( const Entry & ) = delete;
+
+                // NULL when the section is not there
+                const uint8_t *section( SectionId id, size_t *size ) const;
+                bool has( SectionId id ) const;
+
+                // every section, to carry over on rewrite
+                std::vector<SectionId> sectionIds() const;
+        };
+
+        /***
+         * Central store under $XDG_CACHE_HOME/wayver (or ~/.cache/wayver),
+         * one file per audio file, named after its path.
+         * 
+         *      File  -> header | path | section table | sections
+         *      Any mismatch in magic, CACHE_VERSION or FileKey is a miss.
+        */
+        FileKey keyFor( const std::string &audio_path );
+
+        // NULL on a miss - cheap, only the header is validated up front
+        std::shared_ptr<Entry> lookup( const std::string &audio_path );
+
+        // adds / replaces one section, keeping the rest - atomic rename
+        bool store( const std::string &audio_path, SectionId id, const void *data, size_t size );
+    }
+}
@@ -0,0 +1,145 @@
+#include <wayver-compositor.hpp>
+#include <wayver-ui.hpp>
+
+#include <stdexcept>
+#include <string>
+
+using namespace Wayver::UI;
+
+void Wayver::UI::uniteRect( SDL_Rect &into, const SDL_Rect &r )
+{
+    if ( SDL_RectEmpty( &r ) ){
+        return;
+    }
+
+    if ( SDL_RectEmpty( &into ) ){
+        into = r;
+    } else {
+        SDL_UnionRect( &into, &r, &into );
+    }
+}
+
+Compositor::Compositor( SDL_Renderer *r, const SDL_Rect &bounds, SDL_Color background )
+:_renderer(r),
+_bounds(bounds),
+_background(background),
+_dirty(bounds)
+{}
+
+Compositor::~Compositor()
+{
+    for ( Layer &layer : _layers ){
+        if ( layer.texture != NULL ){
+            SDL_DestroyTexture( layer.texture );
+        }
+    }
+}
+
+int Compositor::addLayer( bool cached )
+{
+    Layer layer;
+
+    if ( cached ){
+        layer.texture = SDL_CreateTexture(
+            _renderer,
+            SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_TARGET,
+            _bounds.x + _bounds.w,
+            _bounds.y + _bounds.h
+        );
+
+        if ( layer.texture == NULL ){
+            throw std::runtime_error( std::string("Compositor: ") + SDL_GetError() );
+        }
+
+        SDL_SetTextureBlendMode( layer.texture, SDL_BLENDMODE_BLEND );
+
+        // starts see-through - its components come in dirty and fill it
+        SDL_SetRenderTarget( _renderer, layer.texture );
+        _fill( _bounds, { 0, 0, 0, 0 } );
+        SDL_SetRenderTarget( _renderer, NULL );
+    }
+
+    _layers.push_back( layer );
+    return _layers.size() - 1;
+}
+
+void Compositor::add( int layer, UIComponent *component )
+{
+    _layers[layer].components.push_back( component );
+}
+
+void Compositor::invalidate()
+{
+    invalidate( _bounds );
+}
+
+void Compositor::invalidate( const SDL_Rect &r )
+{
+    uniteRect( _dirty, r );
+}
+
+// RenderClear ignores the clip rect, and blending would keep what is there
+void Compositor::_fill( const SDL_Rect &r, SDL_Color color )
+{
+    SDL_SetRenderDrawBlendMode( _renderer, SDL_BLENDMODE_NONE );
+    SDL_SetRenderDrawColor( _renderer, color.r, color.g, color.b, color.a );
+    SDL_RenderFillRect( _renderer, &r );
+    SDL_SetRenderDrawBlendMode( _renderer, SDL_BLENDMODE_BLEND );
+}
+
+bool Compositor::compose( SDL_Texture *target )
+{
+    /* cached layers catch up first, each only inside its own damage */
+    for ( Layer &layer : _layers ){
+
+        SDL_Rect layer_dirty = {0, 0, 0, 0};
+        for ( UIComponent *c : layer.components ){
+            uniteRect( layer_dirty, c->takeDirty() );
+        }
+
+        if ( SDL_RectEmpty( &layer_dirty ) ){
+            continue;
+        }
+
+        if ( layer.texture != NULL ){
+            SDL_SetRenderTarget( _renderer, layer.texture );
+            SDL_RenderSetClipRect( _renderer, &layer_dirty );
+
+            _fill( layer_dirty, { 0, 0, 0, 0 } );
+            for ( UIComponent *c : layer.components ){
+                c->draw();
+            }
+
+            SDL_RenderSetClipRect( _renderer, NULL );
+        }
+
+        uniteRect( _dirty, layer_dirty );
+    }
+
+    if ( SDL_RectEmpty( &_dirty ) ){
+        return false;
+    }
+
+    /* then the target, bottom to top, inside the union of it all */
+    SDL_SetRenderTarget( _renderer, target );
+    SDL_RenderSetClipRect( _renderer, &_dirty );
+
+    _fill( _dirty, _background );
+
+    for ( Layer &layer : _layers ){
+        if ( layer.texture != NULL ){
+            SDL_RenderCopy( _renderer, layer.texture, &_dirty, &_dirty );
+        } else {
+            for ( UIComponent *c : layer.components ){
+                c->draw();
+            }
+        }
+    }
+
+    SDL_RenderSetClipRect( _renderer, NULL );
+    SDL_SetRenderTarget( _renderer, NULL );
+
+    _dirty = {0, 0, 0, 0};
+    return true;
+}
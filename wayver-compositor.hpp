@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <SDL.h>
+
+namespace Wayver {
+
+    namespace UI {
+
+        class UIComponent;
+
+        /***
+         * Retained-mode drawing for WayverUi.
+         *
+         *      - Components sit on layers, bottom to top. A cached
+         *      layer keeps its own target texture and redraws into it
+         *      only where one of its components went dirty
+         *      - compose() gathers every component's dirty rect, then
+         *      rebuilds just that area of the target, clipped: background,
+         *      cached layers copied, live layers drawn
+         *      - Nothing dirty -> compose() does nothing and the frame
+         *      need not be presented at all
+        */
+        class Compositor {
+
+            struct Layer {
+                std::vector<UIComponent*> components;
+
+                // NULL -> a live layer, drawn straight into the target
+                SDL_Texture *texture = NULL;
+            };
+
+            SDL_Renderer *_renderer;
+            SDL_Rect _bounds;
+            SDL_Color _background;
+
+            std::vector<Layer> _layers;
+
+            // damage not yet composed, window coordinates
+            SDL_Rect _dirty = {0, 0, 0, 0};
+
+            void _fill( const SDL_Rect &r, SDL_Color color );
+
+            public:
+                Compositor( SDL_Renderer *r, const SDL_Rect &bounds, SDL_Color background );
+                ~Compositor();
+
+                // on top of the ones added before - returns its index
+                int addLayer( bool cached );
+
+                // not owned
+                void add( int layer, UIComponent *component );
+
+                // something outside the components changed, e.g. the window was exposed
+                void invalidate();
+                void invalidate( const SDL_Rect &r );
+
+                // redraws what changed into target - false if nothing had
+                bool compose( SDL_Texture *target );
+        };
+
+        // grows into to cover r, empty rects leave it alone
+        void uniteRect( SDL_Rect &into, const SDL_Rect &r );
+    }
+}
@@ -0,0 +1,417 @@
+#include <wayver-decoder.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+using namespace Wayver::Audio;
+
+Decoder::Decoder(
+    Source *source,
+    size_t ring_frames,
+    std::shared_ptr<spdlog::logger> logger
+):_source(source),
+_channels(source->info().channels),
+_samplerate(source->info().samplerate),
+_ring(ring_frames, source->info().channels),
+_scratch(DECODER_CHUNK_FRAMES * source->info().channels, 0),
+_low_water(std::max<size_t>( ring_frames / DECODER_WAKE_FRACTION, DECODER_CHUNK_FRAMES )),
+_logger(logger)
+{
+    sem_init( &_wake, 0, 0 );
+}
+
+Decoder::~Decoder()
+{
+    stop();
+
+    delete _source;
+    delete _previous;
+    delete _queued;
+    delete _next.load();
+
+    sem_destroy( &_wake );
+}
+
+void Decoder::addTap( DecodeTap *tap )
+{
+    _taps.push_back( tap );
+}
+
+void Decoder::prefill()
+{
+    topUp();
+    _logger->debug("Decoder::prefill() - ring at {}", _ring.fillLevel());
+}
+
+void Decoder::topUp()
+{
+    while ( _ring.writeAvailable() >= DECODER_CHUNK_FRAMES ){
+
+        if ( _source_done ){
+            _sourceDone();
+            if ( _source_done ){
+                break;
+            }
+        }
+
+        _decodeChunk( DECODER_CHUNK_FRAMES );
+    }
+}
+
+void Decoder::start()
+{
+    _running = true;
+    _thread = boost::thread( &Decoder::_loop, this );
+}
+
+void Decoder::stop()
+{
+    if ( _running ){
+        _running = false;
+        _wakeUp();
+        _thread.join();
+    }
+}
+
+bool Decoder::isFinished() const
+{
+    return _eof.load( std::memory_order_acquire ) && _ring.readAvailable() == 0;
+}
+
+uint32_t Decoder::requestSeek( int64_t frame )
+{
+    _seek_target.store( frame, std::memory_order_relaxed );
+    const uint32_t ticket = _seek_request.fetch_add( 1, std::memory_order_release ) + 1;
+    _wakeUp();
+    return ticket;
+}
+
+void Decoder::consumed()
+{
+    if ( _ring.writeAvailable() >= _low_water ){
+        _wakeUp();
+    }
+}
+
+bool Decoder::seekServed( uint32_t ticket ) const
+{
+    return _seek_served.load( std::memory_order_acquire ) == ticket;
+}
+
+uint64_t Decoder::seekRingPosition() const
+{
+    return _seek_ring_pos.load( std::memory_order_relaxed );
+}
+
+bool Decoder::setNext( Source *next, int track )
+{
+    if ( !wantsNext() ){
+        return false;
+    }
+
+    _next_track = track;
+    _next.store( next, std::memory_order_release );
+    _wakeUp();
+    return true;
+}
+
+bool Decoder::wantsNext() const
+{
+    return _next.load( std::memory_order_acquire ) == NULL;
+}
+
+bool Decoder::boundaryAhead( TrackBoundary *out ) const
+{
+    if ( _boundaries.load( std::memory_order_acquire ) == _crossed.load( std::memory_order_relaxed ) ){
+        return false;
+    }
+
+    out->ring_pos = _boundary_pos.load( std::memory_order_relaxed );
+    out->track = _boundary_track.load( std::memory_order_relaxed );
+    out->frames = _boundary_frames.load( std::memory_order_relaxed );
+    return true;
+}
+
+void Decoder::crossBoundary()
+{
+    _crossed.fetch_add( 1, std::memory_order_release );
+    // the old track can go, and a source that ran dry can chain on
+    _wakeUp();
+}
+
+bool Decoder::_boundaryPending() const
+{
+    return _boundaries.load( std::memory_order_relaxed ) != _crossed.load( std::memory_order_acquire );
+}
+
+/***
+ * A seek is always into the track the callback plays. With a boundary
+ * still ahead of it that is _previous, and the track after it has to
+ * come back out of the ring first. The callback is parked on the seek
+ * ticket meanwhile, so it cannot cross under us.
+*/
+void Decoder::_serveSeek()
+{
+    uint32_t ticket = _seek_request.load( std::memory_order_acquire );
+    int64_t target = _seek_target.load( std::memory_order_relaxed );
+
+    if ( _boundaryPending() ){
+        _unchain();
+    }
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+    if ( !_source->seek( target ) ){
+        _logger->error("Decoder::_serveSeek() - could not seek to {}", target);
+    } else {
+        _logger->debug("Decoder::_serveSeek() - {} in {} us", target,
+            boost::chrono::duration_cast<boost::chrono::microseconds>(
+                boost::chrono::steady_clock::now() - start ).count() );
+    }
+
+    _file_frame = target;
+    _source_done = false;
+
+    _eof.store( false, std::memory_order_relaxed );
+    _seek_ring_pos.store( _ring.writePosition(), std::memory_order_relaxed );
+    _seek_served.store( ticket, std::memory_order_release );
+}
+
+// next frames of _source - from the preroll while it lasts
+size_t Decoder::_read( float *out, size_t n_frames )
+{
+    size_t got = 0;
+
+    if ( _prerolled == _source && _preroll_used < _preroll_frames ){
+        got = std::min( n_frames, _preroll_frames - _preroll_used );
+        memcpy( out, _preroll.data() + _preroll_used * _channels, got * _channels * sizeof(float) );
+        _preroll_used += got;
+    }
+
+    if ( got < n_frames ){
+        int64_t n_read = _source->readFrames( out + got * _channels, n_frames - got );
+        got += std::max<int64_t>( 0, n_read );
+    }
+
+    return got;
+}
+
+size_t Decoder::_decodeChunk( size_t max_frames )
+{
+    size_t n_read = _read( _scratch.data(), max_frames );
+
+    if ( n_read < max_frames ){
+        _source_done = true;
+    }
+
+    if ( n_read == 0 ){
+        return 0;
+    }
+
+    _ring.write( _scratch.data(), n_read );
+
+    for ( DecodeTap *tap : _taps ){
+        tap->onDecoded( _scratch.data(), n_read, _file_frame );
+    }
+    _file_frame += n_read;
+
+    return n_read;
+}
+
+/***
+ * _source has nothing more: carry on with the next track, or if
+ * there is none, that is the end - until someone queues one.
+ * With a boundary still ahead of the callback, wait for it.
+*/
+void Decoder::_sourceDone()
+{
+    if ( _chain() ){
+        _source_done = false;
+        _eof.store( false, std::memory_order_release );
+        return;
+    }
+
+    _eof.store( _queued == NULL && wantsNext(), std::memory_order_release );
+}
+
+bool Decoder::_chain()
+{
+    if ( _boundaryPending() ){
+        return false;
+    }
+
+    _retire();
+
+    int track = _queued_track;
+    Source *next = _queued;
+    _queued = NULL;
+
+    if ( next == NULL ){
+        next = _next.exchange( NULL, std::memory_order_acq_rel );
+        track = _next_track;
+    }
+
+    if ( next == NULL ){
+        return false;
+    }
+
+    _previous = _source;
+    _previous_track = _source_track;
+    _source = next;
+    _source_track = track;
+    _file_frame = 0;
+
+    // everything about the boundary lands before the count that announces it
+    _boundary_pos.store( _ring.writePosition(), std::memory_order_relaxed );
+    _boundary_track.store( track, std::memory_order_relaxed );
+    _boundary_frames.store( next->info().frames, std::memory_order_relaxed );
+    _boundaries.fetch_add( 1, std::memory_order_release );
+
+    _logger->debug("Decoder::_chain() - track {} starts at ring position {}", track, _ring.writePosition());
+    return true;
+}
+
+// the track after the boundary goes back to the front of the queue, from its start
+void Decoder::_unchain()
+{
+    if ( _prerolled == _source ){
+        _preroll_used = 0;
+        _source->seek( _preroll_frames );
+    } else {
+        _source->seek( 0 );
+    }
+
+    // _chain() took any earlier _queued before this boundary was made
+    _queued = _source;
+    _queued_track = _source_track;
+    _source = _previous;
+    _source_track = _previous_track;
+    _previous = NULL;
+
+    _boundaries.fetch_sub( 1, std::memory_order_relaxed );
+}
+
+// the callback is past the boundary - the old track can go
+void Decoder::_retire()
+{
+    if ( _previous == NULL || _boundaryPending() ){
+        return;
+    }
+
+    if ( _prerolled == _previous ){
+        _prerolled = NULL;
+    }
+
+    delete _previous;
+    _previous = NULL;
+}
+
+void Decoder::_prerollNext()
+{
+    Source *next = _queued != NULL ? _queued : _next.load( std::memory_order_acquire );
+
+    if ( next == NULL || next == _prerolled ){
+        return;
+    }
+
+    // the track playing now is still reading from it
+    if ( _prerolled == _source && _preroll_used < _preroll_frames ){
+        return;
+    }
+
+    const size_t frames = DECODER_PREROLL_SECONDS * _samplerate;
+    _preroll.resize( frames * _channels );
+
+    _preroll_frames = std::max<int64_t>( 0, next->readFrames( _preroll.data(), frames ) );
+    _preroll_used = 0;
+    _prerolled = next;
+
+    _logger->debug("Decoder::_prerollNext() - {} frames of track {} in memory", 
+        _preroll_frames, next == _queued ? _queued_track : _next_track);
+}
+
+// anything for the thread to do, or is it time to park
+bool Decoder::_busy() const
+{
+    if ( !_running ){
+        return true;
+    }
+
+    if ( _seek_request.load( std::memory_order_acquire ) 
+        != _seek_served.load( std::memory_order_relaxed ) ){
+        return true;
+    }
+
+    if ( !_source_done ){
+        return _ring.writeAvailable() >= DECODER_CHUNK_FRAMES;
+    }
+
+    // ran dry - only a track to chain on, once the callback is past the last boundary
+    return ( _queued != NULL || !wantsNext() ) && !_boundaryPending();
+}
+
+/***
+ * Sleep until requestSeek(), setNext(), crossBoundary(), stop() or
+ * consumed() says otherwise. _asleep goes up before the last look,
+ * so a wake-up between that look and sem_wait() is not lost.
+*/
+void Decoder::_park()
+{
+    _asleep.store( true );
+
+    if ( _busy() ){
+        // a waker got in first and has posted, or is about to
+        if ( !_asleep.exchange( false ) ){
+            sem_wait( &_wake );
+        }
+        return;
+    }
+
+    while ( sem_wait( &_wake ) != 0 && errno == EINTR ){}
+}
+
+void Decoder::_wakeUp()
+{
+    if ( _asleep.exchange( false ) ){
+        sem_post( &_wake );
+    }
+}
+
+/***
+ * Keep the ring topped up. With no room for a whole chunk, park until
+ * the callback has drained it to the low-water mark - it reads at
+ * exactly the sample rate, so there is no point waking sooner. At the
+ * end of the file, park until a seek or a queued track revives it.
+ * Runs until stop().
+*/
+void Decoder::_loop()
+{
+    _logger->debug("Decoder::_loop() - started, ring={} frames", _ring.capacity());
+
+    while ( _running ){
+
+        if ( _seek_request.load( std::memory_order_acquire ) 
+            != _seek_served.load( std::memory_order_relaxed ) ){
+            _serveSeek();
+        }
+
+        // also picks up a track queued after we had already stopped
+        if ( _source_done ){
+            _sourceDone();
+        }
+
+        if ( !_source_done && _ring.writeAvailable() >= DECODER_CHUNK_FRAMES ){
+            _decodeChunk( DECODER_CHUNK_FRAMES );
+            continue;
+        }
+
+        // idle - tidy up and get the next track's start off the disk
+        _retire();
+        _prerollNext();
+
+        _park();
+    }
+
+    _logger->debug("Decoder::_loop() - exiting, eof={}", _eof.load());
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+#include <wayver-ring.hpp>
+#include <wayver-source.hpp>
+
+#include <atomic>
+#include <vector>
+
+#include <semaphore.h>
+
+#include <boost/thread.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        /***
+         * Sees every decoded chunk, on the decoder thread.
+         * Must never block the decoder - drop instead.
+        */
+        class DecodeTap {
+            public:
+                virtual ~DecodeTap() {}
+
+                // frame -> position in the file of frames[0]
+                virtual void onDecoded( const float *frames, size_t n_frames, int64_t frame ) = 0;
+        };
+
+        // where the next track starts in the ring, and what it is
+        struct TrackBoundary {
+            uint64_t ring_pos = 0;
+            int track = 0;
+            int64_t frames = 0;
+        };
+
+        /***
+         * Decode-ahead reader.
+         * 
+         *      - Owns a thread that pulls frames from a Source
+         *      and pushes them into a FrameRing
+         *      - The audio callback only ever reads from the ring
+         *      - Gapless: when the source runs dry, the one handed over
+         *      with setNext() carries on in the same ring, from the very
+         *      next frame. The ring position it starts at is published as
+         *      a TrackBoundary; the callback crosses it when it gets there
+         *      - One boundary is ahead of the callback at a time. Until it
+         *      is crossed the old source is kept, so a seek can go back
+        */
+        class Decoder {
+
+            // owned, all of them - the one being decoded, and while a
+            // boundary is ahead, the one the callback still plays
+            Source *_source;
+            Source *_previous = NULL;
+            int _source_track = 0;
+            int _previous_track = 0;
+
+            // engine -> decoder, the track to chain on, and one a seek
+            // took back out of the ring - that goes first
+            std::atomic<Source*> _next{NULL};
+            int _next_track = 0;
+            Source *_queued = NULL;
+            int _queued_track = 0;
+
+            // first DECODER_PREROLL_SECONDS of the next track, read while idle
+            Source *_prerolled = NULL;
+            std::vector<float> _preroll;
+            size_t _preroll_frames = 0;
+            size_t _preroll_used = 0;
+
+            // decoder publishes, callback crosses
+            std::atomic<uint64_t> _boundary_pos{0};
+            std::atomic<int> _boundary_track{0};
+            std::atomic<int64_t> _boundary_frames{0};
+            std::atomic<uint32_t> _boundaries{0};
+            std::atomic<uint32_t> _crossed{0};
+
+            // _source returned short - chain on, or that was the end
+            bool _source_done = false;
+
+            int _channels;
+            int _samplerate;
+
+            Bus::FrameRing _ring;
+            std::vector<float> _scratch;
+
+            // file position of the next frame to decode
+            int64_t _file_frame = 0;
+            std::vector<DecodeTap*> _taps;
+
+            boost::thread _thread;
+            std::atomic<bool> _running{false};
+            std::atomic<bool> _eof{false};
+
+            // nothing to do - the thread parks on _wake. sem_post is RT
+            // safe, so the callback can wake it; _asleep keeps that to
+            // one post per nap
+            sem_t _wake;
+            std::atomic<bool> _asleep{false};
+            // free frames in the ring that are worth waking up for
+            size_t _low_water;
+
+            // seek handshake: callback bumps _seek_request, decoder
+            // answers with _seek_served and the ring position the
+            // post-seek frames start at
+            std::atomic<int64_t> _seek_target{0};
+            std::atomic<uint32_t> _seek_request{0};
+            std::atomic<uint32_t> _seek_served{0};
+            std::atomic<uint64_t> _seek_ring_pos{0};
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            // reads one chunk into the ring, returns frames decoded
+            size_t _decodeChunk( size_t max_frames );
+            size_t _read( float *out, size_t n_frames );
+            void _serveSeek();
+            void _loop();
+            bool _busy() const;
+            void _park();
+            void _wakeUp();
+
+            bool _boundaryPending() const;
+            void _sourceDone();
+            bool _chain();
+            void _unchain();
+            void _retire();
+            void _prerollNext();
+
+            public:
+
+                // takes ownership of source
+                Decoder(
+                    Source *source,
+                    size_t ring_frames,
+                    std::shared_ptr<spdlog::logger> logger
+                );
+
+                ~Decoder();
+
+                // not owned - add before start()
+                void addTap( DecodeTap *tap );
+
+                // fill the ring synchronously - call before the stream starts
+                void prefill();
+
+                // same, without the log line - offline rendering drives the
+                // decoder this way every block instead of start()
+                void topUp();
+
+                void start();
+                void stop();
+
+                Bus::FrameRing &ring() { return _ring; }
+
+                // callback side, RT safe - after reading the ring, wakes
+                // the decoder once enough of it is free
+                void consumed();
+
+                /***
+                 * Seek - RT safe, never blocks.
+                 * requestSeek() returns a ticket; once seekServed(ticket)
+                 * the caller skips the ring to seekRingPosition()
+                */
+                uint32_t requestSeek( int64_t frame );
+                bool seekServed( uint32_t ticket ) const;
+                uint64_t seekRingPosition() const;
+
+                // true once the file is exhausted AND the ring drained
+                bool isFinished() const;
+
+                /***
+                 * Gapless - engine side. Takes ownership of next, which
+                 * must match this decoder's channels and rate; track is
+                 * whatever the caller wants the boundary to report.
+                 * false while an earlier one has not been taken yet
+                */
+                bool setNext( Source *next, int track );
+                bool wantsNext() const;
+
+                /***
+                 * Gapless - callback side, RT safe. A boundary ahead
+                 * sits at or after the ring's read position; once the
+                 * read position reaches it, crossBoundary()
+                */
+                bool boundaryAhead( TrackBoundary *out ) const;
+                void crossBoundary();
+        };
+
+    }
+}
@@ -1,6 +1,136 @@
 #pragma once
 
 #define FFT_OUT_BANDS 100
-#define UI_WAIT_TIME 33
 #define W_QUEUE_SIZE 1024
-#define FRAMES_IN_BUFFER 128
\ No newline at end of file
+#define FRAMES_IN_BUFFER 128
+
+// Engine control loop wakes at least this often
+#define ENGINE_TICK_MS 250
+
+// UI frames pace to the display; these when it will not say, and
+// how long the UI sleeps between events while nothing plays
+#define UI_DEFAULT_REFRESH_HZ 60
+#define UI_IDLE_WAIT_MS 250
+
+// Decode-ahead ring, in frames. Override with -r
+#define DECODER_RING_FRAMES 16384
+#define DECODER_CHUNK_FRAMES 1024
+// the callback wakes a parked decoder once 1/this of the ring is free
+#define DECODER_WAKE_FRACTION 4
+// the next playlist entry has this much read ahead into memory
+#define DECODER_PREROLL_SECONDS 2
+
+// FLAC seek points this far apart - a seek decodes at most this much to land
+#define SEEK_INDEX_SPACING_MS 500
+
+// Scrubbing: decoded blocks kept for random access, the threads
+// that fill them and how often they look while there is work, the grains
+// played off them and how far ahead of the pointer blocks are read
+#define BLOCK_FRAMES 4096
+#define BLOCK_CACHE_BLOCKS 128
+#define BLOCK_READERS 2
+#define BLOCK_QUEUE_SIZE 64
+#define BLOCK_READER_POLL_MS 2
+#define SCRUB_GRAIN_MS 40
+#define SCRUB_LOOKAHEAD_MS 150
+
+// A/B loops: this much of the region is kept decoded - the ring has
+// that long to seek past it - and the seam at B crossfades this long
+#define LOOP_PRELOAD_SECONDS 20
+#define LOOP_XFADE_MS 10
+
+// Varispeed: the speeds playback can run at, how long a change glides
+// for, and how much input the resampler pulls at a time
+#define VARISPEED_MIN 0.25
+#define VARISPEED_MAX 4.0
+#define VARISPEED_GLIDE_MS 80
+#define VARISPEED_CHUNK_FRAMES 256
+
+// Resampler filters: one table per quarter octave of stretch, 1x -> VARISPEED_MAX,
+// and the floats past a channel's input line the widest kernel may read
+#define RESAMPLE_STRETCHES 9
+#define RESAMPLE_LINE_PAD 16
+
+// Conversion to the device's rate: filter rows at most, a rate pair
+// reducing to more output phases interpolates between them, and the
+// rates AudioEngine::setOutputRate() takes besides one in Hz, see -R
+#define RATIO_MAX_PHASES 1024
+#define OUTPUT_RATE_NATIVE 0
+#define OUTPUT_RATE_FILE -1
+
+// Time-stretch, pitch kept: the tempos it runs at and the UI's step,
+// each method's frame length and how far WSOLA looks either way for a
+// splice, how far the worker runs ahead of the callback, how often it
+// looks for work, and how much input the callback hands it at a time
+#define STRETCH_MIN_TEMPO 0.5
+#define STRETCH_MAX_TEMPO 2.0
+#define STRETCH_TEMPO_STEP 0.05
+#define STRETCH_WSOLA_MS 30
+#define STRETCH_WSOLA_SEEK_MS 8
+#define STRETCH_VOCODER_MS 45
+#define STRETCH_AHEAD_MS 60
+#define STRETCH_POLL_MS 1
+#define STRETCH_IDLE_MS 20
+#define STRETCH_CHUNK_FRAMES 256
+
+// Mapped PCM files: prefetch this far ahead of the decoder, drop pages this far behind
+#define PCM_ADVISE_BYTES (4 << 20)
+
+// Timestamped messages from the engine into the callback
+#define RT_QUEUE_SIZE 256
+// Sources the callback has swapped out, waiting for the engine to free them,
+// and files asked for that the engine has not loaded yet
+#define RETIRE_QUEUE_SIZE 8
+#define LOAD_QUEUE_SIZE 8
+
+// Audio thread log records, formatted off the audio thread this often
+#define RT_LOG_RECORDS 256
+#define RT_LOG_DRAIN_MS 50
+
+// Gain changes glide over this many frames
+#define GAIN_RAMP_FRAMES 512
+
+// Buffer auto-tuning (-B auto): sizes tried, how long a fresh stream
+// settles before it is judged, how long it must run clean before a
+// smaller size is tried, and the callback loads that move it
+#define TUNE_MIN_FRAMES 32
+#define TUNE_MAX_FRAMES 4096
+#define TUNE_SETTLE_MS 2000
+#define TUNE_STABLE_MS 30000
+#define TUNE_HIGH_LOAD 0.7
+#define TUNE_LOW_LOAD 0.25
+
+// Spectrum analysis
+#define ANALYSIS_MIN_HZ 20
+#define ANALYSIS_MAX_HZ 20000
+#define ANALYSIS_FLOOR_DB -90
+// bands fall back by this much of full scale per second
+#define ANALYSIS_FALL_PER_SEC 1.5
+// decoded blocks waiting for the analyser, DECODER_CHUNK_FRAMES each
+#define ANALYSIS_QUEUE_BLOCKS 64
+// longest the analyser waits on the play head before republishing it
+#define ANALYSIS_MAX_WAIT_MS 20
+#define FFTW_WISDOM_FILE "wayver.wisdom"
+
+// Visualisation frames, see Bus::VisFrame
+#define VIS_SAMPLES DECODER_CHUNK_FRAMES
+#define VIS_MAX_CHANNELS 8
+
+
+// Waveform overview pyramid, in frames per bucket
+#define OVERVIEW_MIN_BUCKET 256
+#define OVERVIEW_MAX_BUCKET 65536
+// finest level never has more buckets than this
+#define OVERVIEW_MAX_BUCKETS 8192
+#define OVERVIEW_READ_FRAMES 65536
+
+// On-disk analysis cache
+#define CACHE_VERSION 1
+#define CACHE_DIR_NAME "wayver"
+#define CACHE_HASH_BYTES 65536
+
+// Callback benchmark (-b / make bench): audio per case, how much faster
+// than real time the null device runs, and its wakeup jitter
+#define BENCH_SECONDS 5
+#define BENCH_SPEED 20
+#define BENCH_JITTER_US 200
\ No newline at end of file
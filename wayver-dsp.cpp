@@ -0,0 +1,584 @@
+#include <wayver-dsp.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#endif
+
+using namespace Wayver;
+
+// below this an exponential ramp degrades to a linear one
+#define EXP_RAMP_FLOOR 1e-3f
+
+// gains this small are silence, and would only breed denormals
+#define GAIN_SILENCE 1e-6f
+
+namespace {
+
+    typedef void (*RampFn)( const float*, float*, size_t, int, float, float, bool );
+    typedef void (*ReduceFn)( const float*, size_t, float*, float*, double* );
+    typedef void (*ConvertFn)( const void*, float*, size_t, Dsp::PcmFormat );
+    typedef void (*PolyphaseFn)( const float*, const float*, float, const float *const*, int, size_t, float* );
+
+    /***
+     * Per-frame gain, linear as g0 + f * step so a long ramp lands
+     * on its end value, exponential with a multiplicative step.
+    */
+    void _rampScalar( const float *in, float *out, size_t frames, int channels, float g0, float step, bool exp )
+    {
+        float g = g0;
+
+        for ( size_t f = 0; f < frames; f++ ){
+            if ( !exp ){
+                g = g0 + step * f;
+            }
+            for ( int c = 0; c < channels; c++ ){
+                out[ f * channels + c ] = in[ f * channels + c ] * g;
+            }
+            if ( exp ){
+                g *= step;
+            }
+        }
+    }
+
+    // W lanes of T
+    template <typename T, int W> struct Vec {
+        typedef T type __attribute__((vector_size( W * sizeof(T) )));
+    };
+
+    // a frame at least W wide - its gain broadcast over every lane
+    template <int W>
+    inline __attribute__((always_inline)) 
+    void _rampWide( const float *in, float *out, size_t frames, int channels, float g0, float step, bool exp )
+    {
+        typedef typename Vec<float, W>::type V;
+
+        float g = g0;
+
+        for ( size_t f = 0; f < frames; f++, in += channels, out += channels ){
+            if ( !exp ){
+                g = g0 + step * f;
+            }
+
+            int c = 0;
+            for ( ; c + W <= channels; c += W ){
+                V x;
+                memcpy( &x, in + c, sizeof(V) );
+                x *= g;
+                memcpy( out + c, &x, sizeof(V) );
+            }
+            for ( ; c < channels; c++ ){
+                out[c] = in[c] * g;
+            }
+
+            if ( exp ){
+                g *= step;
+            }
+        }
+    }
+
+    /***
+     * Interleaved frames narrower than W. Lanes line up with frames
+     * again every lcm( W, channels ) samples, a period: per vector of
+     * one, the frame offset of each lane, as gain relative to the
+     * period's first frame. Linear periods start at g0 + f * step.
+    */
+    template <int W>
+    inline __attribute__((always_inline)) 
+    void _rampVector( const float *in, float *out, size_t frames, int channels, float g0, float step, bool exp )
+    {
+        typedef typename Vec<float, W>::type V;
+
+        if ( channels >= W ){
+            _rampWide<W>( in, out, frames, channels, g0, step, exp );
+            return;
+        }
+
+        int common = W, r = channels;
+        while ( r != 0 ){
+            const int t = common % r;
+            common = r;
+            r = t;
+        }
+
+        // channels < W, so at most W - 1 vectors and W frames
+        const int vectors = channels / common;
+        const int period = vectors * W;
+        const int period_frames = period / channels;
+
+        float per_frame[W + 1];
+        per_frame[0] = exp ? 1 : 0;
+        for ( int f = 1; f <= period_frames; f++ ){
+            per_frame[f] = exp ? per_frame[f - 1] * step : step * f;
+        }
+        const float period_step = per_frame[period_frames];
+
+        V rel[W];
+        for ( int j = 0; j < vectors; j++ ){
+            for ( int k = 0; k < W; k++ ){
+                rel[j][k] = per_frame[( j * W + k ) / channels];
+            }
+        }
+
+        const size_t n = frames * channels;
+        size_t i = 0;
+        size_t f = 0;
+        float base = g0;
+
+        for ( ; i + period <= n; i += period, f += period_frames ){
+
+            if ( !exp ){
+                base = g0 + step * f;
+            }
+
+            for ( int j = 0; j < vectors; j++ ){
+                V x;
+                memcpy( &x, in + i + j * W, sizeof(V) );
+                x *= exp ? rel[j] * base : rel[j] + base;
+                memcpy( out + i + j * W, &x, sizeof(V) );
+            }
+
+            if ( exp ){
+                base *= period_step;
+            }
+        }
+
+        // leftover frames, from the gain of the first one
+        _rampScalar( in + i, out + i, frames - f, channels, exp ? base : g0 + step * f, step, exp );
+    }
+
+    void _reduceScalar( const float *in, size_t n, float *mn, float *mx, double *sum_sq )
+    {
+        for ( size_t i = 0; i < n; i++ ){
+            *mn = std::min( *mn, in[i] );
+            *mx = std::max( *mx, in[i] );
+            *sum_sq += (double)in[i] * in[i];
+        }
+    }
+
+    /***
+     * Lane-wise min / max / sum of squares, folded across lanes at
+     * the end. Squares accumulate in float per pass of
+     * REDUCE_FLUSH vectors and are flushed to double, so long
+     * buffers do not lose precision.
+    */
+    template <int W>
+    inline __attribute__((always_inline))
+    void _reduceVector( const float *in, size_t n, float *mn, float *mx, double *sum_sq )
+    {
+        typedef typename Vec<float, W>::type V;
+
+        const size_t REDUCE_FLUSH = 1024;
+
+        V vmin, vmax;
+        for ( int k = 0; k < W; k++ ){
+            vmin[k] = *mn;
+            vmax[k] = *mx;
+        }
+
+        size_t i = 0;
+        double total = 0;
+
+        while ( i + W <= n ){
+
+            V vsq = vmin - vmin;
+            size_t stop = std::min( n - (n - i) % W, i + REDUCE_FLUSH * W );
+
+            for ( ; i < stop; i += W ){
+                V x;
+                memcpy( &x, in + i, sizeof(V) );
+                vmin = x < vmin ? x : vmin;
+                vmax = x > vmax ? x : vmax;
+                vsq += x * x;
+            }
+
+            for ( int k = 0; k < W; k++ ){
+                total += vsq[k];
+            }
+        }
+
+        for ( int k = 0; k < W; k++ ){
+            *mn = std::min( *mn, vmin[k] );
+            *mx = std::max( *mx, vmax[k] );
+        }
+
+        *sum_sq += total;
+        _reduceScalar( in + i, n - i, mn, mx, sum_sq );
+    }
+
+    // host order is little endian on every target we build for
+    inline uint16_t _load16( const uint8_t *p, bool be )
+    {
+        return be ? ( p[0] << 8 ) | p[1] : p[0] | ( p[1] << 8 );
+    }
+
+    inline uint32_t _load32( const uint8_t *p, bool be )
+    {
+        return be 
+            ? ( (uint32_t)p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3]
+            : p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+    }
+
+    void _convertScalar( const void *in, float *out, size_t n, Dsp::PcmFormat format )
+    {
+        const uint8_t *p = (const uint8_t*)in;
+
+        switch ( format ){
+            case Dsp::PCM_U8:
+                for ( size_t i = 0; i < n; i++ ) out[i] = ( p[i] - 128 ) * ( 1.0f / 128 );
+                break;
+            case Dsp::PCM_S8:
+                for ( size_t i = 0; i < n; i++ ) out[i] = (int8_t)p[i] * ( 1.0f / 128 );
+                break;
+            case Dsp::PCM_S16_LE:
+            case Dsp::PCM_S16_BE:
+                for ( size_t i = 0; i < n; i++ ){
+                    out[i] = (int16_t)_load16( p + 2 * i, format == Dsp::PCM_S16_BE ) * ( 1.0f / 32768 );
+                }
+                break;
+            case Dsp::PCM_S24_LE:
+                for ( size_t i = 0; i < n; i++, p += 3 ){
+                    int32_t v = (int32_t)( ( (uint32_t)p[2] << 24 ) | ( p[1] << 16 ) | ( p[0] << 8 ) ) >> 8;
+                    out[i] = v * ( 1.0f / 8388608 );
+                }
+                break;
+            case Dsp::PCM_S24_BE:
+                for ( size_t i = 0; i < n; i++, p += 3 ){
+                    int32_t v = (int32_t)( ( (uint32_t)p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) ) >> 8;
+                    out[i] = v * ( 1.0f / 8388608 );
+                }
+                break;
+            case Dsp::PCM_S32_LE:
+            case Dsp::PCM_S32_BE:
+                for ( size_t i = 0; i < n; i++ ){
+                    out[i] = (int32_t)_load32( p + 4 * i, format == Dsp::PCM_S32_BE ) * ( 1.0f / 2147483648.0f );
+                }
+                break;
+            case Dsp::PCM_F32_LE:
+            case Dsp::PCM_F32_BE:
+                for ( size_t i = 0; i < n; i++ ){
+                    uint32_t v = _load32( p + 4 * i, format == Dsp::PCM_F32_BE );
+                    memcpy( out + i, &v, sizeof(float) );
+                }
+                break;
+        }
+    }
+
+    /***
+     * W samples per step: load as unsigned lanes, swap bytes with
+     * shifts if the file is big endian, then reinterpret (float) or
+     * widen and scale (integers). Whatever does not fill a vector
+     * goes through the scalar path.
+    */
+    template <int W>
+    inline __attribute__((always_inline))
+    void _convertVector( const void *in, float *out, size_t n, Dsp::PcmFormat format )
+    {
+        typedef typename Vec<float, W>::type VF;
+        typedef typename Vec<int32_t, W>::type VI32;
+        typedef typename Vec<uint32_t, W>::type VU32;
+        typedef typename Vec<int16_t, W>::type VI16;
+        typedef typename Vec<uint16_t, W>::type VU16;
+
+        const uint8_t *p = (const uint8_t*)in;
+        size_t i = 0;
+
+        switch ( format ){
+            case Dsp::PCM_S16_LE:
+            case Dsp::PCM_S16_BE: {
+                const bool be = format == Dsp::PCM_S16_BE;
+                for ( ; i + W <= n; i += W ){
+                    VU16 x;
+                    memcpy( &x, p + 2 * i, sizeof(VU16) );
+                    if ( be ) x = ( x << 8 ) | ( x >> 8 );
+                    VF f = __builtin_convertvector( (VI16)x, VF ) * ( 1.0f / 32768 );
+                    memcpy( out + i, &f, sizeof(VF) );
+                }
+                _convertScalar( p + 2 * i, out + i, n - i, format );
+                break;
+            }
+            case Dsp::PCM_S32_LE:
+            case Dsp::PCM_S32_BE:
+            case Dsp::PCM_F32_LE:
+            case Dsp::PCM_F32_BE: {
+                const bool be = format == Dsp::PCM_S32_BE || format == Dsp::PCM_F32_BE;
+                const bool fl = format == Dsp::PCM_F32_LE || format == Dsp::PCM_F32_BE;
+                for ( ; i + W <= n; i += W ){
+                    VU32 x;
+                    memcpy( &x, p + 4 * i, sizeof(VU32) );
+                    if ( be ){
+                        x = ( x >> 24 ) | ( ( x >> 8 ) & 0xff00 ) | ( ( x << 8 ) & 0xff0000 ) | ( x << 24 );
+                    }
+                    VF f = fl 
+                        ? (VF)x 
+                        : __builtin_convertvector( (VI32)x, VF ) * ( 1.0f / 2147483648.0f );
+                    memcpy( out + i, &f, sizeof(VF) );
+                }
+                _convertScalar( p + 4 * i, out + i, n - i, format );
+                break;
+            }
+            default:
+                _convertScalar( in, out, n, format );
+        }
+    }
+
+    /***
+     * Coefficients are interpolated once per W taps and shared by up
+     * to POLY_GROUP channels, one accumulator each - the lanes are
+     * folded once, at the end.
+    */
+    template <int W>
+    inline __attribute__((always_inline))
+    void _polyphaseVector( const float *row0, const float *row1, float t, const float *const *in, int channels, size_t taps, float *out )
+    {
+        typedef typename Vec<float, W>::type V;
+
+        const int POLY_GROUP = 8;
+
+        for ( int c0 = 0; c0 < channels; c0 += POLY_GROUP ){
+
+            const int group = std::min( POLY_GROUP, channels - c0 );
+            V acc[POLY_GROUP];
+            memset( acc, 0, sizeof(acc) );
+
+            for ( size_t i = 0; i < taps; i += W ){
+                V r0, r1;
+                memcpy( &r0, row0 + i, sizeof(V) );
+                memcpy( &r1, row1 + i, sizeof(V) );
+                const V h = r0 + ( r1 - r0 ) * t;
+
+                for ( int c = 0; c < group; c++ ){
+                    V x;
+                    memcpy( &x, in[c0 + c] + i, sizeof(V) );
+                    acc[c] += h * x;
+                }
+            }
+
+            for ( int c = 0; c < group; c++ ){
+                float sum = 0;
+                for ( int k = 0; k < W; k++ ){
+                    sum += acc[c][k];
+                }
+                out[c0 + c] = sum;
+            }
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+
+    __attribute__((target("avx512f")))
+    void _polyphaseAvx512( const float *row0, const float *row1, float t, const float *const *in, int channels, size_t taps, float *out )
+    {
+        _polyphaseVector<16>( row0, row1, t, in, channels, taps, out );
+    }
+
+    __attribute__((target("avx2")))
+    void _polyphaseAvx2( const float *row0, const float *row1, float t, const float *const *in, int channels, size_t taps, float *out )
+    {
+        _polyphaseVector<8>( row0, row1, t, in, channels, taps, out );
+    }
+
+    __attribute__((target("avx512f")))
+    void _reduceAvx512( const float *in, size_t n, float *mn, float *mx, double *sum_sq )
+    {
+        _reduceVector<16>( in, n, mn, mx, sum_sq );
+    }
+
+    __attribute__((target("avx2")))
+    void _reduceAvx2( const float *in, size_t n, float *mn, float *mx, double *sum_sq )
+    {
+        _reduceVector<8>( in, n, mn, mx, sum_sq );
+    }
+
+    __attribute__((target("avx512f")))
+    void _convertAvx512( const void *in, float *out, size_t n, Dsp::PcmFormat format )
+    {
+        _convertVector<16>( in, out, n, format );
+    }
+
+    __attribute__((target("avx2")))
+    void _convertAvx2( const void *in, float *out, size_t n, Dsp::PcmFormat format )
+    {
+        _convertVector<8>( in, out, n, format );
+    }
+
+    __attribute__((target("avx512f")))
+    void _rampAvx512( const float *in, float *out, size_t frames, int channels, float g, float step, bool exp )
+    {
+        _rampVector<16>( in, out, frames, channels, g, step, exp );
+    }
+
+    __attribute__((target("avx2")))
+    void _rampAvx2( const float *in, float *out, size_t frames, int channels, float g, float step, bool exp )
+    {
+        _rampVector<8>( in, out, frames, channels, g, step, exp );
+    }
+
+#endif
+
+    // SSE2 is baseline on x86_64, NEON on arm64
+    void _ramp128( const float *in, float *out, size_t frames, int channels, float g, float step, bool exp )
+    {
+        _rampVector<4>( in, out, frames, channels, g, step, exp );
+    }
+
+    void _reduce128( const float *in, size_t n, float *mn, float *mx, double *sum_sq )
+    {
+        _reduceVector<4>( in, n, mn, mx, sum_sq );
+    }
+
+    void _convert128( const void *in, float *out, size_t n, Dsp::PcmFormat format )
+    {
+        _convertVector<4>( in, out, n, format );
+    }
+
+    void _polyphase128( const float *row0, const float *row1, float t, const float *const *in, int channels, size_t taps, float *out )
+    {
+        _polyphaseVector<4>( row0, row1, t, in, channels, taps, out );
+    }
+
+    struct Dispatch {
+        RampFn ramp;
+        ReduceFn reduce;
+        ConvertFn convert;
+        PolyphaseFn polyphase;
+        const char *name;
+
+        Dispatch():ramp(_ramp128), reduce(_reduce128), convert(_convert128), polyphase(_polyphase128), name("128 bit")
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_cpu_init();
+            if ( __builtin_cpu_supports("avx512f") ){
+                ramp = _rampAvx512;
+                reduce = _reduceAvx512;
+                convert = _convertAvx512;
+                polyphase = _polyphaseAvx512;
+                name = "AVX-512";
+            } else if ( __builtin_cpu_supports("avx2") ){
+                ramp = _rampAvx2;
+                reduce = _reduceAvx2;
+                convert = _convertAvx2;
+                polyphase = _polyphaseAvx2;
+                name = "AVX2";
+            } else {
+                name = "SSE2";
+            }
+#elif defined(__aarch64__)
+            name = "NEON";
+#endif
+        }
+    };
+
+    const Dispatch &_dispatch()
+    {
+        static const Dispatch d;
+        return d;
+    }
+
+    // pick up the dispatch before the first callback needs it
+    const Dispatch &_dispatch_at_startup = _dispatch();
+}
+
+void Dsp::gainRamp(
+    const float *in,
+    float *out,
+    size_t frames,
+    int channels,
+    float g0,
+    float g1,
+    RampShape shape )
+{
+    if ( frames == 0 ){
+        return;
+    }
+
+    if ( g0 < GAIN_SILENCE ) g0 = 0;
+    if ( g1 < GAIN_SILENCE ) g1 = 0;
+
+    bool exp = shape == RAMP_EXPONENTIAL 
+        && g0 >= EXP_RAMP_FLOOR 
+        && g1 >= EXP_RAMP_FLOOR;
+
+    float step = exp 
+        ? powf( g1 / g0, 1.0f / frames )
+        : ( g1 - g0 ) / frames;
+
+    _dispatch().ramp( in, out, frames, channels, g0, step, exp );
+}
+
+void Dsp::minMaxSumSq(
+    const float *in,
+    size_t n,
+    float *min_out,
+    float *max_out,
+    double *sum_sq_out )
+{
+    _dispatch().reduce( in, n, min_out, max_out, sum_sq_out );
+}
+
+int Dsp::pcmSampleBytes( PcmFormat format )
+{
+    switch ( format ){
+        case PCM_U8:
+        case PCM_S8:
+            return 1;
+        case PCM_S16_LE:
+        case PCM_S16_BE:
+            return 2;
+        case PCM_S24_LE:
+        case PCM_S24_BE:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+void Dsp::pcmToFloat(
+    const void *in,
+    float *out,
+    size_t n,
+    PcmFormat format )
+{
+    _dispatch().convert( in, out, n, format );
+}
+
+void Dsp::polyphaseFrame(
+    const float *row0,
+    const float *row1,
+    float t,
+    const float *const *in,
+    int channels,
+    size_t taps,
+    float *out )
+{
+    _dispatch().polyphase( row0, row1, t, in, channels, taps, out );
+}
+
+float Dsp::rampValue( float from, float to, float t, RampShape shape )
+{
+    if ( shape == RAMP_EXPONENTIAL && from >= EXP_RAMP_FLOOR && to >= EXP_RAMP_FLOOR ){
+        return from * powf( to / from, t );
+    }
+    return from + ( to - from ) * t;
+}
+
+void Dsp::disableDenormals()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    // FTZ (bit 15) + DAZ (bit 6)
+    _mm_setcsr( _mm_getcsr() | 0x8040 );
+#elif defined(__aarch64__)
+    uint64_t fpcr;
+    __asm__ __volatile__( "mrs %0, fpcr" : "=r"(fpcr) );
+    __asm__ __volatile__( "msr fpcr, %0" :: "r"(fpcr | (1 << 24)) );
+#endif
+}
+
+const char *Dsp::isaName()
+{
+    return _dispatch().name;
+}
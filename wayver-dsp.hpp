@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Wayver {
+
+    namespace Dsp {
+
+        enum RampShape {
+            RAMP_LINEAR,
+            RAMP_EXPONENTIAL
+        };
+
+        // sample encodings the PCM fast path converts from
+        enum PcmFormat {
+            PCM_U8,
+            PCM_S8,
+            PCM_S16_LE,
+            PCM_S16_BE,
+            PCM_S24_LE,
+            PCM_S24_BE,
+            PCM_S32_LE,
+            PCM_S32_BE,
+            PCM_F32_LE,
+            PCM_F32_BE
+        };
+
+        // bytes one sample of `format` takes
+        int pcmSampleBytes( PcmFormat format );
+
+        /***
+         * out = in * gain, interleaved frames, one pass.
+         * Gain starts at g0 on the first frame and would reach g1 on
+         * frame `frames` - so consecutive calls chain without a step.
+         * 
+         * Picks SSE2 / AVX2 / AVX-512 at startup (NEON on arm64),
+         * for any channel count.
+        */
+        void gainRamp(
+            const float *in,
+            float *out,
+            size_t frames,
+            int channels,
+            float g0,
+            float g1,
+            RampShape shape = RAMP_LINEAR
+        );
+
+        /***
+         * min, max and sum of squares over n samples - channel layout
+         * does not matter. Same dispatch as gainRamp().
+        */
+        void minMaxSumSq(
+            const float *in,
+            size_t n,
+            float *min_out,
+            float *max_out,
+            double *sum_sq_out
+        );
+
+        /***
+         * n samples of `format` to float in [-1, 1). Integers scale
+         * by 2^-(bits-1), so full scale negative lands exactly on -1.
+         * 16 / 32 bit and float go through the gainRamp() dispatch,
+         * byte order swapped in-register; 8 and 24 bit stay scalar.
+        */
+        void pcmToFloat(
+            const void *in,
+            float *out,
+            size_t n,
+            PcmFormat format
+        );
+
+        /***
+         * One output frame of a polyphase filter. The coefficients are
+         * t of the way from row0 to row1, two adjacent phases; in[c]
+         * points at channel c's first tap, planar. taps is a multiple
+         * of 16 - rows are zero padded, and whatever the padding lines
+         * up with must be finite. out is one interleaved frame.
+         * Same dispatch as gainRamp().
+        */
+        void polyphaseFrame(
+            const float *row0,
+            const float *row1,
+            float t,
+            const float *const *in,
+            int channels,
+            size_t taps,
+            float *out
+        );
+
+        // value a ramp from -> to has reached at t in [0,1]
+        float rampValue( float from, float to, float t, RampShape shape );
+
+        // flush-to-zero / denormals-are-zero for the calling thread
+        void disableDenormals();
+
+        // name of the kernel gainRamp() dispatches to
+        const char *isaName();
+    }
+}
@@ -0,0 +1,69 @@
+#include <wayver-fft.hpp>
+#include <wayver-defines.hpp>
+
+#include <map>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+using namespace Wayver;
+
+namespace {
+
+    boost::mutex _planner_mutex;
+    bool _wisdom_loaded = false;
+
+    std::map<int, fftwf_plan> _r2c_plans;
+    std::map<int, fftwf_plan> _c2r_plans;
+
+    fftwf_plan _plan( int n, bool forward )
+    {
+        boost::lock_guard<boost::mutex> lock( _planner_mutex );
+
+        std::map<int, fftwf_plan> &cache = forward ? _r2c_plans : _c2r_plans;
+        auto it = cache.find( n );
+        if ( it != cache.end() ){
+            return it->second;
+        }
+
+        if ( !_wisdom_loaded ){
+            fftwf_import_wisdom_from_filename( FFTW_WISDOM_FILE );
+            _wisdom_loaded = true;
+        }
+
+        float *real = fftwf_alloc_real( n );
+        fftwf_complex *cplx = fftwf_alloc_complex( n / 2 + 1 );
+
+        fftwf_plan p = forward
+            ? fftwf_plan_dft_r2c_1d( n, real, cplx, FFTW_MEASURE )
+            : fftwf_plan_dft_c2r_1d( n, cplx, real, FFTW_MEASURE );
+
+        fftwf_free( real );
+        fftwf_free( cplx );
+
+        cache[n] = p;
+        fftwf_export_wisdom_to_filename( FFTW_WISDOM_FILE );
+
+        return p;
+    }
+}
+
+fftwf_plan Fft::planR2C( int n )
+{
+    return _plan( n, true );
+}
+
+fftwf_plan Fft::planC2R( int n )
+{
+    return _plan( n, false );
+}
+
+void Fft::releasePlans()
+{
+    boost::lock_guard<boost::mutex> lock( _planner_mutex );
+
+    for ( auto &p : _r2c_plans ) fftwf_destroy_plan( p.second );
+    for ( auto &p : _c2r_plans ) fftwf_destroy_plan( p.second );
+
+    _r2c_plans.clear();
+    _c2r_plans.clear();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <fftw3.h>
+
+namespace Wayver {
+
+    namespace Fft {
+
+        /***
+         * Process-wide FFTW plan cache.
+         * 
+         *      - Plans are made once per size, with FFTW_MEASURE, on
+         *      scratch buffers - run them with the new-array execute
+         *      functions on fftwf_malloc'ed buffers
+         *      - Wisdom is read from FFTW_WISDOM_FILE before the first
+         *      plan and written back whenever a new one is made, so 
+         *      measuring only ever happens on the first run
+         *      - Thread safe (the FFTW planner is not)
+        */
+        fftwf_plan planR2C( int n );
+        fftwf_plan planC2R( int n );
+
+        // destroys every cached plan - call once at exit
+        void releasePlans();
+    }
+}
@@ -0,0 +1,113 @@
+#include <wayver-glyphs.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace Wayver::UI;
+
+GlyphAtlas::GlyphAtlas( SDL_Renderer *r, TTF_Font *font )
+:_renderer(r)
+{
+    const SDL_Color white = { 255, 255, 255, 255 };
+    SDL_Surface *glyphs[_COUNT];
+
+    _height = TTF_FontHeight( font );
+
+    /* rasterise, then shelf-pack left to right, wrapping at _PAGE_WIDTH */
+    int x = 0, y = 0, row_h = 0;
+
+    for ( int i = 0; i < _COUNT; i++ ){
+        const Uint16 ch = _FIRST + i;
+
+        glyphs[i] = TTF_RenderGlyph_Blended( font, ch, white );
+        if ( glyphs[i] == NULL ){
+            throw std::runtime_error( std::string("GlyphAtlas: ") + SDL_GetError() );
+        }
+
+        int min_x, max_x, min_y, max_y;
+        TTF_GlyphMetrics( font, ch, &min_x, &max_x, &min_y, &max_y, &_advance[i] );
+
+        if ( x + glyphs[i]->w > _PAGE_WIDTH ){
+            x = 0;
+            y += row_h + 1;
+            row_h = 0;
+        }
+
+        _cells[i] = { x, y, glyphs[i]->w, glyphs[i]->h };
+        x += glyphs[i]->w + 1;
+        row_h = std::max( row_h, glyphs[i]->h );
+    }
+
+    _page_w = _PAGE_WIDTH;
+    _page_h = y + row_h;
+
+    // fresh surfaces are zeroed - transparent between the glyphs
+    SDL_Surface *page = SDL_CreateRGBSurfaceWithFormat( 0, _page_w, _page_h, 32, SDL_PIXELFORMAT_RGBA32 );
+
+    for ( int i = 0; i < _COUNT; i++ ){
+        // copy the glyph's alpha as is, not blended onto nothing
+        SDL_SetSurfaceBlendMode( glyphs[i], SDL_BLENDMODE_NONE );
+        SDL_BlitSurface( glyphs[i], NULL, page, &_cells[i] );
+        SDL_FreeSurface( glyphs[i] );
+    }
+
+    _page = SDL_CreateTextureFromSurface( _renderer, page );
+    SDL_FreeSurface( page );
+
+    if ( _page == NULL ){
+        throw std::runtime_error( std::string("GlyphAtlas: ") + SDL_GetError() );
+    }
+
+    SDL_SetTextureBlendMode( _page, SDL_BLENDMODE_BLEND );
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    SDL_DestroyTexture( _page );
+}
+
+/*static*/ int GlyphAtlas::_slot( char c )
+{
+    return ( c < _FIRST || c > _LAST ) ? '?' - _FIRST : c - _FIRST;
+}
+
+int GlyphAtlas::width( const char *text ) const
+{
+    int w = 0;
+    for ( const char *c = text; *c != '\0'; c++ ){
+        w += _advance[ _slot( *c ) ];
+    }
+    return w;
+}
+
+void GlyphAtlas::draw( const char *text, float x, float y, SDL_Color color )
+{
+    _vertices.clear();
+
+    const float u = 1.0f / _page_w;
+    const float v = 1.0f / _page_h;
+
+    for ( const char *c = text; *c != '\0'; c++ ){
+        const int i = _slot( *c );
+        const SDL_Rect &cell = _cells[i];
+
+        const float x1 = x + cell.w, y1 = y + cell.h;
+        const float s0 = cell.x * u, t0 = cell.y * v;
+        const float s1 = ( cell.x + cell.w ) * u, t1 = ( cell.y + cell.h ) * v;
+
+        // two triangles per glyph, no index buffer
+        _vertices.push_back( { { x,  y  }, color, { s0, t0 } } );
+        _vertices.push_back( { { x1, y  }, color, { s1, t0 } } );
+        _vertices.push_back( { { x,  y1 }, color, { s0, t1 } } );
+        _vertices.push_back( { { x1, y  }, color, { s1, t0 } } );
+        _vertices.push_back( { { x1, y1 }, color, { s1, t1 } } );
+        _vertices.push_back( { { x,  y1 }, color, { s0, t1 } } );
+
+        x += _advance[i];
+    }
+
+    if ( !_vertices.empty() ){
+        SDL_RenderGeometry( _renderer, _page, _vertices.data(), _vertices.size(), NULL, 0 );
+    }
+}
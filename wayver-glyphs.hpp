@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+namespace Wayver {
+
+    namespace UI {
+
+        /***
+         * One font at one size, rasterised once.
+         *
+         *      - Every printable ASCII glyph is rendered white into a
+         *      single texture page when the atlas is built
+         *      - draw() lays a string out as textured quads, coloured
+         *      per vertex, and hands them over in one SDL_RenderGeometry
+         *      - Per frame no surfaces, no uploads; the vertex buffer
+         *      only grows on the longest string seen so far
+        */
+        class GlyphAtlas {
+
+            static const char _FIRST = ' ';
+            static const char _LAST = '~';
+            static const int _COUNT = _LAST - _FIRST + 1;
+            static const int _PAGE_WIDTH = 1024;
+
+            SDL_Renderer *_renderer;
+            SDL_Texture *_page = NULL;
+            int _page_w = 0;
+            int _page_h = 0;
+
+            // where each glyph sits on the page, and how far it moves the pen
+            SDL_Rect _cells[_COUNT];
+            int _advance[_COUNT];
+            int _height = 0;
+
+            std::vector<SDL_Vertex> _vertices;
+
+            // anything outside the page draws as '?'
+            static int _slot( char c );
+
+            public:
+                GlyphAtlas( SDL_Renderer *r, TTF_Font *font );
+                ~GlyphAtlas();
+
+                int height() const { return _height; }
+                int width( const char *text ) const;
+
+                // top left of the text at x, y
+                void draw( const char *text, float x, float y, SDL_Color color );
+        };
+    }
+}
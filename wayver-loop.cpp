@@ -0,0 +1,232 @@
+#include <wayver-loop.hpp>
+#include <wayver-source.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+#include <stdexcept>
+
+using namespace Wayver::Audio;
+
+namespace {
+
+    // reads until frames are in or the file runs out, returns how many came
+    int64_t _readFully( Source *source, float *out, int64_t frames )
+    {
+        const int channels = source->info().channels;
+        int64_t got = 0;
+
+        while ( got < frames ){
+            const int64_t n = source->readFrames( out + got * channels, frames - got );
+            if ( n == 0 ){
+                break;
+            }
+            got += n;
+        }
+        return got;
+    }
+}
+
+/***
+ * A region short enough to sit in memory whole is read in one go,
+ * tail included. Past the end of the file, the tail stays silent.
+*/
+LoopRegion::LoopRegion(
+    const std::string &path,
+    int64_t a,
+    int64_t b,
+    int samplerate,
+    std::shared_ptr<spdlog::logger> logger )
+:_a(a),
+_b(b)
+{
+    std::unique_ptr<Source> source( openSource( path, logger, samplerate ) );
+    const SF_INFO &info = source->info();
+
+    if ( a < 0 || b <= a || b > info.frames ){
+        throw std::runtime_error("Loop " + std::to_string( a ) + " -> " + std::to_string( b ) + " is not inside " + path);
+    }
+
+    _channels = info.channels;
+    _xfade_frames = std::max<int64_t>( 1, (int64_t)info.samplerate * LOOP_XFADE_MS / 1000 );
+
+    const int64_t length = b - a;
+    const int64_t preload = (int64_t)info.samplerate * LOOP_PRELOAD_SECONDS;
+
+    _head_frames = std::min( length, preload );
+    _xfade_frames = std::min( _xfade_frames, _head_frames );
+
+    _head.resize( _head_frames * _channels );
+    _tail.assign( _xfade_frames * _channels, 0 );
+
+    if ( !source->seek( a ) ){
+        throw std::runtime_error("Could not seek " + path + " to " + std::to_string( a ));
+    }
+
+    if ( whole() ){
+        std::vector<float> all( ( length + _xfade_frames ) * _channels, 0 );
+        const int64_t got = _readFully( source.get(), all.data(), length + _xfade_frames );
+
+        if ( got < length ){
+            throw std::runtime_error("Could not read the loop out of " + path);
+        }
+
+        memcpy( _head.data(), all.data(), sizeof(float) * _head.size() );
+        memcpy( _tail.data(), all.data() + _head.size(), sizeof(float) * _tail.size() );
+    } else {
+        if ( _readFully( source.get(), _head.data(), _head_frames ) < _head_frames ){
+            throw std::runtime_error("Could not read the loop out of " + path);
+        }
+
+        if ( source->seek( b ) ){
+            _readFully( source.get(), _tail.data(), _xfade_frames );
+        }
+    }
+
+    _fade.resize( _xfade_frames );
+    for ( int64_t i = 0; i < _xfade_frames; i++ ){
+        _fade[i] = sinf( (float)M_PI / 2 * ( i + 0.5f ) / _xfade_frames );
+    }
+
+    logger->debug("LoopRegion - {} -> {}, {} frames in memory", a, b, _head_frames);
+}
+
+int64_t LoopRegion::read( int64_t offset, float *out, int64_t frames ) const
+{
+    const int64_t n = std::max<int64_t>( 0, std::min( frames, _head_frames - offset ) );
+    const int64_t faded = std::max<int64_t>( 0, std::min( n, _xfade_frames - offset ) );
+
+    const float *head = _head.data() + offset * _channels;
+    const float *tail = _tail.data() + offset * _channels;
+
+    for ( int64_t i = 0; i < faded; i++ ){
+        const float in = _fade[offset + i];
+        const float gone = _fade[_xfade_frames - 1 - offset - i];
+
+        for ( int c = 0; c < _channels; c++ ){
+            out[i * _channels + c] = in * head[i * _channels + c] + gone * tail[i * _channels + c];
+        }
+    }
+
+    memcpy( out + faded * _channels, head + faded * _channels, sizeof(float) * ( n - faded ) * _channels );
+
+    return n;
+}
+
+
+/***
+ * LOOP BUILDER
+*/
+LoopBuilder::LoopBuilder( std::shared_ptr<spdlog::logger> logger )
+:_logger(logger)
+{}
+
+LoopBuilder::~LoopBuilder()
+{
+    {
+        boost::lock_guard<boost::mutex> lock( _park_mutex );
+        _running = false;
+    }
+    _park_cond.notify_one();
+
+    if ( _thread.joinable() ){
+        _thread.join();
+    }
+
+    delete _built;
+}
+
+void LoopBuilder::request(
+    const std::string &path,
+    int64_t a,
+    int64_t b,
+    int samplerate,
+    uint32_t load,
+    int track,
+    Bus::Wakeup *done )
+{
+    {
+        boost::lock_guard<boost::mutex> lock( _park_mutex );
+
+        _generation++;
+        _requested = true;
+        _request = Request{ path, a, b, samplerate, load, track };
+        _done = done;
+
+        if ( !_thread.joinable() ){
+            _thread = boost::thread( &LoopBuilder::_loop, this );
+        }
+    }
+    _park_cond.notify_one();
+}
+
+void LoopBuilder::cancel()
+{
+    boost::lock_guard<boost::mutex> lock( _park_mutex );
+    _generation++;
+    _requested = false;
+}
+
+LoopRegion *LoopBuilder::take()
+{
+    boost::lock_guard<boost::mutex> lock( _park_mutex );
+
+    LoopRegion *built = _built;
+    _built = NULL;
+
+    // finished after a newer request or a cancel
+    if ( built != NULL && _built_generation != _generation ){
+        delete built;
+        built = NULL;
+    }
+    return built;
+}
+
+void LoopBuilder::_loop()
+{
+    while ( true ){
+
+        Request request;
+        uint64_t generation;
+        {
+            boost::unique_lock<boost::mutex> lock( _park_mutex );
+            while ( _running && !_requested ){
+                _park_cond.wait( lock );
+            }
+            if ( !_running ){
+                return;
+            }
+
+            request = _request;
+            generation = _generation;
+            _requested = false;
+        }
+
+        LoopRegion *region = NULL;
+        try {
+            region = new LoopRegion( request.path, request.a, request.b, request.samplerate, _logger );
+            region->load = request.load;
+            region->track = request.track;
+        } catch ( const std::runtime_error &e ){
+            _logger->warn("LoopBuilder - {}", e.what());
+        }
+
+        Bus::Wakeup *done = NULL;
+        {
+            boost::lock_guard<boost::mutex> lock( _park_mutex );
+
+            if ( region != NULL && generation == _generation ){
+                delete _built;
+                _built = region;
+                _built_generation = generation;
+                done = _done;
+                region = NULL;
+            }
+        }
+        delete region;
+
+        if ( done != NULL ){
+            done->notify();
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+#include <wayver-bus.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        /***
+         * An A/B loop, decoded ahead so the callback wraps from B
+         * back to A without going near the file.
+         *
+         *      - head: the frames from A on - the whole region, or its
+         *      first LOOP_PRELOAD_SECONDS when it is longer. A long
+         *      loop goes on from the ring, which has the time head
+         *      takes to play to seek to where head stops
+         *      - tail: LOOP_XFADE_MS from B on, faded out under the
+         *      start of head at every wrap, equal power
+         *      - Built off the audio thread, read-only once published
+        */
+        class LoopRegion {
+
+            int64_t _a;
+            int64_t _b;
+            int _channels;
+
+            std::vector<float> _head;
+            int64_t _head_frames = 0;
+
+            std::vector<float> _tail;
+            int64_t _xfade_frames;
+
+            // sin over the crossfade, read backwards it is the cos
+            std::vector<float> _fade;
+
+            public:
+
+                // decodes [a, b) of path at samplerate, see openSource() - throws std::runtime_error
+                LoopRegion(
+                    const std::string &path,
+                    int64_t a,
+                    int64_t b,
+                    int samplerate,
+                    std::shared_ptr<spdlog::logger> logger );
+
+                // which load and playlist entry it is for, see LoadedSource
+                uint32_t load = 0;
+                int track = 0;
+
+                int64_t a() const { return _a; }
+                int64_t b() const { return _b; }
+                int channels() const { return _channels; }
+
+                int64_t headFrames() const { return _head_frames; }
+
+                // head is all of it - the wrap never needs the ring
+                bool whole() const { return _a + _head_frames == _b; }
+
+                /***
+                 * RT safe: head from offset on into out, crossfaded with
+                 * the tail while offset is within the fade. Up to the
+                 * end of head - returns how many frames that was.
+                */
+                int64_t read( int64_t offset, float *out, int64_t frames ) const;
+        };
+
+        /***
+         * Decodes LoopRegions on a thread of its own, so the engine
+         * keeps serving commands while up to LOOP_PRELOAD_SECONDS is read.
+         *
+         *      - One request at a time: a newer one, or cancel(), drops
+         *      whatever was asked before - built or not
+         *      - The thread starts with the first request and parks
+         *      between them
+        */
+        class LoopBuilder {
+
+            struct Request {
+                std::string path;
+                int64_t a;
+                int64_t b;
+                int samplerate;
+                uint32_t load;
+                int track;
+            };
+
+            // bumped by every request and cancel - a build for an older one is dropped
+            uint64_t _generation = 0;
+            bool _requested = false;
+            Request _request;
+
+            LoopRegion *_built = NULL;
+            uint64_t _built_generation = 0;
+            Bus::Wakeup *_done = NULL;
+
+            bool _running = true;
+            boost::mutex _park_mutex;
+            boost::condition_variable _park_cond;
+            boost::thread _thread;
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            void _loop();
+
+            public:
+
+                LoopBuilder( std::shared_ptr<spdlog::logger> logger );
+
+                // waits for a build in progress
+                ~LoopBuilder();
+
+                // [a, b) of path at samplerate, see LoopRegion - done is notified once it is built
+                void request(
+                    const std::string &path,
+                    int64_t a,
+                    int64_t b,
+                    int samplerate,
+                    uint32_t load,
+                    int track,
+                    Bus::Wakeup *done );
+
+                void cancel();
+
+                // the region for the newest request once built, NULL until then - caller owns it
+                LoopRegion *take();
+        };
+    }
+}
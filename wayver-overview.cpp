@@ -0,0 +1,303 @@
+#include <wayver-overview.hpp>
+#include <wayver-dsp.hpp>
+#include <wayver-source.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+using namespace Wayver::Audio;
+
+namespace {
+
+    OverviewBucket _empty()
+    {
+        return { 0, 0, 0 };
+    }
+
+    // OVERVIEW section -> this, then a LevelInfo per level, then the buckets
+    struct SectionHeader {
+        uint32_t level_count;
+        uint32_t reserved;
+    };
+
+    struct LevelInfo {
+        int64_t bucket_frames;
+        uint64_t count;
+    };
+
+    // folds b into `into`, squares go to sum_sq for the caller to average
+    void _merge( OverviewBucket &into, const OverviewBucket &b, double &sum_sq, bool first )
+    {
+        into.min = first ? b.min : std::min( into.min, b.min );
+        into.max = first ? b.max : std::max( into.max, b.max );
+        sum_sq += (double)b.rms * b.rms;
+    }
+}
+
+Overview::Overview( const std::string &path, std::shared_ptr<spdlog::logger> logger )
+:_frames(0),
+_channels(1),
+_logger(logger)
+{
+    try {
+        std::unique_ptr<Source> source( openSource( path, _logger ) );
+        _frames = source->info().frames;
+        _channels = source->info().channels;
+    } catch ( const std::runtime_error &e ){
+        _logger->error("Overview() - {}", e.what());
+    }
+
+    int64_t bucket = OVERVIEW_MIN_BUCKET;
+    while ( _frames / bucket > OVERVIEW_MAX_BUCKETS ){
+        bucket *= 4;
+    }
+
+    do {
+        _bucket_frames.push_back( bucket );
+        _levels.push_back( std::vector<OverviewBucket>( 
+            std::max<int64_t>( 1, ( _frames + bucket - 1 ) / bucket ), _empty() ) );
+        bucket *= 4;
+    } while ( bucket <= OVERVIEW_MAX_BUCKET );
+}
+
+Overview::~Overview()
+{
+    if ( _thread.joinable() ){
+        _thread.join();
+    }
+}
+
+void Overview::buildAsync( const std::string &path )
+{
+    _thread = boost::thread( &Overview::build, this, path );
+}
+
+/***
+ * Split level 0 into one run of buckets per core - slices never
+ * share a bucket, so workers never touch the same memory.
+*/
+void Overview::build( const std::string &path )
+{
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+    const int64_t buckets = _levels[0].size();
+    const int64_t workers = std::max<int64_t>( 1, std::min<int64_t>( boost::thread::hardware_concurrency(), buckets ) );
+
+    boost::thread_group pool;
+
+    for ( int64_t w = 0; w < workers; w++ ){
+        pool.create_thread( boost::bind( 
+            &Overview::_buildSlice, 
+            this, 
+            path, 
+            buckets * w / workers, 
+            buckets * (w + 1) / workers ) );
+    }
+
+    pool.join_all();
+
+    // half an overview is worse than none - it would be cached for good
+    if ( _failed.load() ){
+        _logger->error("Overview - could not read all of {}, not kept", path);
+        _done.store( true, std::memory_order_release );
+        return;
+    }
+
+    _buildCoarserLevels();
+    _measureLoudness();
+    _ready.store( true, std::memory_order_release );
+
+    _store( path );
+    _done.store( true, std::memory_order_release );
+
+    _logger->info(
+        "Overview - {} levels, {} -> {} frames per bucket, {} workers, {} ms",
+        _levels.size(),
+        _bucket_frames.front(),
+        _bucket_frames.back(),
+        workers,
+        boost::chrono::duration_cast<boost::chrono::milliseconds>( 
+            boost::chrono::steady_clock::now() - start ).count() );
+}
+
+void Overview::_buildSlice( const std::string &path, int64_t first_bucket, int64_t last_bucket )
+{
+    std::unique_ptr<Source> source;
+
+    try {
+        source.reset( openSource( path, _logger ) );
+    } catch ( const std::runtime_error &e ){
+        _logger->error("Overview::_buildSlice() - {}", e.what());
+        _failed.store( true );
+        return;
+    }
+
+    const int64_t bucket_frames = _bucket_frames[0];
+
+    // read several buckets per syscall
+    const int64_t buckets_per_read = std::max<int64_t>( 1, OVERVIEW_READ_FRAMES / bucket_frames );
+    std::vector<float> buffer( buckets_per_read * bucket_frames * _channels );
+
+    if ( !source->seek( first_bucket * bucket_frames ) ){
+        _logger->error("Overview::_buildSlice() - could not seek to bucket {}", first_bucket);
+        _failed.store( true );
+        return;
+    }
+
+    for ( int64_t b = first_bucket; b < last_bucket; b += buckets_per_read ){
+
+        const int64_t n_buckets = std::min( buckets_per_read, last_bucket - b );
+        const int64_t got = source->readFrames( buffer.data(), n_buckets * bucket_frames );
+
+        // short of the frames the header promised
+        if ( got <= 0 ){
+            _logger->error("Overview::_buildSlice() - file ended at bucket {} of {}", b, _levels[0].size());
+            _failed.store( true );
+            return;
+        }
+
+        for ( int64_t k = 0; k * bucket_frames < got; k++ ){
+
+            const int64_t frames = std::min<int64_t>( bucket_frames, got - k * bucket_frames );
+            float mn = INFINITY, mx = -INFINITY;
+            double sum_sq = 0;
+
+            Dsp::minMaxSumSq( 
+                buffer.data() + k * bucket_frames * _channels, 
+                frames * _channels, 
+                &mn, &mx, &sum_sq );
+
+            _levels[0][b + k] = { mn, mx, (float)sqrt( sum_sq / ( frames * _channels ) ) };
+        }
+    }
+}
+
+void Overview::_buildCoarserLevels()
+{
+    for ( size_t l = 1; l < _levels.size(); l++ ){
+
+        const std::vector<OverviewBucket> &fine = _levels[l - 1];
+
+        for ( size_t b = 0; b < _levels[l].size(); b++ ){
+
+            OverviewBucket out = _empty();
+            double sum_sq = 0;
+            size_t n = 0;
+
+            for ( size_t k = b * 4; k < std::min( fine.size(), b * 4 + 4 ); k++, n++ ){
+                _merge( out, fine[k], sum_sq, n == 0 );
+            }
+
+            out.rms = n > 0 ? sqrt( sum_sq / n ) : 0;
+            _levels[l][b] = out;
+        }
+    }
+}
+
+void Overview::_measureLoudness()
+{
+    double sum_sq = 0;
+    float peak = 0;
+
+    for ( const OverviewBucket &b : _levels[0] ){
+        peak = std::max( peak, std::max( fabsf( b.min ), fabsf( b.max ) ) );
+        sum_sq += (double)b.rms * b.rms;
+    }
+
+    _loudness = { peak, (float)sqrt( sum_sq / _levels[0].size() ) };
+}
+
+void Overview::_store( const std::string &path )
+{
+    std::vector<uint8_t> bytes( sizeof(SectionHeader) + _levels.size() * sizeof(LevelInfo) );
+
+    SectionHeader *h = (SectionHeader*)bytes.data();
+    h->level_count = _levels.size();
+    h->reserved = 0;
+
+    for ( size_t l = 0; l < _levels.size(); l++ ){
+        LevelInfo info = { _bucket_frames[l], _levels[l].size() };
+        memcpy( bytes.data() + sizeof(SectionHeader) + l * sizeof(LevelInfo), &info, sizeof(info) );
+    }
+
+    for ( const std::vector<OverviewBucket> &level : _levels ){
+        const uint8_t *p = (const uint8_t*)level.data();
+        bytes.insert( bytes.end(), p, p + level.size() * sizeof(OverviewBucket) );
+    }
+
+    if ( !Cache::store( path, Cache::OVERVIEW, bytes.data(), bytes.size() ) 
+        || !Cache::store( path, Cache::LOUDNESS, &_loudness, sizeof(_loudness) ) ){
+        _logger->warn("Overview - could not write the analysis cache for {}", path);
+    }
+}
+
+bool Overview::loadFrom( const Cache::Entry &entry )
+{
+    size_t size, loudness_size;
+    const uint8_t *p = entry.section( Cache::OVERVIEW, &size );
+    const uint8_t *loudness = entry.section( Cache::LOUDNESS, &loudness_size );
+
+    if ( p == NULL || loudness == NULL || loudness_size != sizeof(Cache::Loudness) 
+        || size < sizeof(SectionHeader) ){
+        return false;
+    }
+
+    const SectionHeader *h = (const SectionHeader*)p;
+    const LevelInfo *info = (const LevelInfo*)( p + sizeof(SectionHeader) );
+    size_t offset = sizeof(SectionHeader) + h->level_count * sizeof(LevelInfo);
+
+    // built with other settings -> rebuild
+    if ( h->level_count != _levels.size() || offset > size ){
+        return false;
+    }
+
+    for ( size_t l = 0; l < _levels.size(); l++ ){
+        if ( info[l].bucket_frames != _bucket_frames[l] || info[l].count != _levels[l].size() ){
+            return false;
+        }
+        offset += _levels[l].size() * sizeof(OverviewBucket);
+    }
+
+    if ( offset > size ){
+        return false;
+    }
+
+    offset = sizeof(SectionHeader) + h->level_count * sizeof(LevelInfo);
+    for ( std::vector<OverviewBucket> &level : _levels ){
+        memcpy( level.data(), p + offset, level.size() * sizeof(OverviewBucket) );
+        offset += level.size() * sizeof(OverviewBucket);
+    }
+
+    memcpy( &_loudness, loudness, sizeof(_loudness) );
+    _ready.store( true, std::memory_order_release );
+
+    _logger->debug("Overview - loaded {} levels from the analysis cache", _levels.size());
+    return true;
+}
+
+void Overview::columns( int n, std::vector<OverviewBucket> &out ) const
+{
+    out.assign( n, _empty() );
+
+    // coarsest level that still has a bucket for every column
+    int l = 0;
+    while ( l + 1 < (int)_levels.size() && (int)_levels[l + 1].size() >= n ){
+        l++;
+    }
+
+    const std::vector<OverviewBucket> &src = _levels[l];
+
+    for ( int c = 0; c < n; c++ ){
+
+        size_t from = src.size() * c / n;
+        size_t to = std::max( from + 1, src.size() * (c + 1) / n );
+        double sum_sq = 0;
+
+        for ( size_t k = from; k < std::min( to, src.size() ); k++ ){
+            _merge( out[c], src[k], sum_sq, k == from );
+        }
+
+        out[c].rms = sqrt( sum_sq / (to - from) );
+    }
+}
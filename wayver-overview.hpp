@@ -0,0 +1,97 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+#include <wayver-cache.hpp>
+
+#include <sndfile.hh>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        // envelope of one bucket of frames, all channels together
+        struct OverviewBucket {
+            float min;
+            float max;
+            float rms;
+        };
+
+        /***
+         * Waveform overview as a min / max / RMS mip pyramid.
+         * 
+         *      - Level 0 buckets are OVERVIEW_MIN_BUCKET frames, or coarser
+         *      so there are never more than OVERVIEW_MAX_BUCKETS - memory
+         *      follows screen resolution, not file length
+         *      - Every level above is 4x coarser, up to OVERVIEW_MAX_BUCKET
+         *      - Built on all cores, each with its own Source
+         *      seeked to its slice of the file
+         *      - Persisted, with the file's loudness, in the analysis cache
+         *      - At the file's own rate, whatever it plays at - it is
+         *      drawn by fraction of the track, so it lines up either way
+         *      and the cache holds one pyramid per file
+        */
+        class Overview {
+
+            int64_t _frames;
+            int _channels;
+
+            // frames per bucket, per level
+            std::vector<int64_t> _bucket_frames;
+            std::vector<std::vector<OverviewBucket>> _levels;
+
+            Cache::Loudness _loudness = { 0, 0 };
+
+            std::atomic<bool> _ready{false};
+
+            // a worker could not read its slice - nothing is kept
+            std::atomic<bool> _failed{false};
+
+            // build() returned, ready or not
+            std::atomic<bool> _done{false};
+            boost::thread _thread;
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            void _buildSlice( const std::string &path, int64_t first_bucket, int64_t last_bucket );
+            void _buildCoarserLevels();
+            void _measureLoudness();
+            void _store( const std::string &path );
+
+            public:
+
+                // laid out for the file as it is on disk - empty if it cannot be opened
+                Overview( const std::string &path, std::shared_ptr<spdlog::logger> logger );
+                ~Overview();
+
+                // blocking, stores the result in the cache - never ready if a slice fails
+                void build( const std::string &path );
+
+                // true when the cached pyramid matches this layout - ready at once
+                bool loadFrom( const Cache::Entry &entry );
+
+                // on a background thread, isReady() flips when done
+                void buildAsync( const std::string &path );
+
+                bool isReady() const { return _ready.load( std::memory_order_acquire ); }
+
+                // nothing is working on it any more - safe to delete without waiting
+                bool isDone() const { return _done.load( std::memory_order_acquire ) || isReady(); }
+
+                int levelCount() const { return _levels.size(); }
+                int64_t bucketFrames( int level ) const { return _bucket_frames[level]; }
+                const std::vector<OverviewBucket> &level( int level ) const { return _levels[level]; }
+
+                const Cache::Loudness &loudness() const { return _loudness; }
+
+                // re-bucket into n equal columns, from the cheapest level that has enough detail
+                void columns( int n, std::vector<OverviewBucket> &out ) const;
+        };
+
+    }
+}
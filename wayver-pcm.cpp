@@ -0,0 +1,335 @@
+#include <wayver-pcm.hpp>
+#include <wayver-defines.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Wayver::Audio;
+
+namespace {
+
+    // what the header parsers find
+    struct Layout {
+        Wayver::Dsp::PcmFormat format;
+        int channels = 0;
+        int samplerate = 0;
+        int sf_format = 0;
+        size_t data_offset = 0;
+        size_t data_bytes = 0;
+    };
+
+    uint16_t _le16( const uint8_t *p ) { return p[0] | ( p[1] << 8 ); }
+    uint32_t _le32( const uint8_t *p ) { return _le16( p ) | ( (uint32_t)_le16( p + 2 ) << 16 ); }
+    uint16_t _be16( const uint8_t *p ) { return ( p[0] << 8 ) | p[1]; }
+    uint32_t _be32( const uint8_t *p ) { return ( (uint32_t)_be16( p ) << 16 ) | _be16( p + 2 ); }
+
+    // AIFF sample rates are 80 bit IEEE extended
+    double _extended( const uint8_t *p )
+    {
+        int exponent = ( ( p[0] & 0x7f ) << 8 ) | p[1];
+        uint64_t mantissa = ( (uint64_t)_be32( p + 2 ) << 32 ) | _be32( p + 6 );
+        double v = ldexp( (double)mantissa, exponent - 16383 - 63 );
+        return ( p[0] & 0x80 ) ? -v : v;
+    }
+
+    bool _intFormat( int bits, bool big_endian, bool unsigned_8, Wayver::Dsp::PcmFormat &format, int &sf_sub )
+    {
+        using namespace Wayver::Dsp;
+
+        switch ( bits ){
+            case 8:
+                format = unsigned_8 ? PCM_U8 : PCM_S8;
+                sf_sub = unsigned_8 ? SF_FORMAT_PCM_U8 : SF_FORMAT_PCM_S8;
+                return true;
+            case 16:
+                format = big_endian ? PCM_S16_BE : PCM_S16_LE;
+                sf_sub = SF_FORMAT_PCM_16;
+                return true;
+            case 24:
+                format = big_endian ? PCM_S24_BE : PCM_S24_LE;
+                sf_sub = SF_FORMAT_PCM_24;
+                return true;
+            case 32:
+                format = big_endian ? PCM_S32_BE : PCM_S32_LE;
+                sf_sub = SF_FORMAT_PCM_32;
+                return true;
+        }
+        return false;
+    }
+
+    /***
+     * RIFF / WAVE. Chunks are word aligned; a data chunk
+     * claiming more than the file holds is clipped to the file
+     * (streams that never patched their header).
+    */
+    bool _parseWav( const uint8_t *p, size_t size, Layout &out )
+    {
+        if ( size < 12 || memcmp( p, "RIFF", 4 ) || memcmp( p + 8, "WAVE", 4 ) ){
+            return false;
+        }
+
+        bool have_fmt = false;
+        size_t at = 12;
+
+        while ( at + 8 <= size ){
+
+            const uint8_t *chunk = p + at;
+            const size_t chunk_bytes = _le32( chunk + 4 );
+            const uint8_t *body = chunk + 8;
+
+            if ( !memcmp( chunk, "fmt ", 4 ) && chunk_bytes >= 16 && at + 8 + chunk_bytes <= size ){
+
+                uint16_t tag = _le16( body );
+                const int bits = _le16( body + 14 );
+                const int block_align = _le16( body + 12 );
+
+                // WAVE_FORMAT_EXTENSIBLE - the real tag opens the subformat GUID
+                if ( tag == 0xFFFE && chunk_bytes >= 40 ){
+                    tag = _le16( body + 24 );
+                    out.sf_format = SF_FORMAT_WAVEX;
+                } else {
+                    out.sf_format = SF_FORMAT_WAV;
+                }
+
+                out.channels = _le16( body + 2 );
+                out.samplerate = _le32( body + 4 );
+
+                int sub = 0;
+                if ( tag == 1 ){
+                    if ( !_intFormat( bits, false, true, out.format, sub ) ){
+                        return false;
+                    }
+                } else if ( tag == 3 && bits == 32 ){
+                    out.format = Wayver::Dsp::PCM_F32_LE;
+                    sub = SF_FORMAT_FLOAT;
+                } else {
+                    return false;
+                }
+
+                // 24 in 32 bit containers and the like - leave to libsndfile
+                if ( block_align != out.channels * Wayver::Dsp::pcmSampleBytes( out.format ) ){
+                    return false;
+                }
+
+                out.sf_format |= sub;
+                have_fmt = true;
+
+            } else if ( !memcmp( chunk, "data", 4 ) ){
+                out.data_offset = at + 8;
+                out.data_bytes = std::min( chunk_bytes, size - out.data_offset );
+                return have_fmt;
+            }
+
+            at += 8 + chunk_bytes + ( chunk_bytes & 1 );
+        }
+
+        return false;
+    }
+
+    /***
+     * FORM / AIFF and AIFC, big endian throughout. AIFC only
+     * for the compression types that are really just PCM.
+    */
+    bool _parseAiff( const uint8_t *p, size_t size, Layout &out )
+    {
+        if ( size < 12 || memcmp( p, "FORM", 4 ) ){
+            return false;
+        }
+
+        const bool aifc = !memcmp( p + 8, "AIFC", 4 );
+        if ( !aifc && memcmp( p + 8, "AIFF", 4 ) ){
+            return false;
+        }
+
+        bool have_comm = false;
+        int64_t frames = 0;
+        size_t at = 12;
+
+        while ( at + 8 <= size ){
+
+            const uint8_t *chunk = p + at;
+            const size_t chunk_bytes = _be32( chunk + 4 );
+            const uint8_t *body = chunk + 8;
+
+            if ( !memcmp( chunk, "COMM", 4 ) && chunk_bytes >= 18 && at + 8 + chunk_bytes <= size ){
+
+                out.channels = (int16_t)_be16( body );
+                frames = _be32( body + 2 );
+                const int bits = (int16_t)_be16( body + 6 );
+                out.samplerate = (int)lround( _extended( body + 8 ) );
+                out.sf_format = SF_FORMAT_AIFF;
+
+                int sub = 0;
+                const uint8_t *compression = (const uint8_t*)"NONE";
+                if ( aifc && chunk_bytes >= 22 ){
+                    compression = body + 18;
+                }
+
+                if ( !memcmp( compression, "NONE", 4 ) || !memcmp( compression, "twos", 4 ) ){
+                    if ( !_intFormat( bits, true, false, out.format, sub ) ){
+                        return false;
+                    }
+                } else if ( !memcmp( compression, "sowt", 4 ) ){
+                    if ( !_intFormat( bits, false, false, out.format, sub ) ){
+                        return false;
+                    }
+                    out.sf_format |= SF_ENDIAN_LITTLE;
+                } else if ( !memcmp( compression, "fl32", 4 ) || !memcmp( compression, "FL32", 4 ) ){
+                    out.format = Wayver::Dsp::PCM_F32_BE;
+                    sub = SF_FORMAT_FLOAT;
+                } else {
+                    return false;
+                }
+
+                out.sf_format |= sub;
+                have_comm = true;
+
+            } else if ( !memcmp( chunk, "SSND", 4 ) && chunk_bytes >= 8 ){
+                // offset to the first sample, then block size
+                out.data_offset = at + 16 + _be32( body );
+                if ( out.data_offset > size ){
+                    return false;
+                }
+                out.data_bytes = std::min( chunk_bytes - 8, size - out.data_offset );
+            }
+
+            at += 8 + chunk_bytes + ( chunk_bytes & 1 );
+        }
+
+        if ( !have_comm || out.data_offset == 0 ){
+            return false;
+        }
+
+        // COMM is the authority on length, SSND may carry padding
+        out.data_bytes = std::min<size_t>( out.data_bytes,
+            frames * out.channels * Wayver::Dsp::pcmSampleBytes( out.format ) );
+        return true;
+    }
+
+    size_t _pageDown( size_t bytes )
+    {
+        static const size_t page = sysconf( _SC_PAGESIZE );
+        return bytes - bytes % page;
+    }
+}
+
+/*static*/ MappedPcmSource *MappedPcmSource::open( const std::string &path )
+{
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ){
+        return NULL;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || st.st_size < 12 ){
+        ::close( fd );
+        return NULL;
+    }
+
+    void *map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    if ( map == MAP_FAILED ){
+        ::close( fd );
+        return NULL;
+    }
+
+    const uint8_t *p = (const uint8_t*)map;
+    Layout layout;
+
+    if ( !( _parseWav( p, st.st_size, layout ) || _parseAiff( p, st.st_size, layout ) )
+        || layout.channels <= 0
+        || layout.samplerate <= 0 ){
+        munmap( map, st.st_size );
+        ::close( fd );
+        return NULL;
+    }
+
+    MappedPcmSource *source = new MappedPcmSource();
+    source->_fd = fd;
+    source->_map = (uint8_t*)map;
+    source->_map_bytes = st.st_size;
+    source->_data = p + layout.data_offset;
+    source->_format = layout.format;
+    source->_frame_bytes = layout.channels * Dsp::pcmSampleBytes( layout.format );
+
+    SF_INFO &info = source->_info;
+    memset( &info, 0, sizeof(info) );
+    info.frames = layout.data_bytes / source->_frame_bytes;
+    info.samplerate = layout.samplerate;
+    info.channels = layout.channels;
+    info.format = layout.sf_format;
+    info.sections = 1;
+    info.seekable = 1;
+
+    madvise( map, st.st_size, MADV_SEQUENTIAL );
+    source->_advise();
+
+    return source;
+}
+
+MappedPcmSource::~MappedPcmSource()
+{
+    munmap( _map, _map_bytes );
+    ::close( _fd );
+}
+
+int64_t MappedPcmSource::readFrames( float *out, int64_t frames )
+{
+    const int64_t n = std::max<int64_t>( 0, std::min( frames, _info.frames - _frame ) );
+
+    Dsp::pcmToFloat( _data + _frame * _frame_bytes, out, n * _info.channels, _format );
+    _frame += n;
+
+    _advise();
+    return n;
+}
+
+bool MappedPcmSource::seek( int64_t frame )
+{
+    if ( frame < 0 || frame > _info.frames ){
+        return false;
+    }
+
+    _frame = frame;
+
+    // start the window over at the new position
+    _prefetched_to = _frame * _frame_bytes;
+    _released_to = std::min( _released_to, _prefetched_to );
+    _advise();
+    return true;
+}
+
+/***
+ * Hints go out in PCM_ADVISE_BYTES steps, not per read: WILLNEED
+ * the next window once the read position is half way into the
+ * current one, DONTNEED whatever is a whole window behind. Dropping
+ * only unmaps our copy - the pages stay in the page cache for the
+ * overview workers and for seeks back.
+*/
+void MappedPcmSource::_advise()
+{
+    const size_t data_bytes = _info.frames * _frame_bytes;
+    const size_t at = _frame * _frame_bytes;
+    const size_t base = _data - _map;
+
+    if ( at + PCM_ADVISE_BYTES / 2 >= _prefetched_to && _prefetched_to < data_bytes ){
+        const size_t from = _pageDown( base + _prefetched_to );
+        const size_t to = std::min( base + data_bytes, base + at + PCM_ADVISE_BYTES );
+        madvise( _map + from, to - from, MADV_WILLNEED );
+        _prefetched_to = to - base;
+    }
+
+    if ( at >= _released_to + 2 * PCM_ADVISE_BYTES ){
+        const size_t from = _pageDown( base + _released_to );
+        const size_t to = _pageDown( base + at - PCM_ADVISE_BYTES );
+        if ( to > from ){
+            madvise( _map + from, to - from, MADV_DONTNEED );
+        }
+        _released_to = to - base;
+    }
+}
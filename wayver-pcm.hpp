@@ -0,0 +1,55 @@
+#pragma once
+
+#include <wayver-source.hpp>
+#include <wayver-dsp.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        /***
+         * Uncompressed WAV / AIFF read straight out of an mmap.
+         *
+         *      - Parses the header itself: WAV PCM, IEEE float and
+         *      WAVE_FORMAT_EXTENSIBLE; AIFF and AIFC 'NONE', 'sowt', 'fl32'
+         *      - No read() copy - samples convert from the page cache
+         *      straight into the caller's buffer
+         *      - madvise keeps PCM_ADVISE_BYTES prefetched ahead of
+         *      the read position and drops what is that far behind it
+        */
+        class MappedPcmSource : public Source {
+
+            int _fd = -1;
+            uint8_t *_map = NULL;
+            size_t _map_bytes = 0;
+
+            // first frame, inside _map
+            const uint8_t *_data = NULL;
+            size_t _frame_bytes = 0;
+            Dsp::PcmFormat _format = Dsp::PCM_S16_LE;
+
+            SF_INFO _info;
+            int64_t _frame = 0;
+
+            // byte offsets into _data the hints already cover
+            size_t _prefetched_to = 0;
+            size_t _released_to = 0;
+
+            MappedPcmSource() {}
+            void _advise();
+
+            public:
+                // NULL if the file is not PCM this class can read
+                static MappedPcmSource *open( const std::string &path );
+                ~MappedPcmSource();
+
+                const SF_INFO &info() const override { return _info; }
+                int64_t readFrames( float *out, int64_t frames ) override;
+                bool seek( int64_t frame ) override;
+                const char *kind() const override { return "mapped PCM"; }
+        };
+    }
+}
@@ -0,0 +1,438 @@
+#include <wayver-resampler.hpp>
+#include <wayver-dsp.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <math.h>
+#include <stdexcept>
+#include <string>
+
+#include <boost/thread.hpp>
+
+using namespace Wayver::Audio;
+
+namespace {
+
+    /***
+     * Taps either side at 1x, phases per input frame, cutoff as a
+     * fraction of the input's Nyquist, Kaiser beta - more taps for a
+     * narrower transition, more phases and beta for less noise.
+    */
+    struct Preset {
+        const char *name;
+        int half;
+        int phases;
+        double rolloff;
+        double beta;
+    };
+
+    const Preset PRESETS[RESAMPLE_QUALITY_COUNT] = {
+        { "fast", 4, 32, 0.80, 5.0 },
+        { "good", 12, 128, 0.90, 7.0 },
+        { "best", 32, 256, 0.95, 9.0 },
+    };
+
+    // zeroth order modified Bessel function of the first kind
+    double _besselI0( double x )
+    {
+        double sum = 1, term = 1;
+        for ( int k = 1; k < 64 && term > 1e-12 * sum; k++ ){
+            term *= ( x / ( 2 * k ) ) * ( x / ( 2 * k ) );
+            sum += term;
+        }
+        return sum;
+    }
+
+    /***
+     * phases + 1 rows of p's filter, widened and its cutoff lowered
+     * by stretch - reading stretch input frames per output frame
+    */
+    FilterBank::Table _design( const Preset &p, int phases, double stretch )
+    {
+        const double i0_beta = _besselI0( p.beta );
+
+        FilterBank::Table t;
+        t.stretch = stretch;
+        t.half = (int)ceil( p.half * t.stretch );
+        t.stride = ( 2 * t.half + 15 ) & ~15;
+        t.rows.assign( (size_t)( phases + 1 ) * t.stride, 0 );
+
+        const double fc = p.rolloff / t.stretch;
+
+        for ( int ph = 0; ph <= phases; ph++ ){
+
+            float *row = t.rows.data() + (size_t)ph * t.stride;
+            double sum = 0;
+
+            for ( int m = 0; m < 2 * t.half; m++ ){
+                const double x = m - t.half + 1 - (double)ph / phases;
+                const double u = x / t.half;
+                const double sinc = x == 0 ? 1 : sin( M_PI * fc * x ) / ( M_PI * fc * x );
+                const double window = fabs( u ) < 1 ? _besselI0( p.beta * sqrt( 1 - u * u ) ) / i0_beta : 0;
+
+                row[m] = fc * sinc * window;
+                sum += row[m];
+            }
+
+            // unity at DC on every phase - no ripple as the position moves
+            for ( int m = 0; m < 2 * t.half; m++ ){
+                row[m] /= sum;
+            }
+        }
+
+        return t;
+    }
+
+    FilterBank *_build( const Preset &p )
+    {
+        FilterBank *bank = new FilterBank;
+        bank->phases = p.phases;
+        bank->base_half = p.half;
+        bank->max_half = p.half;
+
+        for ( int k = 0; k < RESAMPLE_STRETCHES; k++ ){
+            FilterBank::Table t = _design( p, p.phases, pow( 2.0, k / 4.0 ) );
+
+            bank->max_half = std::max( bank->max_half, t.half );
+            bank->tables.push_back( t );
+        }
+
+        return bank;
+    }
+
+    // rates files and devices commonly run at, built before they are asked for
+    const int COMMON_PAIRS[][2] = {
+        { 44100, 48000 }, { 48000, 44100 },
+        { 96000, 48000 }, { 48000, 96000 },
+        { 88200, 48000 }, { 88200, 44100 },
+        { 96000, 44100 }, { 44100, 96000 },
+        { 192000, 48000 }, { 176400, 44100 },
+        { 32000, 48000 }, { 22050, 44100 },
+    };
+
+    int _gcd( int a, int b )
+    {
+        while ( b != 0 ){
+            const int r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+}
+
+bool Wayver::Audio::parseResampleQuality( const char *name, ResampleQuality *out )
+{
+    for ( int q = 0; q < RESAMPLE_QUALITY_COUNT; q++ ){
+        if ( strcmp( name, PRESETS[q].name ) == 0 ){
+            *out = (ResampleQuality)q;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *Wayver::Audio::resampleQualityName( ResampleQuality quality )
+{
+    return PRESETS[quality].name;
+}
+
+/*static*/ const FilterBank &FilterBank::get( ResampleQuality quality )
+{
+    static boost::mutex mutex;
+    static FilterBank *banks[RESAMPLE_QUALITY_COUNT] = {};
+
+    boost::lock_guard<boost::mutex> lock( mutex );
+
+    if ( banks[quality] == NULL ){
+        banks[quality] = _build( PRESETS[quality] );
+    }
+    return *banks[quality];
+}
+
+/*static*/ const RatioFilter *RatioFilter::get( int from, int to )
+{
+    static boost::mutex mutex;
+    static std::map<std::pair<int,int>,RatioFilter*> filters;
+
+    if ( from <= 0 || to <= 0 ){
+        return NULL;
+    }
+
+    const int g = _gcd( from, to );
+
+    boost::lock_guard<boost::mutex> lock( mutex );
+
+    RatioFilter *&f = filters[std::make_pair( from, to )];
+    if ( f == NULL ){
+        f = new RatioFilter;
+        f->up = to / g;
+        f->down = from / g;
+        f->phases = std::min( f->up, RATIO_MAX_PHASES );
+        f->table = _design( PRESETS[RESAMPLE_BEST], f->phases, std::max( 1.0, (double)f->down / f->up ) );
+    }
+    return f;
+}
+
+/*static*/ void RatioFilter::prebuild( int to )
+{
+    for ( const int *pair : COMMON_PAIRS ){
+        if ( pair[1] == to ){
+            get( pair[0], pair[1] );
+        }
+    }
+}
+
+
+/***
+ * RESAMPLER
+*/
+Resampler::Resampler( int channels, ResampleQuality quality )
+:_bank(FilterBank::get( quality )),
+_channels(channels),
+_taps(channels)
+{
+    _line_frames = 2 * _bank.max_half + 2 * VARISPEED_CHUNK_FRAMES;
+    _line.assign( (size_t)channels * ( _line_frames + RESAMPLE_LINE_PAD ), 0 );
+    reset();
+}
+
+void Resampler::setSpeed( double speed, int64_t glide_frames )
+{
+    _target = speed;
+
+    if ( glide_frames <= 0 ){
+        _speed = speed;
+        _glide_left = 0;
+        if ( _speed == 1 ){
+            _pos = floor( _pos + 0.5 );
+        }
+        return;
+    }
+
+    _speed_step = ( speed - _speed ) / glide_frames;
+    _glide_left = glide_frames;
+}
+
+bool Resampler::settled() const
+{
+    return _speed == 1 && _glide_left == 0 && _pos == floor( _pos );
+}
+
+void Resampler::reset()
+{
+    for ( int c = 0; c < _channels; c++ ){
+        memset( _at( c, 0 ), 0, sizeof(float) * _bank.max_half );
+    }
+    _filled = _bank.max_half;
+    _pos = _bank.max_half;
+}
+
+// keeps what the longest filter reaches back to, drops the rest
+void Resampler::_compact()
+{
+    const int64_t start = (int64_t)_pos - _bank.max_half + 1;
+    if ( start <= 0 ){
+        return;
+    }
+
+    for ( int c = 0; c < _channels; c++ ){
+        memmove( _at( c, 0 ), _at( c, start ), sizeof(float) * ( _filled - start ) );
+    }
+    _filled -= start;
+    _pos -= start;
+}
+
+size_t Resampler::space() const
+{
+    const int64_t start = std::max<int64_t>( 0, (int64_t)_pos - _bank.max_half + 1 );
+    return _line_frames - ( _filled - start );
+}
+
+size_t Resampler::buffered() const
+{
+    return std::max<int64_t>( 0, _filled - (int64_t)_pos );
+}
+
+size_t Resampler::write( const float *in, size_t frames )
+{
+    if ( _filled + (int64_t)frames > _line_frames ){
+        _compact();
+    }
+
+    const size_t n = std::min<size_t>( frames, _line_frames - _filled );
+
+    for ( int c = 0; c < _channels; c++ ){
+        float *dst = _at( c, _filled );
+        for ( size_t f = 0; f < n; f++ ){
+            dst[f] = in[f * _channels + c];
+        }
+    }
+
+    _filled += n;
+    return n;
+}
+
+/***
+ * Only the last base_half frames matter: a glide starts at 1x, on
+ * the shortest table, and has written plenty by the time a longer
+ * one reaches further back.
+*/
+void Resampler::remember( const float *in, size_t frames )
+{
+    const size_t keep = std::min<size_t>( frames, _bank.base_half );
+
+    write( in + ( frames - keep ) * _channels, keep );
+    _pos = _filled;
+}
+
+size_t Resampler::read( float *out, size_t frames )
+{
+    const std::vector<FilterBank::Table> &tables = _bank.tables;
+    size_t n = 0;
+
+    while ( n < frames ){
+
+        const int64_t i0 = (int64_t)_pos;
+        float *frame = out + n * _channels;
+
+        if ( settled() ){
+            if ( i0 >= _filled ){
+                break;
+            }
+            for ( int c = 0; c < _channels; c++ ){
+                frame[c] = *_at( c, i0 );
+            }
+        } else {
+            // table k serves speeds above table k - 1's stretch, up to its own
+            while ( _table + 1 < tables.size() && _speed > tables[_table].stretch ){
+                _table++;
+            }
+            while ( _table > 0 && _speed <= tables[_table - 1].stretch ){
+                _table--;
+            }
+
+            const FilterBank::Table &t = tables[_table];
+            if ( i0 + t.half >= _filled ){
+                break;
+            }
+
+            const double phase = ( _pos - i0 ) * _bank.phases;
+            const int p = (int)phase;
+            const float *row0 = t.rows.data() + (size_t)p * t.stride;
+
+            for ( int c = 0; c < _channels; c++ ){
+                _taps[c] = _at( c, i0 - t.half + 1 );
+            }
+
+            Dsp::polyphaseFrame( row0, row0 + t.stride, (float)( phase - p ), _taps.data(), _channels, t.stride, frame );
+        }
+
+        _pos += _speed;
+        n++;
+
+        if ( _glide_left > 0 ){
+            _glide_left--;
+            _speed = _glide_left == 0 ? _target : _speed + _speed_step;
+
+            // back at 1x, on a whole frame so it copies again - under half a frame off
+            if ( _glide_left == 0 && _speed == 1 ){
+                _pos = floor( _pos + 0.5 );
+            }
+        }
+    }
+
+    return n;
+}
+
+
+/***
+ * RATIO RESAMPLER
+*/
+RatioResampler::RatioResampler( int channels, int from, int to )
+:_filter(RatioFilter::get( from, to )),
+_channels(channels),
+_taps(channels)
+{
+    if ( _filter == NULL ){
+        throw std::runtime_error("No filter for " + std::to_string( from ) + " -> " + std::to_string( to ) + " Hz");
+    }
+
+    _line_frames = 2 * _filter->table.half + 2 * DECODER_CHUNK_FRAMES;
+    _line.assign( (size_t)channels * ( _line_frames + RESAMPLE_LINE_PAD ), 0 );
+    reset( 0, 0 );
+}
+
+void RatioResampler::reset( int64_t lead, int phase )
+{
+    const int half = _filter->table.half;
+
+    for ( int c = 0; c < _channels; c++ ){
+        memset( _at( c, 0 ), 0, sizeof(float) * half );
+    }
+    _filled = half;
+    _pos = half + lead;
+    _phase = phase;
+}
+
+size_t RatioResampler::space() const
+{
+    const int64_t start = std::max<int64_t>( 0, _pos - _filter->table.half + 1 );
+    return _line_frames - ( _filled - start );
+}
+
+size_t RatioResampler::write( const float *in, size_t frames )
+{
+    if ( _filled + (int64_t)frames > _line_frames ){
+        const int64_t start = _pos - _filter->table.half + 1;
+
+        if ( start > 0 ){
+            for ( int c = 0; c < _channels; c++ ){
+                memmove( _at( c, 0 ), _at( c, start ), sizeof(float) * ( _filled - start ) );
+            }
+            _filled -= start;
+            _pos -= start;
+        }
+    }
+
+    const size_t n = std::min<size_t>( frames, _line_frames - _filled );
+
+    for ( int c = 0; c < _channels; c++ ){
+        float *dst = _at( c, _filled );
+        for ( size_t f = 0; f < n; f++ ){
+            dst[f] = in[f * _channels + c];
+        }
+    }
+
+    _filled += n;
+    return n;
+}
+
+size_t RatioResampler::read( float *out, size_t frames )
+{
+    const FilterBank::Table &t = _filter->table;
+    const int64_t up = _filter->up;
+    size_t n = 0;
+
+    while ( n < frames && _pos + t.half < _filled ){
+
+        // a row per phase when exact, t always 0; otherwise between two rows
+        const int64_t scaled = (int64_t)_phase * _filter->phases;
+        const float *row = t.rows.data() + (size_t)( scaled / up ) * t.stride;
+        const float frac = (float)( scaled % up ) / up;
+
+        for ( int c = 0; c < _channels; c++ ){
+            _taps[c] = _at( c, _pos - t.half + 1 );
+        }
+
+        Dsp::polyphaseFrame( row, row + t.stride, frac, _taps.data(), _channels, t.stride, out + n * _channels );
+
+        _phase += _filter->down;
+        _pos += _phase / _filter->up;
+        _phase %= _filter->up;
+        n++;
+    }
+
+    return n;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        // filter length against cost, see the presets in wayver-resampler.cpp
+        enum ResampleQuality {
+            RESAMPLE_FAST,
+            RESAMPLE_GOOD,
+            RESAMPLE_BEST,
+            RESAMPLE_QUALITY_COUNT
+        };
+
+        // "fast", "good", "best" - false for anything else
+        bool parseResampleQuality( const char *name, ResampleQuality *out );
+        const char *resampleQualityName( ResampleQuality quality );
+
+        /***
+         * Kaiser windowed sinc for one quality, as polyphase tables.
+         *
+         *      - One table per stretch, RESAMPLE_STRETCHES of them from
+         *      1x to VARISPEED_MAX in quarter octaves: reading faster
+         *      than 1x needs the cutoff that much lower, and the filter
+         *      that much longer to keep its transition band
+         *      - phases + 1 rows per table, each summing to one, so a
+         *      position between two rows interpolates both ends
+         *      - Built once per quality and shared, never freed
+        */
+        struct FilterBank {
+
+            struct Table {
+                double stretch;
+
+                // taps either side of the position, and the padded row length
+                int half;
+                int stride;
+
+                std::vector<float> rows;
+            };
+
+            int phases;
+            int base_half;
+            int max_half;
+            std::vector<Table> tables;
+
+            static const FilterBank &get( ResampleQuality quality );
+        };
+
+        /***
+         * Polyphase resampler at a variable ratio - speed input frames
+         * are read per output frame.
+         *
+         *      - Input is kept planar, in a line long enough for the
+         *      longest filter plus VARISPEED_CHUNK_FRAMES either way
+         *      - setSpeed() glides to the new ratio, linearly
+         *      - At 1x, on a whole input frame, it copies instead of
+         *      filtering - settled() says so
+         *      - RT safe once built: read(), write(), remember() and
+         *      reset() neither allocate nor lock
+        */
+        class Resampler {
+
+            const FilterBank &_bank;
+            int _channels;
+
+            // where each channel's taps start, for the frame being read
+            std::vector<const float*> _taps;
+
+            // planar input line, _line_frames per channel plus padding
+            std::vector<float> _line;
+            int64_t _line_frames;
+            int64_t _filled = 0;
+
+            // input frame the next output lands on, into the line
+            double _pos = 0;
+
+            double _speed = 1;
+            double _speed_step = 0;
+            int64_t _glide_left = 0;
+            double _target = 1;
+
+            // table for the speed last read at
+            size_t _table = 0;
+
+            float *_at( int c, int64_t frame ) { return _line.data() + c * ( _line_frames + RESAMPLE_LINE_PAD ) + frame; }
+            void _compact();
+
+            public:
+
+                Resampler( int channels, ResampleQuality quality );
+
+                // glide from wherever it is now to speed over glide_frames output frames
+                void setSpeed( double speed, int64_t glide_frames );
+
+                // where the glide is now
+                double speed() const { return _speed; }
+
+                // 1x, not gliding, on a whole frame - output is the input
+                bool settled() const;
+
+                // silence before the next frame written - after a seek
+                void reset();
+
+                // input frames write() takes right now
+                size_t space() const;
+
+                // input written but not yet read past
+                size_t buffered() const;
+
+                // interleaved, returns how many frames it took
+                size_t write( const float *in, size_t frames );
+
+                /***
+                 * Frames that were played without it: keeps the last few
+                 * as history, so a glide away from 1x starts seamless
+                */
+                void remember( const float *in, size_t frames );
+
+                // interleaved, up to frames - fewer when it needs more input
+                size_t read( float *out, size_t frames );
+        };
+
+        /***
+         * Kaiser windowed sinc for one rate pair, from -> to, with the
+         * "best" preset. The ratio reduces to up / down; one row per
+         * output phase, up of them, so no row is ever interpolated.
+         *
+         *      - Built once per pair and shared, never freed. prebuild()
+         *      makes the common pairs into a rate ahead of time
+         *      - Pairs that reduce to over RATIO_MAX_PHASES get that many
+         *      rows, and a phase between two of them is interpolated
+         *      - NULL only for a rate that is not positive
+        */
+        struct RatioFilter {
+
+            int up;
+            int down;
+            // rows in table, less the closing one - up when exact
+            int phases;
+            FilterBank::Table table;
+
+            static const RatioFilter *get( int from, int to );
+            static void prebuild( int to );
+        };
+
+        /***
+         * Polyphase resampler at a fixed rational ratio, for converting
+         * a whole file to the device's rate.
+         *
+         *      - Steps down / up input frames per output frame exactly:
+         *      a whole frame index plus a phase, nothing drifts, even
+         *      where the filter's rows are interpolated
+         *      - Input kept planar like Resampler, DECODER_CHUNK_FRAMES
+         *      either way past the kernel
+         *      - Throws std::runtime_error for a pair RatioFilter has no
+         *      filter for
+        */
+        class RatioResampler {
+
+            const RatioFilter *_filter;
+            int _channels;
+
+            std::vector<const float*> _taps;
+
+            std::vector<float> _line;
+            int64_t _line_frames;
+            int64_t _filled = 0;
+
+            // input frame the next output is at, plus phase / up of one
+            int64_t _pos = 0;
+            int _phase = 0;
+
+            float *_at( int c, int64_t frame ) { return _line.data() + c * ( _line_frames + RESAMPLE_LINE_PAD ) + frame; }
+
+            public:
+
+                RatioResampler( int channels, int from, int to );
+
+                int up() const { return _filter->up; }
+                int down() const { return _filter->down; }
+
+                // input frames before a position the kernel reaches back to
+                int history() const { return _filter->table.half - 1; }
+
+                /***
+                 * Silence before the next frame written; the first output
+                 * lands lead frames into it, phase / up of a frame on
+                */
+                void reset( int64_t lead, int phase );
+
+                size_t space() const;
+                size_t write( const float *in, size_t frames );
+                size_t read( float *out, size_t frames );
+        };
+    }
+}
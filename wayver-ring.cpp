@@ -0,0 +1,104 @@
+#include <wayver-ring.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Wayver::Bus;
+
+FrameRing::FrameRing( size_t capacity_frames, int channels )
+:_buffer( capacity_frames * channels, 0 ),
+_capacity_frames( capacity_frames ),
+_channels( channels )
+{}
+
+size_t FrameRing::write( const float *frames, size_t n_frames )
+{
+    const uint64_t w = _write_pos.load( std::memory_order_relaxed );
+    const uint64_t r = _read_pos.load( std::memory_order_acquire );
+
+    const size_t n = std::min( n_frames, _capacity_frames - (size_t)(w - r) );
+    const size_t start = w % _capacity_frames;
+    const size_t first = std::min( n, _capacity_frames - start );
+
+    // copy in at most two pieces, wrapping at the end of the buffer
+    memcpy( &_buffer[ start * _channels ], frames, first * _channels * sizeof(float) );
+    memcpy( &_buffer[0], frames + first * _channels, (n - first) * _channels * sizeof(float) );
+
+    _write_pos.store( w + n, std::memory_order_release );
+    return n;
+}
+
+size_t FrameRing::read( float *out, size_t n_frames )
+{
+    const uint64_t r = _read_pos.load( std::memory_order_relaxed );
+    const uint64_t w = _write_pos.load( std::memory_order_acquire );
+
+    const size_t n = std::min( n_frames, (size_t)(w - r) );
+    const size_t start = r % _capacity_frames;
+    const size_t first = std::min( n, _capacity_frames - start );
+
+    memcpy( out, &_buffer[ start * _channels ], first * _channels * sizeof(float) );
+    memcpy( out + first * _channels, &_buffer[0], (n - first) * _channels * sizeof(float) );
+
+    _read_pos.store( r + n, std::memory_order_release );
+    return n;
+}
+
+size_t FrameRing::peek( 
+    size_t n_frames, 
+    const float **a, size_t *n_a, 
+    const float **b, size_t *n_b ) const
+{
+    const uint64_t r = _read_pos.load( std::memory_order_relaxed );
+    const uint64_t w = _write_pos.load( std::memory_order_acquire );
+
+    const size_t n = std::min( n_frames, (size_t)(w - r) );
+    const size_t start = r % _capacity_frames;
+
+    *n_a = std::min( n, _capacity_frames - start );
+    *n_b = n - *n_a;
+    *a = &_buffer[ start * _channels ];
+    *b = &_buffer[0];
+
+    return n;
+}
+
+void FrameRing::consume( size_t n_frames )
+{
+    _read_pos.store( 
+        _read_pos.load( std::memory_order_relaxed ) + n_frames, 
+        std::memory_order_release );
+}
+
+uint64_t FrameRing::writePosition() const
+{
+    return _write_pos.load( std::memory_order_relaxed );
+}
+
+void FrameRing::skipTo( uint64_t pos )
+{
+    if ( pos > _read_pos.load( std::memory_order_relaxed ) ){
+        _read_pos.store( pos, std::memory_order_release );
+    }
+}
+
+uint64_t FrameRing::readPosition() const
+{
+    return _read_pos.load( std::memory_order_relaxed );
+}
+
+size_t FrameRing::readAvailable() const
+{
+    return (size_t)( _write_pos.load( std::memory_order_acquire ) 
+        - _read_pos.load( std::memory_order_acquire ) );
+}
+
+size_t FrameRing::writeAvailable() const
+{
+    return _capacity_frames - readAvailable();
+}
+
+float FrameRing::fillLevel() const
+{
+    return (float)readAvailable() / (float)_capacity_frames;
+}
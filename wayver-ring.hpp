@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Wayver {
+    namespace Bus {
+
+        /***
+         * Single producer / single consumer ring of interleaved
+         * float frames. Positions are monotonic frame counters, so
+         * fill level is simply write - read.
+         *
+         *      - producer: write() from exactly one thread
+         *      - consumer: read() from exactly one thread (the callback)
+         *
+         * Neither side allocates or locks after construction.
+        */
+        class FrameRing {
+
+            std::vector<float> _buffer;
+
+            size_t _capacity_frames;
+            int _channels;
+
+            std::atomic<uint64_t> _write_pos{0};
+            std::atomic<uint64_t> _read_pos{0};
+
+            public:
+
+                FrameRing( size_t capacity_frames, int channels );
+
+                // Producer - returns frames actually written
+                size_t write( const float *frames, size_t n_frames );
+
+                // Consumer - returns frames actually read
+                size_t read( float *out, size_t n_frames );
+
+                /***
+                 * Consumer, zero copy - up to n_frames readable frames as
+                 * at most two contiguous pieces (a, then b after the wrap).
+                 * Nothing is released until consume()
+                */
+                size_t peek( 
+                    size_t n_frames, 
+                    const float **a, size_t *n_a, 
+                    const float **b, size_t *n_b 
+                ) const;
+                void consume( size_t n_frames );
+
+                // Producer - position the next write() will land on
+                uint64_t writePosition() const;
+
+                // Consumer - drop everything before pos (a producer mark)
+                void skipTo( uint64_t pos );
+
+                // Consumer - position the next read() starts at
+                uint64_t readPosition() const;
+
+                size_t readAvailable() const;
+                size_t writeAvailable() const;
+
+                // 0 -> empty, 1 -> full
+                float fillLevel() const;
+
+                size_t capacity() const { return _capacity_frames; }
+                int channels() const { return _channels; }
+        };
+
+    }
+}
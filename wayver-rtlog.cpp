@@ -0,0 +1,102 @@
+#include <wayver-rtlog.hpp>
+
+#include <boost/chrono.hpp>
+#include <spdlog/sinks/basic_file_sink.h>
+
+using namespace Wayver::Bus;
+
+namespace {
+
+    // by RtEvent - what the record is and what its args mean, "" -> unused
+    struct EventFormat {
+        const char *name;
+        const char *args[3];
+    };
+
+    const EventFormat EVENT_FORMATS[RT_EVENT_COUNT] = {
+        { "end of stream", { "", "", "" } },
+        { "seek landed", { "target", "", "" } },
+        { "ring underrun", { "missing", "", "" } },
+        { "track change", { "track", "frames", "" } },
+        { "source swap", { "load", "", "" } },
+        { "loop set", { "a", "b", "in memory" } },
+    };
+}
+
+RtLog::RtLog( std::shared_ptr<spdlog::logger> logger )
+:_logger(logger)
+{}
+
+RtLog::~RtLog()
+{
+    stop();
+}
+
+void RtLog::log( RtEvent event, int64_t frame, double a, double b, double c )
+{
+    RtRecord r;
+    r.event = event;
+    r.frame = frame;
+    r.args[0] = a;
+    r.args[1] = b;
+    r.args[2] = c;
+
+    if ( !_records.push( r ) ){
+        _dropped.fetch_add( 1, std::memory_order_relaxed );
+    }
+}
+
+void RtLog::start()
+{
+    if ( !_running ){
+        _running = true;
+        _thread = boost::thread( &RtLog::_loop, this );
+    }
+}
+
+void RtLog::stop()
+{
+    if ( _running ){
+        _running = false;
+        _thread.join();
+        _drain();
+    }
+}
+
+void RtLog::_drain()
+{
+    RtRecord r;
+
+    while ( _records.pop( r ) ){
+
+        const EventFormat &f = EVENT_FORMATS[ r.event < RT_EVENT_COUNT ? r.event : RT_END_OF_STREAM ];
+        std::string line = fmt::format( "[audio thread] {} at frame {}", f.name, r.frame );
+
+        for ( int i = 0; i < 3; i++ ){
+            if ( f.args[i][0] != '\0' ){
+                line += fmt::format( " {}={}", f.args[i], r.args[i] );
+            }
+        }
+
+        _logger->info( line );
+    }
+
+    uint64_t dropped = _dropped.exchange( 0, std::memory_order_relaxed );
+    if ( dropped > 0 ){
+        _logger->warn( "[audio thread] log ring full, {} records dropped", dropped );
+    }
+}
+
+void RtLog::_loop()
+{
+    while ( _running ){
+        _drain();
+        boost::this_thread::sleep_for( boost::chrono::milliseconds( RT_LOG_DRAIN_MS ) );
+    }
+}
+
+std::shared_ptr<spdlog::logger> Wayver::Bus::fileLogger( const std::string &name )
+{
+    std::shared_ptr<spdlog::logger> logger = spdlog::get( name );
+    return logger != NULL ? logger : spdlog::basic_logger_mt( name, "wayver.log" );
+}
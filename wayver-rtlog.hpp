@@ -0,0 +1,78 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Bus {
+
+        // what the audio thread can report - see the name table in wayver-rtlog.cpp
+        enum RtEvent : uint32_t {
+            RT_END_OF_STREAM,
+            RT_SEEK_LANDED,
+            RT_RING_UNDERRUN,
+            RT_TRACK_CHANGE,
+            RT_SOURCE_SWAP,
+            RT_LOOP_SET,
+            RT_EVENT_COUNT
+        };
+
+        // one fixed size entry, filled in on the audio thread
+        struct RtRecord {
+            RtEvent event;
+            int64_t frame;
+            double args[3];
+        };
+
+        /***
+         * Logging for the audio callback.
+         *
+         *      - log() copies a fixed size record into a preallocated
+         *      spsc ring: no allocation, no lock, no syscall. A full
+         *      ring drops the record and counts it
+         *      - A background thread formats records and hands them
+         *      to a normal spdlog logger every RT_LOG_DRAIN_MS
+         *      - One producer: whichever thread runs the callback
+        */
+        class RtLog {
+
+            boost::lockfree::spsc_queue<RtRecord, boost::lockfree::capacity<RT_LOG_RECORDS>> _records;
+            std::atomic<uint64_t> _dropped{0};
+
+            boost::thread _thread;
+            std::atomic<bool> _running{false};
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            void _drain();
+            void _loop();
+
+            public:
+                RtLog( std::shared_ptr<spdlog::logger> logger );
+                ~RtLog();
+
+                // RT safe
+                void log( RtEvent event, int64_t frame, double a = 0, double b = 0, double c = 0 );
+
+                void start();
+
+                // writes out whatever is still queued
+                void stop();
+        };
+
+        /***
+         * The named logger on wayver.log. spdlog throws on a second
+         * basic_logger_mt() with the same name - anything that can be
+         * built more than once gets its logger through here.
+        */
+        std::shared_ptr<spdlog::logger> fileLogger( const std::string &name );
+    }
+}
@@ -0,0 +1,54 @@
+#include <wayver-scheduler.hpp>
+
+#include <boost/thread.hpp>
+
+using namespace Wayver::UI;
+
+FrameScheduler::FrameScheduler( double refresh_hz )
+:_refresh_hz(refresh_hz),
+_period( boost::chrono::duration_cast<Clock::duration>( boost::chrono::duration<double>( 1 / refresh_hz ) ) )
+{}
+
+void FrameScheduler::waitNextFrame()
+{
+    Clock::time_point now = Clock::now();
+
+    if ( _first ){
+        _first = false;
+        _next = now;
+    } else if ( now >= _next + _period ){
+        _late++;
+        _next = now;
+    } else if ( now < _next ){
+        boost::this_thread::sleep_until( _next );
+        now = Clock::now();
+    }
+
+    if ( _started != Clock::time_point() ){
+        _interval_us.record( boost::chrono::duration_cast<boost::chrono::microseconds>( now - _started ).count() );
+    }
+
+    _started = now;
+    _next += _period;
+}
+
+void FrameScheduler::resync()
+{
+    _first = true;
+    _started = Clock::time_point();
+}
+
+FrameStats FrameScheduler::stats() const
+{
+    FrameStats s;
+
+    s.refresh_hz = _refresh_hz;
+    s.frames = _interval_us.count();
+    s.presented = _presented;
+    s.late = _late;
+    s.p50_ms = _interval_us.percentile( 50 ) / 1e3;
+    s.p99_ms = _interval_us.percentile( 99 ) / 1e3;
+    s.max_ms = _interval_us.max() / 1e3;
+
+    return s;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <wayver-stats.hpp>
+
+#include <cstdint>
+
+#include <boost/chrono.hpp>
+
+namespace Wayver {
+
+    namespace UI {
+
+        // how the UI has been keeping pace with the display
+        struct FrameStats {
+            double refresh_hz = 0;
+
+            uint64_t frames = 0;
+            uint64_t presented = 0;
+
+            // frames that started a whole period or more behind
+            uint64_t late = 0;
+
+            // frame to frame, in milliseconds
+            double p50_ms = 0;
+            double p99_ms = 0;
+            double max_ms = 0;
+        };
+
+        /***
+         * Paces the UI loop to the display refresh.
+         *
+         *      - Frames are due on a fixed grid of refresh periods,
+         *      so sleep error does not add up; a frame that starts a
+         *      whole period late drops the grid and starts a new one
+         *      - A vsynced present blocks on its own, a skipped one
+         *      does not - either way the next wait lands on the grid
+         *      - displayTime() is when the frame being built should
+         *      reach the screen, one period after it started
+        */
+        class FrameScheduler {
+
+            typedef boost::chrono::steady_clock Clock;
+
+            double _refresh_hz;
+            Clock::duration _period;
+
+            Clock::time_point _next;
+            Clock::time_point _started;
+            bool _first = true;
+
+            Stats::Histogram _interval_us;
+            uint64_t _presented = 0;
+            uint64_t _late = 0;
+
+            public:
+                FrameScheduler( double refresh_hz );
+
+                // sleeps until the next frame is due
+                void waitNextFrame();
+
+                // after a wait outside the scheduler, e.g. on events while idle
+                void resync();
+
+                void presented() { _presented++; }
+
+                Clock::time_point displayTime() const { return _started + _period; }
+
+                FrameStats stats() const;
+        };
+    }
+}
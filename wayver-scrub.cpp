@@ -0,0 +1,421 @@
+#include <wayver-scrub.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+#include <stdexcept>
+
+#include <boost/chrono.hpp>
+
+using namespace Wayver::Audio;
+
+namespace {
+
+    const uint64_t NO_KEY = ~(uint64_t)0;
+
+    uint64_t _key( uint64_t file, int64_t block )
+    {
+        return file << 32 | (uint64_t)block;
+    }
+}
+
+BlockCache::BlockCache( std::shared_ptr<spdlog::logger> logger )
+:_blocks(new Block[BLOCK_CACHE_BLOCKS]),
+_logger(logger)
+{
+    for ( int i = 0; i < BLOCK_CACHE_BLOCKS; i++ ){
+        _blocks[i].key.store( NO_KEY );
+    }
+
+    for ( int i = 0; i < BLOCK_QUEUE_SIZE; i++ ){
+        _pending[i].store( NO_KEY );
+    }
+
+    for ( int i = 0; i < BLOCK_READERS; i++ ){
+        _readers.push_back( boost::thread( &BlockCache::_readLoop, this ) );
+    }
+}
+
+BlockCache::~BlockCache()
+{
+    _running = false;
+    wake();
+
+    for ( boost::thread &t : _readers ){
+        t.join();
+    }
+}
+
+/*static*/ uint64_t BlockCache::fileId( uint32_t load, int track )
+{
+    return (uint64_t)load << 16 | (uint16_t)track;
+}
+
+void BlockCache::setFile( uint64_t file, const std::string &path, int samplerate )
+{
+    boost::lock_guard<boost::mutex> lock( _files_mutex );
+
+    // the track before this one may still be playing out, nothing earlier is
+    const uint64_t load = file >> 16;
+    const int track = (uint16_t)file;
+
+    for ( auto it = _files.begin(); it != _files.end(); ){
+        if ( ( it->first >> 16 ) != load || (int)(uint16_t)it->first < track - 1 ){
+            it = _files.erase( it );
+        } else {
+            ++it;
+        }
+    }
+
+    _files[file] = std::make_pair( path, samplerate );
+}
+
+void BlockCache::wake()
+{
+    {
+        boost::lock_guard<boost::mutex> lock( _park_mutex );
+        _wake_gen.fetch_add( 1 );
+    }
+    _park_cond.notify_all();
+}
+
+/***
+ * Callback side: queue key unless it is queued already. Only the
+ * callback turns a free slot into a key, only readers turn it back,
+ * so a plain store is enough here.
+*/
+void BlockCache::_request( uint64_t key )
+{
+    int free_slot = -1;
+
+    for ( int i = 0; i < BLOCK_QUEUE_SIZE; i++ ){
+        const uint64_t k = _pending[i].load( std::memory_order_acquire );
+        if ( k == key ){
+            return;
+        }
+        if ( k == NO_KEY && free_slot < 0 ){
+            free_slot = i;
+        }
+    }
+
+    // as many queued as the queue holds - it comes round again on the next grain
+    if ( free_slot < 0 ){
+        return;
+    }
+
+    _pending[free_slot].store( key, std::memory_order_release );
+    if ( !_wanted.push( key ) ){
+        _pending[free_slot].store( NO_KEY, std::memory_order_release );
+    }
+}
+
+void BlockCache::_unpend( uint64_t key )
+{
+    for ( int i = 0; i < BLOCK_QUEUE_SIZE; i++ ){
+        uint64_t k = key;
+        if ( _pending[i].compare_exchange_strong( k, NO_KEY ) ){
+            return;
+        }
+    }
+}
+
+/***
+ * Pin, then look at the key: a reader that takes the key away
+ * afterwards sees the pin and waits. Both sides are seq_cst so
+ * neither can miss the other.
+*/
+BlockCache::Block *BlockCache::_pin( uint64_t key )
+{
+    for ( int i = 0; i < BLOCK_CACHE_BLOCKS; i++ ){
+
+        Block &b = _blocks[i];
+        if ( b.key.load( std::memory_order_relaxed ) != key ){
+            continue;
+        }
+
+        b.pins.fetch_add( 1 );
+        if ( b.key.load() == key ){
+            b.used.store( _clock.fetch_add( 1, std::memory_order_relaxed ), std::memory_order_relaxed );
+            return &b;
+        }
+        b.pins.fetch_sub( 1, std::memory_order_release );
+    }
+    return NULL;
+}
+
+BlockCache::Block *BlockCache::_find( uint64_t key )
+{
+    for ( int i = 0; i < BLOCK_CACHE_BLOCKS; i++ ){
+        if ( _blocks[i].key.load( std::memory_order_relaxed ) == key ){
+            return &_blocks[i];
+        }
+    }
+    return NULL;
+}
+
+bool BlockCache::read( uint64_t file, int64_t frame, float *out, int64_t frames, int channels )
+{
+    bool whole = true;
+
+    while ( frames > 0 ){
+
+        const int64_t block = std::max<int64_t>( frame, 0 ) / BLOCK_FRAMES;
+        const int64_t at = frame - block * BLOCK_FRAMES;
+        const int64_t n = std::min<int64_t>( frames, at < 0 ? -at : BLOCK_FRAMES - at );
+
+        Block *b = at < 0 ? NULL : _pin( _key( file, block ) );
+        int64_t got = 0;
+
+        if ( b != NULL ){
+            if ( b->channels == channels ){
+                got = std::max<int64_t>( 0, std::min( n, b->frames - at ) );
+                memcpy( out, b->samples.data() + at * channels, sizeof(float) * got * channels );
+            }
+            b->pins.fetch_sub( 1, std::memory_order_release );
+        } else if ( at >= 0 ){
+            _request( _key( file, block ) );
+            whole = false;
+        }
+
+        memset( out + got * channels, 0, sizeof(float) * ( n - got ) * channels );
+
+        out += n * channels;
+        frame += n;
+        frames -= n;
+    }
+
+    return whole;
+}
+
+void BlockCache::want( uint64_t file, int64_t frame )
+{
+    if ( frame < 0 ){
+        return;
+    }
+
+    const uint64_t key = _key( file, frame / BLOCK_FRAMES );
+    if ( _find( key ) == NULL ){
+        _request( key );
+    }
+}
+
+// false when it is there already, or another reader has it
+bool BlockCache::_claim( uint64_t key )
+{
+    boost::lock_guard<boost::mutex> lock( _fill_mutex );
+
+    if ( _find( key ) != NULL || std::find( _filling.begin(), _filling.end(), key ) != _filling.end() ){
+        return false;
+    }
+    _filling.push_back( key );
+    return true;
+}
+
+void BlockCache::_publish( uint64_t key, const std::vector<float> &samples, int64_t frames, int channels )
+{
+    boost::lock_guard<boost::mutex> lock( _fill_mutex );
+
+    Block *victim = &_blocks[0];
+    for ( int i = 1; i < BLOCK_CACHE_BLOCKS; i++ ){
+        if ( _blocks[i].used.load( std::memory_order_relaxed ) < victim->used.load( std::memory_order_relaxed ) ){
+            victim = &_blocks[i];
+        }
+    }
+
+    victim->key.store( NO_KEY );
+    while ( victim->pins.load() != 0 ){
+        boost::this_thread::yield();
+    }
+
+    victim->samples.assign( samples.begin(), samples.begin() + frames * channels );
+    victim->channels = channels;
+    victim->frames = frames;
+    victim->used.store( _clock.fetch_add( 1, std::memory_order_relaxed ), std::memory_order_relaxed );
+    victim->key.store( key, std::memory_order_release );
+
+    _filling.erase( std::find( _filling.begin(), _filling.end(), key ) );
+}
+
+/***
+ * Keeps the last file it read open - a scrub stays in one track.
+ * Polls while there is work: the callback cannot wake anyone, so a
+ * reader that just had work looks again every BLOCK_READER_POLL_MS.
+ * Once nothing came for a second it sleeps until wake() - the
+ * engine calls it on every SCRUB, before the callback asks for
+ * anything.
+*/
+void BlockCache::_readLoop()
+{
+    std::unique_ptr<Source> source;
+    uint64_t source_file = NO_KEY;
+    std::vector<float> samples;
+    int idle_ms = 1000;
+
+    while ( _running ){
+
+        // before the pop, so a wake() between the two is not slept through
+        const uint64_t gen = _wake_gen.load();
+
+        uint64_t key;
+        bool got;
+        {
+            boost::lock_guard<boost::mutex> lock( _wanted_mutex );
+            got = _wanted.pop( key );
+        }
+
+        if ( !got ){
+            if ( idle_ms < 1000 ){
+                boost::this_thread::sleep_for( boost::chrono::milliseconds( BLOCK_READER_POLL_MS ) );
+                idle_ms += BLOCK_READER_POLL_MS;
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock( _park_mutex );
+            while ( _running && _wake_gen.load() == gen ){
+                _park_cond.wait( lock );
+            }
+            idle_ms = 0;
+            continue;
+        }
+        idle_ms = 0;
+
+        if ( !_claim( key ) ){
+            _unpend( key );
+            continue;
+        }
+
+        const uint64_t file = key >> 32;
+        const int64_t block = key & 0xFFFFFFFF;
+
+        if ( file != source_file ){
+            source.reset();
+            source_file = file;
+
+            std::string path;
+            int samplerate = 0;
+            {
+                boost::lock_guard<boost::mutex> lock( _files_mutex );
+                std::map<uint64_t,std::pair<std::string,int>>::const_iterator it = _files.find( file );
+                if ( it != _files.end() ){
+                    path = it->second.first;
+                    samplerate = it->second.second;
+                }
+            }
+
+            try {
+                if ( !path.empty() ){
+                    source.reset( openSource( path, _logger, samplerate ) );
+                }
+            } catch ( const std::runtime_error &e ){
+                _logger->warn("BlockCache - {}", e.what());
+            }
+        }
+
+        int64_t frames = 0;
+        int channels = 0;
+
+        if ( source != NULL ){
+            channels = source->info().channels;
+            samples.resize( (size_t)BLOCK_FRAMES * channels );
+
+            if ( source->seek( block * BLOCK_FRAMES ) ){
+                while ( frames < BLOCK_FRAMES ){
+                    const int64_t n = source->readFrames( samples.data() + frames * channels, BLOCK_FRAMES - frames );
+                    if ( n == 0 ){
+                        break;
+                    }
+                    frames += n;
+                }
+            }
+        }
+
+        // past the end, or nothing to read it from: an empty block, so it is not asked for again
+        _publish( key, samples, frames, channels );
+        _unpend( key );
+    }
+}
+
+
+/***
+ * GRAINS
+*/
+GrainPlayer::GrainPlayer( int channels, int samplerate )
+:_channels(channels),
+_samplerate(samplerate)
+{
+    _grain_frames = std::max<int64_t>( 2, (int64_t)samplerate * SCRUB_GRAIN_MS / 1000 ) & ~(int64_t)1;
+    _hop = _grain_frames / 2;
+
+    // periodic Hann - overlap-adds to one at half a window apart
+    _window.resize( _grain_frames );
+    for ( int64_t i = 0; i < _grain_frames; i++ ){
+        _window[i] = 0.5f - 0.5f * cosf( 2 * (float)M_PI * i / _grain_frames );
+    }
+
+    for ( int v = 0; v < 2; v++ ){
+        _voice[v].resize( _grain_frames * channels );
+        _played[v] = _grain_frames;
+    }
+}
+
+void GrainPlayer::moveTo( uint64_t file, int64_t position, float velocity )
+{
+    _file = file;
+    _position = position;
+    _velocity = velocity;
+}
+
+void GrainPlayer::reset()
+{
+    _played[0] = _played[1] = _grain_frames;
+    _until_next = 0;
+}
+
+void GrainPlayer::_startGrain()
+{
+    const int v = _next_voice;
+
+    _cache->read( _file, _position, _voice[v].data(), _grain_frames, _channels );
+    _played[v] = 0;
+    _next_voice ^= 1;
+    _until_next = _hop;
+
+    // where the pointer is heading
+    if ( _velocity != 0 ){
+        _cache->want( _file, _position + (int64_t)( _velocity * SCRUB_LOOKAHEAD_MS / 1000 ) );
+    }
+}
+
+void GrainPlayer::_mix( int v, float *out, int64_t frames )
+{
+    const int64_t n = std::min( frames, _grain_frames - _played[v] );
+    const float *w = _window.data() + _played[v];
+    const float *in = _voice[v].data() + _played[v] * _channels;
+
+    for ( int64_t i = 0; i < n; i++ ){
+        for ( int c = 0; c < _channels; c++ ){
+            out[i * _channels + c] += w[i] * in[i * _channels + c];
+        }
+    }
+    _played[v] += n;
+}
+
+void GrainPlayer::render( float *out, int64_t frames )
+{
+    memset( out, 0, sizeof(float) * frames * _channels );
+
+    while ( frames > 0 ){
+
+        if ( _until_next == 0 ){
+            _startGrain();
+        }
+
+        const int64_t n = std::min( frames, _until_next );
+        _mix( 0, out, n );
+        _mix( 1, out, n );
+
+        _until_next -= n;
+        out += n * _channels;
+        frames -= n;
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+#include <wayver-source.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        /***
+         * Decoded blocks of BLOCK_FRAMES frames, for playing anywhere in
+         * a file without going through its decoder.
+         *
+         *      - A fixed set of BLOCK_CACHE_BLOCKS blocks, keyed by file
+         *      and block index, the least recently read one goes first
+         *      - read() is for the callback: it copies what is there,
+         *      leaves silence for what is not, and queues the misses
+         *      - BLOCK_READERS threads fill the misses, each through
+         *      a Source of its own. A key is queued once until it is
+         *      filled, and the readers sleep until wake() once
+         *      nothing has come for a second
+         *      - A block being read is pinned; a reader wanting it
+         *      takes the key away first, then waits for the pins to go
+        */
+        class BlockCache {
+
+            struct Block {
+                std::atomic<uint64_t> key;
+                std::atomic<int> pins{0};
+
+                // _clock when last read - the smallest is evicted
+                std::atomic<uint64_t> used{0};
+
+                int channels = 0;
+                int64_t frames = 0;
+                std::vector<float> samples;
+            };
+
+            std::unique_ptr<Block[]> _blocks;
+            std::atomic<uint64_t> _clock{0};
+
+            // callback -> readers, one reader pops at a time
+            boost::lockfree::spsc_queue<uint64_t,boost::lockfree::capacity<BLOCK_QUEUE_SIZE>> _wanted;
+            boost::mutex _wanted_mutex;
+
+            // keys queued and not filled yet: the callback fills free slots, readers free them
+            std::atomic<uint64_t> _pending[BLOCK_QUEUE_SIZE];
+
+            // readers with nothing to do wait for this to move
+            std::atomic<uint64_t> _wake_gen{0};
+            boost::mutex _park_mutex;
+            boost::condition_variable _park_cond;
+
+            // who fills what - keys some reader is decoding right now
+            boost::mutex _fill_mutex;
+            std::vector<uint64_t> _filling;
+
+            boost::mutex _files_mutex;
+            // path and the rate it plays at, see openSource()
+            std::map<uint64_t,std::pair<std::string,int>> _files;
+
+            std::vector<boost::thread> _readers;
+            std::atomic<bool> _running{true};
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            Block *_pin( uint64_t key );
+            Block *_find( uint64_t key );
+            bool _claim( uint64_t key );
+            void _request( uint64_t key );
+            void _unpend( uint64_t key );
+            void _publish( uint64_t key, const std::vector<float> &samples, int64_t frames, int channels );
+            void _readLoop();
+
+            public:
+                BlockCache( std::shared_ptr<spdlog::logger> logger );
+                ~BlockCache();
+
+                // a track of a load, see LoadedSource
+                static uint64_t fileId( uint32_t load, int track );
+
+                /***
+                 * What the readers open for file, at samplerate - off the
+                 * audio thread. Drops the files of older loads, and the
+                 * tracks of this one before the one playing out
+                */
+                void setFile( uint64_t file, const std::string &path, int samplerate );
+
+                // readers up - scrubbing is about to ask for blocks. Locks, never from the callback
+                void wake();
+
+                /***
+                 * Callback side: frames from `frame` on into out,
+                 * interleaved. False when some of them were missing -
+                 * those are silent and on their way.
+                */
+                bool read( uint64_t file, int64_t frame, float *out, int64_t frames, int channels );
+
+                // callback side: have the block holding frame read, if it is not there
+                void want( uint64_t file, int64_t frame );
+        };
+
+        /***
+         * Scrub playback: Hann-windowed grains of SCRUB_GRAIN_MS off a
+         * BlockCache, two at a time, each starting half a grain after
+         * the other - the windows overlap-add to exactly one. Every
+         * grain starts wherever the pointer is when it begins.
+         * Callback-owned, allocates only when built.
+        */
+        class GrainPlayer {
+
+            BlockCache *_cache = NULL;
+            int _channels;
+            int _samplerate;
+
+            int64_t _grain_frames;
+            int64_t _hop;
+            std::vector<float> _window;
+
+            std::vector<float> _voice[2];
+            int64_t _played[2];
+            int _next_voice = 0;
+            int64_t _until_next = 0;
+
+            uint64_t _file = 0;
+            int64_t _position = 0;
+            float _velocity = 0;
+
+            void _startGrain();
+            void _mix( int voice, float *out, int64_t frames );
+
+            public:
+                GrainPlayer( int channels, int samplerate );
+
+                void setCache( BlockCache *cache ) { _cache = cache; }
+
+                // pointer at position, moving at velocity frames per second
+                void moveTo( uint64_t file, int64_t position, float velocity );
+
+                // back to silence - the next render starts a fresh grain
+                void reset();
+
+                // overwrites out
+                void render( float *out, int64_t frames );
+        };
+    }
+}
@@ -0,0 +1,341 @@
+#include <wayver-seekindex.hpp>
+#include <wayver-defines.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/chrono.hpp>
+
+using namespace Wayver::Audio;
+
+namespace {
+
+    // SEEK_INDEX section -> this, then the points
+    struct SectionHeader {
+        int64_t audio_offset;
+        uint64_t count;
+    };
+
+    // the longest block FLAC allows - no two frames start further apart
+    const int64_t FLAC_MAX_BLOCK = 65535;
+
+    // frame header CRC: x^8 + x^2 + x + 1, no reflection, starts at 0
+    uint8_t _crc8( const uint8_t *p, size_t n )
+    {
+        uint8_t crc = 0;
+        for ( size_t i = 0; i < n; i++ ){
+            crc ^= p[i];
+            for ( int b = 0; b < 8; b++ ){
+                crc = ( crc & 0x80 ) ? ( crc << 1 ) ^ 0x07 : crc << 1;
+            }
+        }
+        return crc;
+    }
+
+    // FLAC's UTF-8 style coded number, up to 36 bits - bytes used, 0 if malformed
+    int _codedNumber( const uint8_t *p, size_t avail, uint64_t *out )
+    {
+        if ( avail == 0 ){
+            return 0;
+        }
+
+        int extra;
+        uint64_t v;
+
+        if ( !( p[0] & 0x80 ) ){
+            *out = p[0];
+            return 1;
+        } else if ( ( p[0] & 0xE0 ) == 0xC0 ){
+            extra = 1;
+            v = p[0] & 0x1F;
+        } else if ( ( p[0] & 0xF0 ) == 0xE0 ){
+            extra = 2;
+            v = p[0] & 0x0F;
+        } else if ( ( p[0] & 0xF8 ) == 0xF0 ){
+            extra = 3;
+            v = p[0] & 0x07;
+        } else if ( ( p[0] & 0xFC ) == 0xF8 ){
+            extra = 4;
+            v = p[0] & 0x03;
+        } else if ( ( p[0] & 0xFE ) == 0xFC ){
+            extra = 5;
+            v = p[0] & 0x01;
+        } else if ( p[0] == 0xFE ){
+            extra = 6;
+            v = 0;
+        } else {
+            return 0;
+        }
+
+        if ( (size_t)extra >= avail ){
+            return 0;
+        }
+
+        for ( int i = 1; i <= extra; i++ ){
+            if ( ( p[i] & 0xC0 ) != 0x80 ){
+                return 0;
+            }
+            v = ( v << 6 ) | ( p[i] & 0x3F );
+        }
+
+        *out = v;
+        return extra + 1;
+    }
+
+    /***
+     * First sample of the frame whose header starts at p, -1 when
+     * it is not one. Fixed-blocksize streams number frames, not
+     * samples - every frame but the last is block_size long.
+    */
+    int64_t _frameStart( const uint8_t *p, size_t avail, int64_t block_size )
+    {
+        if ( avail < 6 || p[0] != 0xFF || ( p[1] & 0xFE ) != 0xF8 ){
+            return -1;
+        }
+
+        const int block_code = p[2] >> 4;
+        const int rate_code = p[2] & 0x0F;
+        const int channel_code = p[3] >> 4;
+        const int bits_code = ( p[3] >> 1 ) & 0x07;
+
+        if ( block_code == 0 || rate_code == 15 || channel_code > 10 || bits_code == 3 || ( p[3] & 1 ) ){
+            return -1;
+        }
+
+        uint64_t number;
+        const int used = _codedNumber( p + 4, avail - 4, &number );
+        if ( used == 0 ){
+            return -1;
+        }
+
+        size_t at = 4 + used;
+        at += block_code == 6 ? 1 : block_code == 7 ? 2 : 0;
+        at += rate_code == 12 ? 1 : ( rate_code == 13 || rate_code == 14 ) ? 2 : 0;
+
+        if ( at >= avail || _crc8( p, at ) != p[at] ){
+            return -1;
+        }
+
+        const bool variable = p[1] & 1;
+        return variable ? (int64_t)number : (int64_t)number * block_size;
+    }
+}
+
+SeekIndex::SeekIndex( std::shared_ptr<spdlog::logger> logger )
+:_logger(logger)
+{
+}
+
+SeekIndex::~SeekIndex()
+{
+    _abort = true;
+    if ( _thread.joinable() ){
+        _thread.join();
+    }
+}
+
+/*static*/ bool SeekIndex::covers( const SF_INFO &info )
+{
+    return ( info.format & SF_FORMAT_TYPEMASK ) == SF_FORMAT_FLAC;
+}
+
+void SeekIndex::buildAsync( const std::string &path )
+{
+    _thread = boost::thread( &SeekIndex::build, this, path );
+}
+
+void SeekIndex::build( const std::string &path )
+{
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ){
+        _logger->warn("SeekIndex - could not open {}", path);
+        return;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+
+    if ( fstat( fd, &st ) == 0 && st.st_size > 0 ){
+        map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    }
+    ::close( fd );
+
+    if ( map == MAP_FAILED ){
+        _logger->warn("SeekIndex - could not map {}", path);
+        return;
+    }
+
+    madvise( map, st.st_size, MADV_SEQUENTIAL );
+    const bool scanned = _scan( (const uint8_t*)map, st.st_size );
+    munmap( map, st.st_size );
+
+    if ( !scanned ){
+        if ( !_abort ){
+            _logger->warn("SeekIndex - {} does not look like FLAC, seeking through libsndfile", path);
+        }
+        return;
+    }
+
+    _ready.store( true, std::memory_order_release );
+    _store( path );
+
+    _logger->info(
+        "SeekIndex - {} points over {} MB, {} ms",
+        _points.size(),
+        st.st_size >> 20,
+        boost::chrono::duration_cast<boost::chrono::milliseconds>(
+            boost::chrono::steady_clock::now() - start ).count() );
+}
+
+/***
+ * Metadata first: STREAMINFO has the block sizes and rate, and the
+ * last block ends where frames start. Then every 0xFF that opens a
+ * header with a good CRC and carries on the count - the next frame
+ * number with a fixed block size, a sample no more than a block on
+ * otherwise. Whatever else inside the compressed data happens to
+ * look like a header fails one of those.
+*/
+bool SeekIndex::_scan( const uint8_t *p, size_t size )
+{
+    size_t at = 0;
+
+    // some taggers put ID3v2 in front
+    if ( size >= 10 && memcmp( p, "ID3", 3 ) == 0 ){
+        at = 10 + ( ( p[6] & 0x7F ) << 21 | ( p[7] & 0x7F ) << 14 | ( p[8] & 0x7F ) << 7 | ( p[9] & 0x7F ) );
+    }
+
+    if ( at + 4 > size || memcmp( p + at, "fLaC", 4 ) != 0 ){
+        return false;
+    }
+    at += 4;
+
+    int64_t block_size = 0;
+    int64_t max_block_size = 0;
+    int64_t samplerate = 0;
+    bool last = false;
+
+    while ( !last ){
+
+        if ( at + 4 > size ){
+            return false;
+        }
+
+        last = p[at] & 0x80;
+        const int type = p[at] & 0x7F;
+        const size_t length = p[at + 1] << 16 | p[at + 2] << 8 | p[at + 3];
+        at += 4;
+
+        if ( at + length > size ){
+            return false;
+        }
+
+        // STREAMINFO
+        if ( type == 0 && length >= 18 ){
+            block_size = p[at] << 8 | p[at + 1];
+            max_block_size = p[at + 2] << 8 | p[at + 3];
+            samplerate = p[at + 10] << 12 | p[at + 11] << 4 | p[at + 12] >> 4;
+        }
+
+        at += length;
+    }
+
+    if ( block_size == 0 || samplerate == 0 ){
+        return false;
+    }
+
+    _audio_offset = at;
+
+    const int64_t spacing = samplerate * SEEK_INDEX_SPACING_MS / 1000;
+    const bool fixed = block_size == max_block_size;
+    int64_t previous = -1;
+
+    while ( at + 1 < size && !_abort ){
+
+        const uint8_t *hit = (const uint8_t*)memchr( p + at, 0xFF, size - at - 1 );
+        if ( hit == NULL ){
+            break;
+        }
+        at = hit - p;
+
+        const int64_t sample = _frameStart( hit, size - at, block_size );
+        const bool follows = previous < 0
+            ? sample == 0
+            : fixed 
+                ? sample == previous + block_size 
+                : sample > previous && sample - previous <= FLAC_MAX_BLOCK;
+
+        if ( follows ){
+            if ( _points.empty() || sample - _points.back().frame >= spacing ){
+                _points.push_back( { sample, (int64_t)at } );
+            }
+            previous = sample;
+        }
+
+        at++;
+    }
+
+    return !_abort && !_points.empty();
+}
+
+void SeekIndex::_store( const std::string &path )
+{
+    std::vector<uint8_t> bytes( sizeof(SectionHeader) );
+
+    SectionHeader *h = (SectionHeader*)bytes.data();
+    h->audio_offset = _audio_offset;
+    h->count = _points.size();
+
+    const uint8_t *p = (const uint8_t*)_points.data();
+    bytes.insert( bytes.end(), p, p + _points.size() * sizeof(SeekPoint) );
+
+    if ( !Cache::store( path, Cache::SEEK_INDEX, bytes.data(), bytes.size() ) ){
+        _logger->warn("SeekIndex - could not write the analysis cache for {}", path);
+    }
+}
+
+bool SeekIndex::loadFrom( const Cache::Entry &entry )
+{
+    size_t size;
+    const uint8_t *p = entry.section( Cache::SEEK_INDEX, &size );
+
+    if ( p == NULL || size < sizeof(SectionHeader) ){
+        return false;
+    }
+
+    const SectionHeader *h = (const SectionHeader*)p;
+    if ( h->count == 0 || size != sizeof(SectionHeader) + h->count * sizeof(SeekPoint) ){
+        return false;
+    }
+
+    const SeekPoint *points = (const SeekPoint*)( p + sizeof(SectionHeader) );
+    _points.assign( points, points + h->count );
+    _audio_offset = h->audio_offset;
+
+    _ready.store( true, std::memory_order_release );
+    return true;
+}
+
+bool SeekIndex::find( int64_t frame, SeekPoint *out ) const
+{
+    if ( !isReady() ){
+        return false;
+    }
+
+    std::vector<SeekPoint>::const_iterator it = std::upper_bound(
+        _points.begin(), _points.end(), frame,
+        []( int64_t f, const SeekPoint &point ){ return f < point.frame; } );
+
+    if ( it == _points.begin() ){
+        return false;
+    }
+
+    *out = *( it - 1 );
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <wayver-cache.hpp>
+
+#include <sndfile.hh>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        // a frame decoding can restart at, and the file offset its data starts at
+        struct SeekPoint {
+            int64_t frame;
+            int64_t offset;
+        };
+
+        /***
+         * Seek points into a FLAC file, about SEEK_INDEX_SPACING_MS apart.
+         *
+         *      - Every FLAC frame header carries its first sample and a
+         *      CRC-8, so a scan over the mapped file finds them without
+         *      decoding a thing
+         *      - The file's metadata followed by everything from one of
+         *      them on is itself a valid stream that decodes exactly
+         *      like the original from there, see SndfileSource::seek()
+         *      - Built on its own thread, usable once isReady();
+         *      stored in the analysis cache for later runs
+        */
+        class SeekIndex {
+
+            std::vector<SeekPoint> _points;
+
+            // first byte after the metadata blocks
+            int64_t _audio_offset = 0;
+
+            std::atomic<bool> _ready{false};
+            std::atomic<bool> _abort{false};
+            boost::thread _thread;
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            bool _scan( const uint8_t *p, size_t size );
+            void _store( const std::string &path );
+
+            public:
+                SeekIndex( std::shared_ptr<spdlog::logger> logger );
+                ~SeekIndex();
+
+                // formats libsndfile seeks by searching and the scan can read
+                static bool covers( const SF_INFO &info );
+
+                void build( const std::string &path );
+
+                // on a background thread, isReady() flips when done
+                void buildAsync( const std::string &path );
+
+                // false when the cache has none
+                bool loadFrom( const Cache::Entry &entry );
+
+                bool isReady() const { return _ready.load( std::memory_order_acquire ); }
+
+                // once ready - the last point at or before frame
+                bool find( int64_t frame, SeekPoint *out ) const;
+
+                int64_t audioOffset() const { return _audio_offset; }
+        };
+    }
+}
@@ -0,0 +1,312 @@
+#include <wayver-source.hpp>
+#include <wayver-pcm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Wayver::Audio;
+
+namespace {
+
+    sf_count_t _spliceLength( void *user )
+    {
+        const SplicedFile *f = (const SplicedFile*)user;
+        return f->head_bytes + f->file_bytes - f->from;
+    }
+
+    sf_count_t _spliceSeek( sf_count_t offset, int whence, void *user )
+    {
+        SplicedFile *f = (SplicedFile*)user;
+
+        switch ( whence ){
+            case SEEK_SET: f->pos = offset; break;
+            case SEEK_CUR: f->pos += offset; break;
+            case SEEK_END: f->pos = _spliceLength( user ) + offset; break;
+        }
+        return f->pos;
+    }
+
+    // the head straight through, the rest shifted on to `from`
+    sf_count_t _spliceRead( void *out, sf_count_t count, void *user )
+    {
+        SplicedFile *f = (SplicedFile*)user;
+        sf_count_t done = 0;
+
+        while ( done < count ){
+
+            const bool in_head = f->pos < f->head_bytes;
+            const int64_t at = in_head ? f->pos : f->from + f->pos - f->head_bytes;
+            const int64_t want = in_head ? std::min<int64_t>( count - done, f->head_bytes - f->pos ) : count - done;
+
+            const ssize_t n = pread( f->fd, (uint8_t*)out + done, want, at );
+            if ( n <= 0 ){
+                break;
+            }
+
+            f->pos += n;
+            done += n;
+        }
+        return done;
+    }
+
+    sf_count_t _spliceWrite( const void *, sf_count_t, void * )
+    {
+        return 0;
+    }
+
+    sf_count_t _spliceTell( void *user )
+    {
+        return ((SplicedFile*)user)->pos;
+    }
+
+    SF_VIRTUAL_IO SPLICE_IO = { _spliceLength, _spliceSeek, _spliceRead, _spliceWrite, _spliceTell };
+}
+
+SndfileSource::SndfileSource( const std::string &path )
+:_path(path)
+{
+    _info.format = 0;
+    _file = sf_open( path.c_str(), SFM_READ, &_info );
+
+    if ( _file == NULL ){
+        throw std::runtime_error("Could not open " + path + ": " + sf_strerror(NULL));
+    }
+}
+
+SndfileSource::~SndfileSource()
+{
+    sf_close( _file );
+
+    if ( _fd >= 0 ){
+        ::close( _fd );
+    }
+}
+
+void SndfileSource::useSeekIndex( std::shared_ptr<const SeekIndex> index )
+{
+    _index = index;
+}
+
+int64_t SndfileSource::readFrames( float *out, int64_t frames )
+{
+    sf_count_t n_read = sf_readf_float( _file, out, frames );
+    return n_read > 0 ? n_read : 0;
+}
+
+/***
+ * sf_seek() on FLAC is a search over the file, each probe a read
+ * and a frame decode. From an index point it is one open and at
+ * most SEEK_INDEX_SPACING_MS of decoding. Without a point before
+ * the target, back to the plain file and libsndfile's own seek.
+*/
+bool SndfileSource::seek( int64_t frame )
+{
+    SeekPoint point;
+
+    if ( _index != NULL && _index->find( frame, &point ) && point.frame > 0 ){
+        if ( _reopen( &point ) ){
+            return _skip( frame - point.frame );
+        }
+    }
+
+    if ( _splice != NULL && !_reopen( NULL ) ){
+        return false;
+    }
+
+    return sf_seek( _file, frame, SF_SEEK_SET ) >= 0;
+}
+
+// point NULL -> the file as it is; the old handle stays on any failure
+bool SndfileSource::_reopen( const SeekPoint *point )
+{
+    std::unique_ptr<SplicedFile> splice;
+    SF_INFO info;
+    info.format = 0;
+    SNDFILE *file;
+
+    if ( point == NULL ){
+        file = sf_open( _path.c_str(), SFM_READ, &info );
+    } else {
+        struct stat st;
+
+        if ( _fd < 0 ){
+            _fd = ::open( _path.c_str(), O_RDONLY );
+        }
+        if ( _fd < 0 || fstat( _fd, &st ) != 0 ){
+            return false;
+        }
+
+        splice.reset( new SplicedFile{ _fd, _index->audioOffset(), point->offset, (int64_t)st.st_size } );
+        file = sf_open_virtual( &SPLICE_IO, SFM_READ, &info, splice.get() );
+    }
+
+    if ( file == NULL ){
+        return false;
+    }
+
+    if ( info.channels != _info.channels || info.samplerate != _info.samplerate ){
+        sf_close( file );
+        return false;
+    }
+
+    sf_close( _file );
+    _file = file;
+    _splice = std::move( splice );
+
+    return true;
+}
+
+bool SndfileSource::_skip( int64_t frames )
+{
+    _discard.resize( (size_t)DECODER_CHUNK_FRAMES * _info.channels );
+
+    while ( frames > 0 ){
+        const int64_t n = readFrames( _discard.data(), std::min<int64_t>( frames, DECODER_CHUNK_FRAMES ) );
+        if ( n == 0 ){
+            return false;
+        }
+        frames -= n;
+    }
+    return true;
+}
+
+ToneSource::ToneSource( int channels, int samplerate, int64_t frames )
+{
+    memset( &_info, 0, sizeof(_info) );
+    _info.frames = frames;
+    _info.samplerate = samplerate;
+    _info.channels = channels;
+    _info.format = SF_FORMAT_RAW | SF_FORMAT_FLOAT;
+    _info.sections = 1;
+    _info.seekable = 1;
+}
+
+// 440 Hz on the first channel, a fifth higher on each one after
+int64_t ToneSource::readFrames( float *out, int64_t frames )
+{
+    const int64_t n = std::max<int64_t>( 0, std::min( frames, _info.frames - _frame ) );
+
+    for ( int64_t f = 0; f < n; f++ ){
+        for ( int c = 0; c < _info.channels; c++ ){
+            const double hz = 440 * pow( 1.5, c );
+            out[ f * _info.channels + c ] = 0.5f * sin( 2 * M_PI * hz * ( _frame + f ) / _info.samplerate );
+        }
+    }
+
+    _frame += n;
+    return n;
+}
+
+bool ToneSource::seek( int64_t frame )
+{
+    if ( frame < 0 || frame > _info.frames ){
+        return false;
+    }
+    _frame = frame;
+    return true;
+}
+
+ResampledSource::ResampledSource( Source *inner, int samplerate )
+:_inner(inner),
+_info(inner->info()),
+_resampler(inner->info().channels, inner->info().samplerate, samplerate),
+_chunk((size_t)DECODER_CHUNK_FRAMES * inner->info().channels)
+{
+    const int64_t up = _resampler.up();
+    const int64_t down = _resampler.down();
+
+    _info.samplerate = samplerate;
+    _info.frames = ( _info.frames * up + down - 1 ) / down;
+}
+
+int64_t ResampledSource::readFrames( float *out, int64_t frames )
+{
+    const int channels = _info.channels;
+    const int64_t want = std::max<int64_t>( 0, std::min( frames, _info.frames - _out_pos ) );
+    int64_t n = 0;
+
+    while ( n < want ){
+
+        n += _resampler.read( out + n * channels, want - n );
+        if ( n == want || _tail == 0 ){
+            break;
+        }
+
+        int64_t got = 0;
+        const int64_t room = std::min<int64_t>( _resampler.space(), DECODER_CHUNK_FRAMES );
+
+        if ( _tail < 0 ){
+            got = _inner->readFrames( _chunk.data(), room );
+            if ( got == 0 ){
+                _tail = _resampler.history() + 1;
+            }
+        }
+
+        // past the end: silence, until the kernel has played out the last frames
+        if ( _tail > 0 ){
+            got = std::min( room, _tail );
+            memset( _chunk.data(), 0, sizeof(float) * got * channels );
+            _tail -= got;
+        }
+
+        if ( got == 0 ){
+            break;
+        }
+        _resampler.write( _chunk.data(), got );
+    }
+
+    _out_pos += n;
+    return n;
+}
+
+bool ResampledSource::seek( int64_t frame )
+{
+    if ( frame < 0 || frame > _info.frames ){
+        return false;
+    }
+
+    const int64_t up = _resampler.up();
+    const int64_t down = _resampler.down();
+
+    const int64_t base = frame * down / up;
+    const int64_t from = std::max<int64_t>( 0, base - _resampler.history() );
+
+    if ( !_inner->seek( from ) ){
+        return false;
+    }
+
+    _resampler.reset( base - from, (int)( frame * down % up ) );
+    _out_pos = frame;
+    _tail = -1;
+    return true;
+}
+
+Source *Wayver::Audio::openSource( const std::string &path, std::shared_ptr<spdlog::logger> logger, int samplerate )
+{
+    Source *source = MappedPcmSource::open( path );
+
+    if ( source == NULL ){
+        source = new SndfileSource( path );
+    }
+
+    const int from = source->info().samplerate;
+
+    if ( samplerate > 0 && from != samplerate ){
+        if ( RatioFilter::get( from, samplerate ) == NULL ){
+            delete source;
+            throw std::runtime_error("Cannot convert " + path + " from " + std::to_string( from ) + " to " + std::to_string( samplerate ) + " Hz");
+        }
+
+        logger->debug("openSource() - {} converted {} -> {} Hz", path, from, samplerate);
+        source = new ResampledSource( source, samplerate );
+    }
+
+    logger->debug("openSource() - {} via {}", path, source->kind());
+    return source;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <wayver-resampler.hpp>
+#include <wayver-seekindex.hpp>
+
+#include <sndfile.hh>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        /***
+         * Where decoded frames come from.
+         *
+         *      - Interleaved float out, whatever is on disk
+         *      - One reader at a time - not thread safe
+        */
+        class Source {
+            public:
+                virtual ~Source() {}
+
+                virtual const SF_INFO &info() const = 0;
+
+                // up to `frames` frames into out, 0 once the file is exhausted
+                virtual int64_t readFrames( float *out, int64_t frames ) = 0;
+
+                virtual bool seek( int64_t frame ) = 0;
+
+                // seek points someone else builds - only the slow seekers use them
+                virtual void useSeekIndex( std::shared_ptr<const SeekIndex> index ) {}
+
+                // for the log
+                virtual const char *kind() const = 0;
+        };
+
+        /***
+         * A file seen as its first head_bytes, then everything from
+         * byte `from` on - libsndfile reads it through SF_VIRTUAL_IO
+        */
+        struct SplicedFile {
+            int fd;
+            int64_t head_bytes;
+            int64_t from;
+            int64_t file_bytes;
+            int64_t pos = 0;
+        };
+
+        /***
+         * Anything libsndfile can open - compressed formats
+         * and every PCM layout the mapped path turns down.
+         *
+         *      - With a SeekIndex, a seek reopens the file spliced at
+         *      the nearest point before the target and decodes the
+         *      rest of the way, instead of sf_seek()'s search
+        */
+        class SndfileSource : public Source {
+
+            SNDFILE *_file = NULL;
+            SF_INFO _info;
+            std::string _path;
+
+            std::shared_ptr<const SeekIndex> _index;
+            int _fd = -1;
+            std::unique_ptr<SplicedFile> _splice;
+
+            // decoded on the way from a seek point to the target
+            std::vector<float> _discard;
+
+            bool _reopen( const SeekPoint *point );
+            bool _skip( int64_t frames );
+
+            public:
+                // throws if libsndfile cannot open the file
+                SndfileSource( const std::string &path );
+                ~SndfileSource();
+
+                const SF_INFO &info() const override { return _info; }
+                int64_t readFrames( float *out, int64_t frames ) override;
+                bool seek( int64_t frame ) override;
+                void useSeekIndex( std::shared_ptr<const SeekIndex> index ) override;
+                const char *kind() const override { return "libsndfile"; }
+        };
+
+        /***
+         * A sine per channel, `frames` long - the benchmarks
+         * play this so they need no file on disk.
+        */
+        class ToneSource : public Source {
+
+            SF_INFO _info;
+            int64_t _frame = 0;
+
+            public:
+                ToneSource( int channels, int samplerate, int64_t frames );
+
+                const SF_INFO &info() const override { return _info; }
+                int64_t readFrames( float *out, int64_t frames ) override;
+                bool seek( int64_t frame ) override;
+                const char *kind() const override { return "tone"; }
+        };
+
+        /***
+         * Another Source converted to a fixed rate - whoever reads it,
+         * usually the decoder thread, does the filtering.
+         *
+         *      - info() is the inner source's at the new rate, frames
+         *      scaled to match
+         *      - A seek lands the inner source the kernel's reach early
+         *      and starts the filter on the exact phase, so output is
+         *      the same however it was got to
+         *      - Takes ownership of inner
+        */
+        class ResampledSource : public Source {
+
+            std::unique_ptr<Source> _inner;
+            SF_INFO _info;
+            RatioResampler _resampler;
+
+            std::vector<float> _chunk;
+            int64_t _out_pos = 0;
+
+            // silence still to feed past the inner source's end, -1 until it is reached
+            int64_t _tail = -1;
+
+            public:
+                // throws if either rate is not positive
+                ResampledSource( Source *inner, int samplerate );
+
+                const SF_INFO &info() const override { return _info; }
+                int64_t readFrames( float *out, int64_t frames ) override;
+                bool seek( int64_t frame ) override;
+                void useSeekIndex( std::shared_ptr<const SeekIndex> index ) override { _inner->useSeekIndex( index ); }
+                const char *kind() const override { return "resampled"; }
+        };
+
+        /***
+         * Mapped PCM when the file allows it, libsndfile otherwise.
+         * Throws if neither can read it. Caller owns the result.
+         *
+         *      - samplerate > 0: converted to that rate when the file
+         *      is at another one. Throws if the file's rate is not
+         *      one it can be converted from
+        */
+        Source *openSource( const std::string &path, std::shared_ptr<spdlog::logger> logger, int samplerate = 0 );
+    }
+}
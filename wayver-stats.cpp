@@ -0,0 +1,118 @@
+#include <wayver-stats.hpp>
+
+#include <algorithm>
+#include <math.h>
+
+using namespace Wayver::Stats;
+
+void Timings::add( double value )
+{
+    _samples.push_back( value );
+    _sorted = false;
+}
+
+double Timings::total() const
+{
+    double sum = 0;
+    for ( double v : _samples ){
+        sum += v;
+    }
+    return sum;
+}
+
+double Timings::max()
+{
+    return percentile( 100 );
+}
+
+double Timings::percentile( double p )
+{
+    if ( _samples.empty() ){
+        return 0;
+    }
+
+    if ( !_sorted ){
+        std::sort( _samples.begin(), _samples.end() );
+        _sorted = true;
+    }
+
+    size_t rank = (size_t)ceil( p / 100 * _samples.size() );
+    rank = std::min( std::max<size_t>( rank, 1 ), _samples.size() );
+    return _samples[ rank - 1 ];
+}
+
+Histogram::Histogram()
+{
+    for ( int i = 0; i < _BUCKETS; i++ ){
+        _counts[i].store( 0, std::memory_order_relaxed );
+    }
+}
+
+/***
+ * Below _SUB values map to themselves. Above, the top bit picks
+ * the power of two and the _SUB_BITS under it the sub-bucket, so
+ * the buckets run on without gaps: 7, 8, 9 .. 15, 16, 18 .. 30, 32 ..
+*/
+/*static*/ int Histogram::_index( uint64_t value )
+{
+    if ( value < (uint64_t)_SUB ){
+        return (int)value;
+    }
+
+    const int top = 63 - __builtin_clzll( value );
+    const int sub = ( value >> ( top - _SUB_BITS ) ) & ( _SUB - 1 );
+
+    return std::min( ( top - _SUB_BITS + 1 ) * _SUB + sub, _BUCKETS - 1 );
+}
+
+/*static*/ uint64_t Histogram::_upper( int i )
+{
+    if ( i < _SUB ){
+        return i;
+    }
+
+    const int octave = i / _SUB;
+    const int sub = i % _SUB;
+
+    return ( (uint64_t)( _SUB + sub + 1 ) << ( octave - 1 ) ) - 1;
+}
+
+void Histogram::record( uint64_t value )
+{
+    std::atomic<uint32_t> &c = _counts[ _index( value ) ];
+    c.store( c.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+
+    _total.store( _total.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+
+    if ( value > _max.load( std::memory_order_relaxed ) ){
+        _max.store( value, std::memory_order_relaxed );
+    }
+}
+
+uint64_t Histogram::percentile( double p ) const
+{
+    uint64_t counts[_BUCKETS];
+    uint64_t total = 0;
+
+    // one pass over the counters, so rank and buckets agree
+    for ( int i = 0; i < _BUCKETS; i++ ){
+        counts[i] = _counts[i].load( std::memory_order_relaxed );
+        total += counts[i];
+    }
+
+    if ( total == 0 ){
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>( 1, (uint64_t)ceil( p / 100 * total ) );
+    uint64_t seen = 0;
+
+    for ( int i = 0; i < _BUCKETS; i++ ){
+        seen += counts[i];
+        if ( seen >= rank ){
+            return std::min( _upper( i ), max() );
+        }
+    }
+
+    return max();
+}
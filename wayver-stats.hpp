@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Wayver {
+
+    namespace Stats {
+
+        /***
+         * Durations kept raw, sorted only when asked for a
+         * percentile - for offline runs, where every sample counts
+         * and allocation does not matter. reserve() up front keeps
+         * add() from allocating mid-run.
+        */
+        class Timings {
+
+            std::vector<double> _samples;
+            bool _sorted = true;
+
+            public:
+                void reserve( size_t n ) { _samples.reserve( n ); }
+                void add( double value );
+
+                size_t count() const { return _samples.size(); }
+                double total() const;
+                double max();
+
+                // p in [0, 100], nearest rank
+                double percentile( double p );
+        };
+
+        /***
+         * HDR-style histogram for the audio thread.
+         *
+         *      - Power of two buckets, each split into _SUB linear
+         *      sub-buckets: any value up to 2^40 is kept to within
+         *      1 / _SUB of itself in a fixed 1.2 KB, never allocating
+         *      - One writer: record() is a relaxed load + store per
+         *      counter, wait-free and cheap enough for the callback
+         *      - Readers may look at any time; what they see may be
+         *      a record or two behind, never torn
+        */
+        class Histogram {
+
+            static const int _SUB_BITS = 3;
+            static const int _SUB = 1 << _SUB_BITS;
+            static const int _BUCKETS = 38 * _SUB;
+
+            std::atomic<uint32_t> _counts[_BUCKETS];
+            std::atomic<uint64_t> _total{0};
+            std::atomic<uint64_t> _max{0};
+
+            static int _index( uint64_t value );
+
+            // largest value that lands in bucket i
+            static uint64_t _upper( int i );
+
+            public:
+                Histogram();
+
+                // writer only
+                void record( uint64_t value );
+
+                uint64_t count() const { return _total.load( std::memory_order_relaxed ); }
+                uint64_t max() const { return _max.load( std::memory_order_relaxed ); }
+
+                // p in [0, 100] - the upper edge of the bucket holding it
+                uint64_t percentile( double p ) const;
+        };
+    }
+}
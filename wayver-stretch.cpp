@@ -0,0 +1,500 @@
+#include <wayver-stretch.hpp>
+#include <wayver-fft.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+#include <boost/chrono.hpp>
+
+using namespace Wayver::Audio;
+
+namespace {
+
+    const char *MODE_NAMES[STRETCH_MODE_COUNT] = { "wsola", "vocoder" };
+
+    // power of two nearest to ms at samplerate - the vocoder's FFT size
+    int _frameLength( int samplerate, int ms )
+    {
+        return 1 << (int)round( log2( samplerate * ms / 1000.0 ) );
+    }
+
+    float _wrap( float phase )
+    {
+        return phase - 2 * (float)M_PI * roundf( phase / ( 2 * (float)M_PI ) );
+    }
+}
+
+bool Wayver::Audio::parseStretchMode( const char *name, StretchMode *out )
+{
+    for ( int m = 0; m < STRETCH_MODE_COUNT; m++ ){
+        if ( strcmp( name, MODE_NAMES[m] ) == 0 ){
+            *out = (StretchMode)m;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *Wayver::Audio::stretchModeName( StretchMode mode )
+{
+    return MODE_NAMES[mode];
+}
+
+/***
+ * Rings sized for the worst hop: the input one holds a frame, the
+ * splice search and a hop read at STRETCH_MAX_TEMPO either way; the
+ * output one the lead plus the largest buffer the tuner may pick.
+*/
+Stretcher::Stretcher( int channels, int samplerate, StretchMode mode, std::shared_ptr<spdlog::logger> logger )
+:_mode(mode),
+_channels(channels),
+_window(_frameLength( samplerate, mode == STRETCH_WSOLA ? STRETCH_WSOLA_MS : STRETCH_VOCODER_MS )),
+_hop(mode == STRETCH_WSOLA ? _window / 2 : _window / 4),
+_seek(mode == STRETCH_WSOLA ? samplerate * STRETCH_WSOLA_SEEK_MS / 1000 : 0),
+_decimate(std::max( 1, samplerate / 12000 )),
+_ahead((size_t)samplerate * STRETCH_AHEAD_MS / 1000),
+_in(_window + 2 * _seek + (size_t)( 2 * _hop * STRETCH_MAX_TEMPO ), channels),
+_out(_ahead + TUNE_MAX_FRAMES + _hop, channels),
+_logger(logger)
+{
+    const int bins = _window / 2 + 1;
+    const size_t buf_frames = _window + 2 * _seek + (size_t)( 2 * _hop * STRETCH_MAX_TEMPO ) + _hop;
+
+    _buf.assign( buf_frames * channels, 0 );
+    _mono.assign( buf_frames, 0 );
+    _acc.assign( (size_t)_window * channels, 0 );
+
+    _win.resize( _window );
+    for ( int n = 0; n < _window; n++ ){
+        _win[n] = 0.5f - 0.5f * cosf( 2 * (float)M_PI * n / _window );
+    }
+
+    if ( mode == STRETCH_VOCODER ){
+        _fft_in = fftwf_alloc_real( _window );
+        _fft_out = fftwf_alloc_complex( bins );
+        _r2c = Fft::planR2C( _window );
+        _c2r = Fft::planC2R( _window );
+
+        _phase_in.assign( (size_t)bins * channels, 0 );
+        _phase_out.assign( (size_t)bins * channels, 0 );
+        _mag.resize( bins );
+        _phase.resize( bins );
+        _peaks.reserve( bins );
+    }
+
+    _reset();
+
+    _logger->debug("Stretcher - {}, {} frame window, {} frame hop", MODE_NAMES[mode], _window, _hop);
+}
+
+Stretcher::~Stretcher()
+{
+    {
+        boost::lock_guard<boost::mutex> lock( _park_mutex );
+        _running = false;
+    }
+    _park_cond.notify_one();
+
+    if ( _thread.joinable() ){
+        _thread.join();
+    }
+
+    if ( _fft_in != NULL ){
+        fftwf_free( _fft_in );
+        fftwf_free( _fft_out );
+    }
+}
+
+void Stretcher::want( bool on )
+{
+    {
+        boost::lock_guard<boost::mutex> lock( _park_mutex );
+        _wanted = on;
+
+        if ( on && !_thread.joinable() ){
+            _thread = boost::thread( &Stretcher::_loop, this );
+        }
+    }
+    _park_cond.notify_one();
+}
+
+void Stretcher::setTempo( double tempo )
+{
+    _tempo.store( tempo, std::memory_order_relaxed );
+}
+
+size_t Stretcher::push( const float *in, size_t frames )
+{
+    return _in.write( in, frames );
+}
+
+size_t Stretcher::pull( float *out, size_t frames )
+{
+    if ( frames > _max_pull.load( std::memory_order_relaxed ) ){
+        _max_pull.store( frames, std::memory_order_relaxed );
+    }
+
+    if ( _flushing ){
+        if ( _flush_served.load( std::memory_order_acquire ) != _flush_ticket ){
+            return 0;
+        }
+        _out.skipTo( _flush_out_pos.load( std::memory_order_relaxed ) );
+        _flushing = false;
+    }
+
+    return _out.read( out, frames );
+}
+
+void Stretcher::flush()
+{
+    _draining.store( false, std::memory_order_relaxed );
+    _flush_in_pos.store( _in.writePosition(), std::memory_order_relaxed );
+    _flush_ticket = _flush_request.fetch_add( 1, std::memory_order_release ) + 1;
+    _flushing = true;
+}
+
+void Stretcher::drain()
+{
+    _draining.store( true, std::memory_order_release );
+}
+
+bool Stretcher::drained() const
+{
+    return !_flushing && _drained.load( std::memory_order_acquire ) && _out.readAvailable() == 0;
+}
+
+int64_t Stretcher::behind() const
+{
+    if ( _flushing ){
+        return _in.writePosition() - _flush_in_pos.load( std::memory_order_relaxed );
+    }
+
+    return _in.readAvailable()
+        + _held.load( std::memory_order_relaxed )
+        + (int64_t)( _out.readAvailable() * tempo() );
+}
+
+
+/***
+ * Worker
+*/
+bool Stretcher::_flushPending() const
+{
+    return _flush_request.load( std::memory_order_acquire ) != _flush_served.load( std::memory_order_relaxed );
+}
+
+// under _park_mutex - nothing asked of the worker until want( true )
+bool Stretcher::_parked() const
+{
+    return _running && !_wanted && tempo() == 1 && !_flushPending();
+}
+
+void Stretcher::_loop()
+{
+    int idle_ms = 1000;
+
+    while ( _running ){
+
+        {
+            boost::unique_lock<boost::mutex> lock( _park_mutex );
+            while ( _parked() ){
+                _park_cond.wait( lock );
+                idle_ms = 1000;
+            }
+        }
+
+        if ( _flushPending() ){
+            _serveFlush();
+        }
+
+        // no further ahead than the callback needs
+        const size_t lead = std::min( _out.capacity() - _hop, _ahead + _max_pull.load( std::memory_order_relaxed ) );
+
+        if ( !_drained.load( std::memory_order_relaxed )
+            && _out.readAvailable() + _hop <= lead
+            && _hopOnce() ){
+            idle_ms = 0;
+            continue;
+        }
+
+        const int wait_ms = idle_ms < 1000 ? STRETCH_POLL_MS : STRETCH_IDLE_MS;
+        boost::this_thread::sleep_for( boost::chrono::milliseconds( wait_ms ) );
+        idle_ms += wait_ms;
+    }
+}
+
+void Stretcher::_serveFlush()
+{
+    const uint32_t ticket = _flush_request.load( std::memory_order_acquire );
+
+    _in.skipTo( _flush_in_pos.load( std::memory_order_relaxed ) );
+    _reset();
+
+    _flush_out_pos.store( _out.writePosition(), std::memory_order_relaxed );
+    _flush_served.store( ticket, std::memory_order_release );
+}
+
+/***
+ * Silence before the first input frame, half a window of it, so the
+ * first frame heard at full weight is input frame 0.
+*/
+void Stretcher::_reset()
+{
+    const int64_t pad = _window / 2 + _seek;
+
+    memset( _buf.data(), 0, sizeof(float) * pad * _channels );
+    memset( _mono.data(), 0, sizeof(float) * pad );
+    std::fill( _acc.begin(), _acc.end(), 0 );
+
+    _buf_start = -pad;
+    _buf_frames = pad;
+    _in_read = 0;
+
+    _a_pos = -_window / 2;
+    _prev = -1;
+    _first = true;
+
+    _held.store( 0, std::memory_order_relaxed );
+    _drained.store( false, std::memory_order_relaxed );
+}
+
+/***
+ * Input up to frame until, out of the ring. Short -> false, unless
+ * the callback is draining: then silence makes up the rest. Also
+ * false once a flush is asked for: what was peeked may already be
+ * from past it, so nothing is taken and _serveFlush() skips to the
+ * exact frame the callback flushed at.
+*/
+bool Stretcher::_fill( int64_t until )
+{
+    while ( _buf_start + _buf_frames < until ){
+
+        const int64_t want = until - _buf_start - _buf_frames;
+        float *dst = _buf.data() + _buf_frames * _channels;
+
+        const float *a, *b;
+        size_t n_a, n_b;
+        const size_t got = _in.peek( want, &a, &n_a, &b, &n_b );
+
+        if ( _flushPending() ){
+            return false;
+        }
+
+        memcpy( dst, a, sizeof(float) * n_a * _channels );
+        memcpy( dst + n_a * _channels, b, sizeof(float) * n_b * _channels );
+        _in.consume( got );
+
+        if ( got == 0 ){
+            if ( !_draining.load( std::memory_order_acquire ) || _in.readAvailable() > 0 ){
+                return false;
+            }
+            memset( dst, 0, sizeof(float) * want * _channels );
+            memset( _mono.data() + _buf_frames, 0, sizeof(float) * want );
+            _buf_frames += want;
+            continue;
+        }
+
+        for ( size_t f = 0; f < got; f++ ){
+            float sum = 0;
+            for ( int c = 0; c < _channels; c++ ){
+                sum += dst[f * _channels + c];
+            }
+            _mono[_buf_frames + f] = sum;
+        }
+
+        _buf_frames += got;
+        _in_read += got;
+    }
+
+    return true;
+}
+
+bool Stretcher::_hopOnce()
+{
+    const double tempo = _tempo.load( std::memory_order_relaxed );
+    const int64_t start = (int64_t)floor( _a_pos );
+
+    // drop what neither this frame nor the splice search reaches back to
+    int64_t keep = start - _seek;
+    if ( _mode == STRETCH_WSOLA && _prev >= 0 ){
+        keep = std::min( keep, _prev + _hop );
+    }
+
+    const int64_t drop = std::min( keep - _buf_start, _buf_frames );
+    if ( drop > 0 ){
+        memmove( _buf.data(), _buf.data() + drop * _channels, sizeof(float) * ( _buf_frames - drop ) * _channels );
+        memmove( _mono.data(), _mono.data() + drop, sizeof(float) * ( _buf_frames - drop ) );
+        _buf_start += drop;
+        _buf_frames -= drop;
+    }
+
+    if ( !_fill( start + _window + _seek ) ){
+        return false;
+    }
+
+    if ( _mode == STRETCH_WSOLA ){
+        _hopWsola( start );
+    } else {
+        _hopVocoder( start, _first ? _hop : std::max<int64_t>( 1, start - _prev ) );
+        _prev = start;
+    }
+    _first = false;
+
+    // the first hop of the accumulator has every frame it overlaps
+    _out.write( _acc.data(), _hop );
+    memmove( _acc.data(), _acc.data() + _hop * _channels, sizeof(float) * ( _window - _hop ) * _channels );
+    memset( _acc.data() + ( _window - _hop ) * _channels, 0, sizeof(float) * _hop * _channels );
+
+    _a_pos += tempo * _hop;
+    _held.store( _in_read - (int64_t)_a_pos, std::memory_order_relaxed );
+
+    // every real input frame has gone through at full weight
+    if ( _draining.load( std::memory_order_acquire )
+        && _in.readAvailable() == 0
+        && _a_pos >= _in_read + _window / 2 ){
+        _drained.store( true, std::memory_order_release );
+    }
+
+    return true;
+}
+
+/***
+ * Offset from start, within _seek, that best continues natural - the
+ * frames that followed the last splice. Normalised cross-correlation
+ * of the mono mix over the overlap: every _decimate-th lag and frame
+ * first, then every lag around the winner.
+*/
+int64_t Stretcher::_bestSplice( int64_t start, int64_t natural ) const
+{
+    const int overlap = _window - _hop;
+    const float *target = _mono.data() + ( natural - _buf_start );
+
+    auto score = [&]( int64_t lag, int step ){
+        const float *cand = _mono.data() + ( start + lag - _buf_start );
+        float cc = 0, energy = 0;
+        for ( int i = 0; i < overlap; i += step ){
+            cc += cand[i] * target[i];
+            energy += cand[i] * cand[i];
+        }
+        return cc / sqrtf( energy + 1e-9f );
+    };
+
+    int64_t best = 0;
+    float best_score = -INFINITY;
+
+    for ( int64_t lag = -_seek; lag <= _seek; lag += _decimate ){
+        const float s = score( lag, _decimate );
+        if ( s > best_score ){
+            best_score = s;
+            best = lag;
+        }
+    }
+
+    const int64_t from = std::max<int64_t>( -_seek, best - _decimate + 1 );
+    const int64_t to = std::min<int64_t>( _seek, best + _decimate - 1 );
+    best_score = -INFINITY;
+
+    for ( int64_t lag = from; lag <= to; lag++ ){
+        const float s = score( lag, 1 );
+        if ( s > best_score ){
+            best_score = s;
+            best = lag;
+        }
+    }
+
+    return start + best;
+}
+
+void Stretcher::_hopWsola( int64_t start )
+{
+    const int64_t at = _prev < 0 ? start : _bestSplice( start, _prev + _hop );
+    const float *x = _buf.data() + ( at - _buf_start ) * _channels;
+
+    for ( int f = 0; f < _window; f++ ){
+        const float w = _win[f];
+        for ( int c = 0; c < _channels; c++ ){
+            _acc[f * _channels + c] += w * x[f * _channels + c];
+        }
+    }
+
+    _prev = at;
+}
+
+/***
+ * Bins are moved on at the frequency their phase says they are at.
+ * Only peaks are tracked; every other bin keeps its offset from the
+ * peak nearest it, as analysed.
+*/
+void Stretcher::_hopVocoder( int64_t start, int64_t a_hop )
+{
+    const int bins = _window / 2 + 1;
+
+    // Hann squared at 75% overlap sums to 1.5, and FFTW does not scale
+    const float scale = 1.0f / ( 1.5f * _window );
+
+    for ( int c = 0; c < _channels; c++ ){
+
+        const float *x = _buf.data() + ( start - _buf_start ) * _channels + c;
+        float *phase_in = _phase_in.data() + (size_t)c * bins;
+        float *phase_out = _phase_out.data() + (size_t)c * bins;
+
+        for ( int n = 0; n < _window; n++ ){
+            _fft_in[n] = _win[n] * x[n * _channels];
+        }
+        fftwf_execute_dft_r2c( _r2c, _fft_in, _fft_out );
+
+        for ( int k = 0; k < bins; k++ ){
+            _mag[k] = hypotf( _fft_out[k][0], _fft_out[k][1] );
+            _phase[k] = atan2f( _fft_out[k][1], _fft_out[k][0] );
+        }
+
+        if ( _first ){
+            memcpy( phase_out, _phase.data(), sizeof(float) * bins );
+        } else {
+            _peaks.clear();
+            for ( int k = 2; k < bins - 2; k++ ){
+                if ( _mag[k] > _mag[k - 1] && _mag[k] >= _mag[k + 1]
+                    && _mag[k] > _mag[k - 2] && _mag[k] >= _mag[k + 2] ){
+                    _peaks.push_back( k );
+                }
+            }
+
+            // silence - nothing to lock to, every bin goes its own way
+            if ( _peaks.empty() ){
+                for ( int k = 0; k < bins; k++ ){
+                    _peaks.push_back( k );
+                }
+            }
+
+            for ( int p : _peaks ){
+                const float omega = 2 * (float)M_PI * p / _window;
+                const float drift = _wrap( _phase[p] - phase_in[p] - omega * a_hop );
+                phase_out[p] = _wrap( phase_out[p] + ( omega + drift / a_hop ) * _hop );
+            }
+
+            size_t j = 0;
+            for ( int k = 0; k < bins; k++ ){
+                while ( j + 1 < _peaks.size() && abs( _peaks[j + 1] - k ) < abs( _peaks[j] - k ) ){
+                    j++;
+                }
+                const int p = _peaks[j];
+                if ( p != k ){
+                    phase_out[k] = phase_out[p] + _phase[k] - _phase[p];
+                }
+            }
+        }
+
+        memcpy( phase_in, _phase.data(), sizeof(float) * bins );
+
+        for ( int k = 0; k < bins; k++ ){
+            _fft_out[k][0] = _mag[k] * cosf( phase_out[k] );
+            _fft_out[k][1] = _mag[k] * sinf( phase_out[k] );
+        }
+        fftwf_execute_dft_c2r( _c2r, _fft_out, _fft_in );
+
+        for ( int n = 0; n < _window; n++ ){
+            _acc[n * _channels + c] += scale * _win[n] * _fft_in[n];
+        }
+    }
+}
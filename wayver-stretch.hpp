@@ -0,0 +1,183 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+#include <wayver-ring.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <fftw3.h>
+#include <spdlog/spdlog.h>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        // WSOLA keeps speech intelligible, the vocoder keeps music smooth
+        enum StretchMode {
+            STRETCH_WSOLA,
+            STRETCH_VOCODER,
+            STRETCH_MODE_COUNT
+        };
+
+        // "wsola", "vocoder" - false for anything else
+        bool parseStretchMode( const char *name, StretchMode *out );
+        const char *stretchModeName( StretchMode mode );
+
+        /***
+         * Tempo without pitch - tempo input frames are played per output
+         * frame, STRETCH_MIN_TEMPO -> STRETCH_MAX_TEMPO.
+         *
+         *      - A worker thread does the work, a hop at a time: input
+         *      comes from the callback through one FrameRing, finished
+         *      audio goes back through another
+         *      - It runs at most STRETCH_AHEAD_MS past what the callback
+         *      pulls, plus the largest pull seen, so a tempo change is
+         *      heard that soon
+         *      - WSOLA: Hann frames at 50% overlap, each spliced in
+         *      within STRETCH_WSOLA_SEEK_MS of its nominal place, where
+         *      it lines up best with how the last one carried on
+         *      - Vocoder: Hann frames at 75% overlap through FFTW, bin
+         *      phases advanced at their measured frequency and locked
+         *      to the nearest peak, so partials stay coherent
+         *      - flush() after a jump: same handshake as Decoder seeks,
+         *      pull() gives nothing until the worker has started over
+         *      - The callback side - push(), pull(), flush(), drain(),
+         *      setTempo() - neither allocates nor locks
+         *      - No worker until want() first asks for one, and it sleeps
+         *      on a condition while unwanted and the callback is at 1x
+        */
+        class Stretcher {
+
+            StretchMode _mode;
+            int _channels;
+
+            // frame length and output hop, in frames
+            int _window;
+            int _hop;
+
+            // WSOLA: splice search either side, and its coarse step
+            int _seek = 0;
+            int _decimate = 1;
+
+            // how far the worker runs ahead of the callback, before the largest pull
+            size_t _ahead;
+
+            Bus::FrameRing _in;
+            Bus::FrameRing _out;
+
+            std::atomic<double> _tempo{1};
+            std::atomic<size_t> _max_pull{0};
+
+            // flush handshake: callback bumps _flush_request, worker
+            // answers with _flush_served and where the output starts over
+            std::atomic<uint64_t> _flush_in_pos{0};
+            std::atomic<uint32_t> _flush_request{0};
+            std::atomic<uint32_t> _flush_served{0};
+            std::atomic<uint64_t> _flush_out_pos{0};
+
+            // callback-owned: the flush pull() waits on, if any
+            uint32_t _flush_ticket = 0;
+            bool _flushing = false;
+
+            // the callback has no more input - the worker pads to finish
+            std::atomic<bool> _draining{false};
+            std::atomic<bool> _drained{false};
+
+            // input past what has been played out, for the clock
+            std::atomic<int64_t> _held{0};
+
+            /***
+             * Worker-owned. Input in absolute frames since the last
+             * flush, _buf holding from _buf_start on, and a mono mix of
+             * it for the WSOLA search
+            */
+            std::vector<float> _buf;
+            std::vector<float> _mono;
+            int64_t _buf_start = 0;
+            int64_t _buf_frames = 0;
+            int64_t _in_read = 0;
+
+            // where the next frame is read from, and where the last one was
+            double _a_pos = 0;
+            int64_t _prev = -1;
+
+            std::vector<float> _win;
+            std::vector<float> _acc;
+
+            // vocoder, per channel: phases as analysed and as synthesised
+            float *_fft_in = NULL;
+            fftwf_complex *_fft_out = NULL;
+            fftwf_plan _r2c;
+            fftwf_plan _c2r;
+            std::vector<float> _phase_in;
+            std::vector<float> _phase_out;
+            std::vector<float> _mag;
+            std::vector<float> _phase;
+            std::vector<int> _peaks;
+            bool _first = true;
+
+            boost::thread _thread;
+            std::atomic<bool> _running{true};
+
+            // engine side: whether tempo is about to leave or stay off 1x
+            bool _wanted = false;
+            boost::mutex _park_mutex;
+            boost::condition_variable _park_cond;
+
+            bool _flushPending() const;
+            bool _parked() const;
+
+            std::shared_ptr<spdlog::logger> _logger;
+
+            void _loop();
+            void _serveFlush();
+            void _reset();
+            bool _fill( int64_t until );
+            int64_t _bestSplice( int64_t start, int64_t natural ) const;
+            void _hopWsola( int64_t start );
+            void _hopVocoder( int64_t start, int64_t a_hop );
+            bool _hopOnce();
+
+            public:
+
+                Stretcher( int channels, int samplerate, StretchMode mode, std::shared_ptr<spdlog::logger> logger );
+                ~Stretcher();
+
+                StretchMode mode() const { return _mode; }
+
+                /***
+                 * Engine - call before tempo leaves 1x, the worker starts
+                 * on the first call. false lets it sleep once the
+                 * callback is back at 1x. Locks, never from the callback
+                */
+                void want( bool on );
+
+                // applies from the next hop on
+                void setTempo( double tempo );
+                double tempo() const { return _tempo.load( std::memory_order_relaxed ); }
+
+                // Callback - input frames push() takes right now
+                size_t space() const { return _in.writeAvailable(); }
+                size_t push( const float *in, size_t frames );
+
+                // Callback - up to frames of finished audio, fewer while the worker catches up
+                size_t pull( float *out, size_t frames );
+
+                // Callback - drop everything queued, input and output
+                void flush();
+
+                // Callback - no more input is coming, play out what there is
+                void drain();
+
+                // everything pushed has been pulled, after drain()
+                bool drained() const;
+
+                // input frames pushed that have not been heard yet
+                int64_t behind() const;
+        };
+    }
+}
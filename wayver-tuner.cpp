@@ -0,0 +1,48 @@
+#include <wayver-tuner.hpp>
+
+#include <algorithm>
+
+using namespace Wayver::Audio;
+
+unsigned long BufferTuner::start()
+{
+    // tuned down from a safe size, not up through a string of underruns
+    reopened( std::min<unsigned long>( TUNE_MAX_FRAMES, std::max<unsigned long>( TUNE_MIN_FRAMES, FRAMES_IN_BUFFER ) ), 0 );
+    return _frames;
+}
+
+unsigned long BufferTuner::observe( uint64_t underflows, double cpu_load )
+{
+    const double ran_ms = boost::chrono::duration<double, boost::milli>( Clock::now() - _since ).count();
+
+    // opening and starting glitches on some hosts - not the size's fault
+    if ( ran_ms < TUNE_SETTLE_MS ){
+        _underflows = underflows;
+        return 0;
+    }
+
+    const bool xrun = underflows > _underflows;
+    _underflows = underflows;
+
+    if ( ( xrun || cpu_load > TUNE_HIGH_LOAD ) && _frames < TUNE_MAX_FRAMES ){
+
+        // load comes and goes, underruns say the size is too small
+        if ( xrun ){
+            _floor = 2 * _frames;
+        }
+        return 2 * _frames;
+    }
+
+    if ( ran_ms > TUNE_STABLE_MS && cpu_load < TUNE_LOW_LOAD && _frames / 2 >= _floor ){
+        return _frames / 2;
+    }
+
+    return 0;
+}
+
+void BufferTuner::reopened( unsigned long frames, uint64_t underflows )
+{
+    _frames = frames;
+    _underflows = underflows;
+    _since = Clock::now();
+}
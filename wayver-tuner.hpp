@@ -0,0 +1,46 @@
+#pragma once
+
+#include <wayver-defines.hpp>
+
+#include <cstdint>
+
+#include <boost/chrono.hpp>
+
+namespace Wayver {
+
+    namespace Audio {
+
+        /***
+         * Picks the callback buffer size at run time.
+         *
+         *      - Starts at FRAMES_IN_BUFFER, which plays clean on most
+         *      machines, and doubles on an xrun or when the callback
+         *      uses more than TUNE_HIGH_LOAD of its period
+         *      - Halves after TUNE_STABLE_MS without xruns below
+         *      TUNE_LOW_LOAD, but never back to a size that underran
+         *      - Only decides: the engine does the reopening and
+         *      calls reopened() once the new stream runs
+        */
+        class BufferTuner {
+
+            typedef boost::chrono::steady_clock Clock;
+
+            unsigned long _frames = FRAMES_IN_BUFFER;
+
+            // sizes below this have underrun on this machine
+            unsigned long _floor = TUNE_MIN_FRAMES;
+
+            uint64_t _underflows = 0;
+            Clock::time_point _since;
+
+            public:
+                // size to open the first stream with
+                unsigned long start();
+
+                // every engine tick - a new size to reopen at, 0 -> keep this one
+                unsigned long observe( uint64_t underflows, double cpu_load );
+
+                void reopened( unsigned long frames, uint64_t underflows );
+        };
+    }
+}
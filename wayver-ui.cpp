@@ -2,10 +2,13 @@
 #include <boost/chrono.hpp>
 #include "spdlog/sinks/basic_file_sink.h"
 #include <string>
+#include <cstring>
 #include <math.h>
+#include <algorithm>
 
 
 #include "wayver-ui.hpp"
+#include "wayver-rtlog.hpp"
 
 
 using namespace Wayver::UI;
@@ -13,7 +16,7 @@ using namespace Wayver::UI;
 
 
 WayverUi::WayverUi()
-:_logger(spdlog::basic_logger_mt("UI", "wayver.log"))
+:_logger(Bus::fileLogger("UI"))
 {
     /****
      * 
@@ -65,8 +68,21 @@ WayverUi::WayverUi()
 WayverUi::~WayverUi()
 {    
     delete _scrubber;
+    delete _spectrum;
+    delete _overview;
+    for ( Audio::Overview *o : _retired_overviews ){
+        delete o;
+    }
     delete _help_component;
     delete _static_info;
+    delete _stats_overlay;
+    delete _compositor;
+    delete _scheduler;
+
+    // atlas pages belong to the renderer
+    delete _title_glyphs;
+    delete _body_glyphs;
+    delete _labels_glyphs;
 
     //Destroy window	
 	SDL_DestroyRenderer( renderer );
@@ -95,15 +111,36 @@ void WayverUi::initUiState(
     const std::string &fpath )
 {
     this->_sfInfo = info;
-    this->_n_samples_in = info.channels * _n_frames_per_buffer;
-    this->_samples_in_vec.reserve( _n_samples_in );
     this->_queues_ptr = _q_ptr;
     this->path_to_file = fpath;
 
+    if ( _playlist.empty() ){
+        _playlist.push_back( fpath );
+    }
+
+    // waveform for the scrubber, ready well before the window is up
+    _loadAnalysis( fpath );
+
     _logger->debug("Finished Constructor");
     _logger->flush();
 }
 
+void WayverUi::setPlaylist( const std::vector<std::string> &playlist ){
+    _playlist = playlist;
+}
+
+void WayverUi::_loadAnalysis( const std::string &fpath ){
+
+    // cached analysis first, only build what is missing
+    _cache = Cache::lookup( fpath );
+
+    // the file's frames, not the stream's - see Audio::Overview
+    _overview = new Audio::Overview( fpath, _logger );
+    if ( _cache == NULL || !_overview->loadFrom( *_cache ) ){
+        _overview->buildAsync( fpath );
+    }
+}
+
 void WayverUi::initWindow(){
     int sdlIsInitted = SDL_Init( SDL_INIT_VIDEO );
 
@@ -142,21 +179,52 @@ void WayverUi::initWindow(){
 
     _initFonts();
 
+    SDL_DisplayMode mode;
+    const bool known = SDL_GetWindowDisplayMode( window, &mode ) == 0 && mode.refresh_rate > 0;
+
+    _scheduler = new FrameScheduler( known ? mode.refresh_rate : UI_DEFAULT_REFRESH_HZ );
+    _logger->info("initWindow() - pacing frames to {} Hz{}", 
+        known ? mode.refresh_rate : UI_DEFAULT_REFRESH_HZ, known ? "" : " (display did not say)");
+
+    _title_glyphs = new GlyphAtlas( renderer, title_font );
+    _body_glyphs = new GlyphAtlas( renderer, body_font );
+    _labels_glyphs = new GlyphAtlas( renderer, labels_font );
+
     _scrubber = new Scrubber(
         _scrubber_rect,
         renderer,
         _logger,
         _sfInfo,
-        body_font
+        _body_glyphs
+    );
+    _scrubber->setOverview( _overview );
+
+    _spectrum = new Spectrum(
+        _spectrum_rect,
+        renderer,
+        _logger
     );
 
+    size_t summary_size;
+    const uint8_t *summary = _cache != NULL ? _cache->section( Cache::SPECTRUM, &summary_size ) : NULL;
+    if ( summary != NULL && summary_size == FFT_OUT_BANDS * sizeof(float) ){
+        _spectrum->setSummary( (const float*)summary );
+    }
+
     _help_component = new Help(
         _help_rect,
         renderer,
         _logger,
-        body_font
+        _body_glyphs
     );
     
+    _stats_overlay = new StatsOverlay(
+        _spectrum_rect,
+        renderer,
+        _logger,
+        _labels_glyphs
+    );
+
     _static_info = new StaticInfo(
         _info_rect,
         renderer,
@@ -165,10 +233,26 @@ void WayverUi::initWindow(){
         path_to_file,
         _globals._BACKGROUND_1,
         _globals._FOREGROUND_1,
-        body_font,
-        title_font
+        _body_glyphs,
+        _title_glyphs
+    );
+
+    _compositor = new Compositor(
+        renderer,
+        { 0, 0, _globals._WIN_SIZE.x, _globals._WIN_SIZE.y },
+        _globals._BACKGROUND_1
     );
 
+    const int live = _compositor->addLayer( false );
+    const int file_info = _compositor->addLayer( true );
+    const int overlays = _compositor->addLayer( true );
+
+    _compositor->add( live, _scrubber );
+    _compositor->add( live, _spectrum );
+    _compositor->add( file_info, _static_info );
+    _compositor->add( overlays, _stats_overlay );
+    _compositor->add( overlays, _help_component );
+
     _logger->debug("initWindow()");
     _logger->flush();
 }
@@ -207,33 +291,122 @@ void WayverUi::_initFonts(){
 */
 void WayverUi::run(){
 
-    // initWindow();
-    // std::vector<float> *frames = new std::vector<float>();
-    // float item = 0;
-
-    // auto consume_pending = [&] {
-    //     while ( _queues_ptr->_queue_audio_to_ui.pop(item)) {
-    //         frames->push_back(item);
-    //     }
-    // };
-
     while (!_QUIT ) {
 
+        // paused or not started: sleep until an event, or the overlay's next refresh
+        if ( _idle() ){
+            SDL_Event e;
+            if ( SDL_WaitEventTimeout( &e, UI_IDLE_WAIT_MS ) ){
+                _handleEvent( e );
+            }
+            _scheduler->resync();
+        } else {
+            _scheduler->waitNextFrame();
+        }
+
         _handleEvents();
 
-        // int items_in_queue = _queues_ptr->_queue_audio_to_ui.read_available();
-        _frames_counter = _queues_ptr->head;
+        // newest complete frames from the callback and analyser, never blocks them
+        _queues_ptr->_clock_to_ui.update();
+        _queues_ptr->_vis_to_ui.update();
+
+        const Bus::AudioClock &clock = _queues_ptr->_clock_to_ui.readBuffer();
+
+        if ( ( clock.load != _load || clock.track != _track ) && clock.track_frames > 0 ){
+            _onTrackChange( clock );
+        }
+
+        // where the audio will be when this frame is on screen
+        _frames_counter = clock.wall_ns != 0
+            ? clock.audibleFrame( boost::chrono::duration_cast<boost::chrono::nanoseconds>( 
+                _scheduler->displayTime().time_since_epoch() ).count() )
+            : _queues_ptr->_vis_to_ui.readBuffer().frame;
         
         _update();
-        _draw();
 
-        boost::this_thread::sleep_for( boost::chrono::milliseconds( UI_WAIT_TIME ) );
+        if ( _draw() ){
+            _scheduler->presented();
+        }
     }
 
+    const FrameStats f = _scheduler->stats();
+    _logger->info(
+        "Frames at {} Hz: {} frames, {} presented, {} late, interval p50={:.2f}ms p99={:.2f}ms max={:.2f}ms",
+        f.refresh_hz, f.frames, f.presented, f.late, f.p50_ms, f.p99_ms, f.max_ms );
+
     _logger->debug("Exiting run()");
     _logger->flush();
 }
 
+/***
+ * Everything that describes the file follows the engine onto the next
+ * entry. An old overview still building would block its destructor,
+ * so it waits on the side until it is done.
+*/
+void WayverUi::_onTrackChange( const Bus::AudioClock &clock ){
+
+    // every load after the first one is a file dropped here, in order
+    if ( _load != 0 && clock.load != _load ){
+        for ( ; _load < clock.load && !_dropped.empty(); _load++ ){
+            _playlist.assign( 1, _dropped.front() );
+            _dropped.pop_front();
+        }
+    }
+
+    const bool first = _load == 0;
+    _load = clock.load;
+    _track = clock.track;
+
+    if ( first && _track == 0 ){
+        return;
+    }
+
+    if ( _track < 0 || _track >= (int)_playlist.size() ){
+        return;
+    }
+
+    path_to_file = _playlist[_track];
+    _sfInfo.frames = clock.track_frames;
+    _sfInfo.channels = clock.track_channels;
+    _sfInfo.samplerate = clock.track_samplerate;
+
+    _logger->info("_onTrackChange() - track {}: {}", _track, path_to_file);
+
+    for ( size_t i = 0; i < _retired_overviews.size(); ){
+        if ( _retired_overviews[i]->isDone() ){
+            delete _retired_overviews[i];
+            _retired_overviews.erase( _retired_overviews.begin() + i );
+        } else {
+            i++;
+        }
+    }
+
+    if ( _overview->isDone() ){
+        delete _overview;
+    } else {
+        _retired_overviews.push_back( _overview );
+    }
+
+    _loadAnalysis( path_to_file );
+
+    // a loop is for one track - the engine's stops applying on its own
+    _loop_a = _loop_b = -1;
+
+    _scrubber->setTrack( _sfInfo, _overview );
+    _static_info->setFile( path_to_file, _sfInfo );
+
+    size_t summary_size;
+    const uint8_t *summary = _cache != NULL ? _cache->section( Cache::SPECTRUM, &summary_size ) : NULL;
+    if ( summary != NULL && summary_size == FFT_OUT_BANDS * sizeof(float) ){
+        _spectrum->setSummary( (const float*)summary );
+    }
+}
+
+bool WayverUi::_idle(){
+    return _queues_ptr->_clock_to_ui.readBuffer().rate == 0
+        && SDL_GetTicks() - _last_input_ms > 1000;
+}
+
 void WayverUi::stop(){
     _logger->debug("Received STOP signal.");
     _logger->flush();
@@ -248,28 +421,32 @@ void WayverUi::stop(){
 /**
  * Draw
 */
-void WayverUi::_draw(){
-
-    //Clear screen
-    SDL_SetRenderDrawColor( 
-        renderer, 
-        _globals._BACKGROUND_1.r, 
-        _globals._BACKGROUND_1.g, 
-        _globals._BACKGROUND_1.b, 
-        _globals._BACKGROUND_1.a 
-    );
-    
-    SDL_RenderClear( renderer );
+bool WayverUi::_draw(){
 
-    _scrubber->draw();
-    _help_component->draw();
-    _static_info->draw();
+    // nothing changed since the last present -> leave the screen be
+    if ( !_compositor->compose( canvas ) ){
+        return false;
+    }
 
+    SDL_RenderCopy( renderer, canvas, NULL, NULL );
     SDL_RenderPresent(renderer);
+    return true;
 }
 
 void WayverUi::_update(){
     _scrubber->update( _frames_counter );
+
+    const Bus::VisFrame &vis = _queues_ptr->_vis_to_ui.readBuffer();
+
+    if ( vis.analysis_seq != _analysis_seq ){
+        _analysis_seq = vis.analysis_seq;
+        _spectrum->update( vis );
+    }
+
+    // only worth rendering text for while it is on screen
+    if ( _queues_ptr->_stats_to_ui.update() && _stats_overlay->isVisible() ){
+        _stats_overlay->update( _queues_ptr->_stats_to_ui.readBuffer(), _scheduler->stats() );
+    }
 }
 
 
@@ -299,67 +476,244 @@ void WayverUi::_handleEvents(){
     
     SDL_Event e;
 
-    while( SDL_PollEvent( &e ) != 0 )
-    {
-        switch(e.type) {
+    while( SDL_PollEvent( &e ) != 0 ){
+        _handleEvent( e );
+    }
+}
+
+void WayverUi::_handleEvent( const SDL_Event &e ){
+
+    if ( e.type == SDL_KEYDOWN || e.type == SDL_MOUSEBUTTONDOWN || _dragging ){
+        _last_input_ms = SDL_GetTicks();
+    }
+
+    switch(e.type) {
+
+        case SDL_QUIT:
+            _queues_ptr->pushCommand( Bus::Command::QUIT );
+            _QUIT = true;
+            break;
+
+        // the canvas survives, but the window contents may not have
+        case SDL_WINDOWEVENT:
+            if ( e.window.event == SDL_WINDOWEVENT_EXPOSED ){
+                _compositor->invalidate();
+            }
+            break;
+
+        // click on the waveform -> play from there
+        case SDL_MOUSEBUTTONDOWN:
+            if ( e.button.button == SDL_BUTTON_LEFT && _scrubber->contains( e.button.x, e.button.y ) ){
+                Bus::Message seek;
+                seek.cmd = Bus::Command::SEEK;
+                seek.position = _scrubber->frameAt( e.button.x );
+                _queues_ptr->pushCommand( seek );
+
+                _dragging = true;
+                _drag_frame = seek.position;
+                _drag_ms = 0;
+            }
+            break;
+
+        // ... and drag -> grains wherever the pointer is, see GrainPlayer
+        case SDL_MOUSEMOTION:
+            if ( _dragging && ( e.motion.state & SDL_BUTTON_LMASK ) ){
+                _scrubTo( e.motion.x );
+            }
+            break;
+
+        // playback carries on from where the drag let go
+        case SDL_MOUSEBUTTONUP:
+            if ( e.button.button == SDL_BUTTON_LEFT && _dragging ){
+                _dragging = false;
+
+                if ( _drag_ms != 0 ){
+                    Bus::Message end;
+                    end.cmd = Bus::Command::SCRUB_END;
+                    end.position = _scrubber->frameAt( e.button.x );
+                    _queues_ptr->pushCommand( end );
+                }
+            }
+            break;
+
+        // plays instead of what is playing now, once the engine says so
+        case SDL_DROPFILE:
+            _logger->info("_handleEvent() - dropped {}", e.drop.file);
+            if ( _queues_ptr->pushLoad( e.drop.file ) ){
+                _dropped.push_back( e.drop.file );
+            }
+            SDL_free( e.drop.file );
+            break;
 
-            case SDL_QUIT:
-                _queues_ptr->_queue_commands.push( Bus::Command::QUIT );
+        case SDL_KEYUP:
+            switch (e.key.keysym.sym)
+            {
+            case 'q':
+                _queues_ptr->pushCommand( Bus::Command::QUIT );
                 _QUIT = true;
                 break;
+            default:
+                break;
+            }
+        case SDL_KEYDOWN:
+            switch (e.key.keysym.sym)
+            {
+            case SDLK_SPACE:
+                if (!_throttleActive){
+                    _queues_ptr->pushCommand( Bus::Command::PAUSE_PLAY );
+                    _throttleActive = true;
+                    _throttleTimer_start = SDL_GetTicks();
+                }
+                break;
 
-            case SDL_KEYUP:
-                switch (e.key.keysym.sym)
-                {
-                case 'q':
-                    _queues_ptr->_queue_commands.push( Bus::Command::QUIT );
-                    _QUIT = true;
-                    break;
-                default:
-                    break;
+            case SDLK_DOWN:
+                if (!_throttleActive){
+                    _queues_ptr->pushCommand( Bus::Command::NUDGE_GAIN_DWN );
+                    _throttleActive = true;
+                    _throttleTimer_start = SDL_GetTicks();
                 }
-            case SDL_KEYDOWN:
-                switch (e.key.keysym.sym)
-                {
-                case SDLK_SPACE:
-                    if (!_throttleActive){
-                        _queues_ptr->_queue_commands.push( Bus::Command::PAUSE_PLAY );
-                        _throttleActive = true;
-                        _throttleTimer_start = SDL_GetTicks();
-                    }
-                    break;
+                break;
+            
+            case SDLK_UP:
+                if (!_throttleActive){
+                    _queues_ptr->pushCommand( Bus::Command::NUDGE_GAIN_UP );
+                    _throttleActive = true;
+                    _throttleTimer_start = SDL_GetTicks();
+                }
+            case SDLK_h:
+                if (!_throttleActive){
+                    _logger -> debug("SDL_k pressed");
+                    _help_component->toggle();
+                    _throttleActive = true;
+                    _throttleTimer_start = SDL_GetTicks();
+                }
+                break;
 
-                case SDLK_DOWN:
-                    if (!_throttleActive){
-                        _queues_ptr->_queue_commands.push( Bus::Command::NUDGE_GAIN_DWN );
-                        _throttleActive = true;
-                        _throttleTimer_start = SDL_GetTicks();
-                    }
-                    break;
-                
-                case SDLK_UP:
-                    if (!_throttleActive){
-                        _queues_ptr->_queue_commands.push( Bus::Command::NUDGE_GAIN_UP );
-                        _throttleActive = true;
-                        _throttleTimer_start = SDL_GetTicks();
-                    }
-                case SDLK_h:
-                    if (!_throttleActive){
-                        _logger -> debug("SDL_k pressed");
-                        _help_component->toggle();
-                        _throttleActive = true;
-                        _throttleTimer_start = SDL_GetTicks();
+            // key up lands here too - only the press counts
+            case SDLK_a:
+            case SDLK_b:
+                if ( e.type == SDL_KEYDOWN && !e.key.repeat ){
+                    _markLoop( e.key.keysym.sym == SDLK_b );
+                }
+                break;
+
+            case SDLK_c:
+                if ( e.type == SDL_KEYDOWN && !e.key.repeat ){
+                    _clearLoop();
+                }
+                break;
+
+            // held, it keeps stepping - the engine glides between steps
+            case SDLK_LEFT:
+            case SDLK_RIGHT:
+                if ( e.type == SDL_KEYDOWN ){
+                    _nudgeSpeed( e.key.keysym.sym == SDLK_RIGHT );
+                }
+                break;
+
+            case SDLK_LEFTBRACKET:
+            case SDLK_RIGHTBRACKET:
+                if ( e.type == SDL_KEYDOWN ){
+                    _nudgeTempo( e.key.keysym.sym == SDLK_RIGHTBRACKET );
+                }
+                break;
+
+            case SDLK_s:
+                if ( e.type == SDL_KEYDOWN && !e.key.repeat ){
+                    _stats_overlay->toggle();
+                    if ( _stats_overlay->isVisible() ){
+                        _stats_overlay->update( _queues_ptr->_stats_to_ui.readBuffer(), _scheduler->stats() );
                     }
-                default:
-                    break;
                 }
+                break;
+
             default:
-            break;
-        }
+                break;
+            }
+        default:
+        break;
     }
 }
 
+// velocity from the last SCRUB - the engine reads ahead along it
+void WayverUi::_scrubTo( int x )
+{
+    const Uint32 now = SDL_GetTicks();
+    const int64_t frame = _scrubber->frameAt( x );
+
+    Bus::Message scrub;
+    scrub.cmd = Bus::Command::SCRUB;
+    scrub.position = frame;
+    scrub.value = _drag_ms == 0 ? 0 : (float)( frame - _drag_frame ) * 1000 / std::max<Uint32>( 1, now - _drag_ms );
+    _queues_ptr->pushCommand( scrub );
+
+    _drag_frame = frame;
+    _drag_ms = std::max<Uint32>( 1, now );
+}
+
 
+// A or B where playback is now - a loop once both are in, either order
+void WayverUi::_markLoop( bool at_b )
+{
+    ( at_b ? _loop_b : _loop_a ) = _frames_counter;
+    _scrubber->setLoop( _loop_a, _loop_b );
+
+    if ( _loop_a < 0 || _loop_b < 0 || _loop_a == _loop_b ){
+        return;
+    }
+
+    Bus::Message loop;
+    loop.cmd = Bus::Command::SET_LOOP;
+    loop.position = std::min( _loop_a, _loop_b );
+    loop.end = std::max( _loop_a, _loop_b );
+    loop.track = _track;
+    _queues_ptr->pushCommand( loop );
+}
+
+void WayverUi::_nudgeSpeed( bool up )
+{
+    const double step = pow( 2.0, 1.0 / 12 );
+
+    _speed = std::min( VARISPEED_MAX, std::max( VARISPEED_MIN, up ? _speed * step : _speed / step ) );
+
+    // a few steps back from anywhere lands on 1x exactly
+    if ( fabs( _speed - 1 ) < 1e-6 ){
+        _speed = 1;
+    }
+
+    Bus::Message speed;
+    speed.cmd = Bus::Command::SET_SPEED;
+    speed.value = _speed;
+    _queues_ptr->pushCommand( speed );
+
+    _static_info->setSpeed( _speed );
+}
+
+void WayverUi::_nudgeTempo( bool up )
+{
+    _tempo = std::min( STRETCH_MAX_TEMPO, std::max( STRETCH_MIN_TEMPO, _tempo + ( up ? STRETCH_TEMPO_STEP : -STRETCH_TEMPO_STEP ) ) );
+
+    // whole steps, so 1x is exactly 1 again
+    _tempo = round( _tempo / STRETCH_TEMPO_STEP ) * STRETCH_TEMPO_STEP;
+
+    Bus::Message tempo;
+    tempo.cmd = Bus::Command::SET_TEMPO;
+    tempo.value = _tempo;
+    _queues_ptr->pushCommand( tempo );
+
+    _static_info->setTempo( _tempo );
+}
+
+// playback runs on past B from wherever it is in the loop
+void WayverUi::_clearLoop()
+{
+    if ( _loop_a >= 0 && _loop_b >= 0 ){
+        _queues_ptr->pushCommand( Bus::Command::CLEAR_LOOP );
+    }
+
+    _loop_a = _loop_b = -1;
+    _scrubber->setLoop( _loop_a, _loop_b );
+}
 
 /****
  * Components
@@ -370,9 +724,27 @@ UIComponent::UIComponent(
     std::shared_ptr<spdlog::logger> logger
 ):_renderer(r),
 _content_rect(contentRect),
-_logger(logger)
+_logger(logger),
+_dirty(contentRect)
 {}
 
+void UIComponent::_invalidate()
+{
+    _invalidate( _content_rect );
+}
+
+void UIComponent::_invalidate( const SDL_Rect &r )
+{
+    uniteRect( _dirty, r );
+}
+
+SDL_Rect UIComponent::takeDirty()
+{
+    const SDL_Rect dirty = _dirty;
+    _dirty = {0, 0, 0, 0};
+    return dirty;
+}
+
 
 
 /***
@@ -383,18 +755,26 @@ Scrubber::Scrubber(
     SDL_Renderer *r,
     std::shared_ptr<spdlog::logger> logger,
     const SF_INFO &sfi,
-    TTF_Font *f
+    GlyphAtlas *glyphs
 ):UIComponent(contentRect, r, logger),
-_font(f)
+_glyphs(glyphs)
 {
-    _logger = spdlog::basic_logger_mt("UI::Scrubber", "wayver.log");
+    _logger = Bus::fileLogger("UI::Scrubber");
 
     _sf_info = sfi;
 
-    _scrub_bar_rect_outer = {
+    _wave_rect = {
         (float)_content_rect.x,
         (float)_content_rect.y,
         (float)_content_rect.w,
+        (float)_WAVE_HEIGHT
+    };
+
+    // bar runs through the middle of the waveform
+    _scrub_bar_rect_outer = {
+        _wave_rect.x,
+        _wave_rect.y + (_wave_rect.h - 8) / 2,
+        _wave_rect.w,
         8
     };
 
@@ -406,8 +786,8 @@ _font(f)
     };
 
     _timeLabelPosition = {
-        _scrub_bar_rect_outer.x,
-        _scrub_bar_rect_outer.y + _scrub_bar_rect_outer.h + 5
+        _wave_rect.x,
+        _wave_rect.y + _wave_rect.h + 5
     };
 
     _max_scrubber_bar_width = _scrub_bar_rect_outer.w;
@@ -452,13 +832,59 @@ const std::string Scrubber::_ms_to_time_string(int time_ms){
 
 
 
+void Scrubber::setOverview( const Audio::Overview *overview ){
+    _overview = overview;
+}
+
+void Scrubber::setTrack( const SF_INFO &sfi, const Audio::Overview *overview ){
+    _sf_info = sfi;
+    _total_ms = 1000 * (float)sfi.frames / (float)sfi.samplerate;
+    _overview = overview;
+
+    // rebuilt from the new overview once it is ready
+    _wave_columns.clear();
+    _wave_played = 0;
+    _shown_bar_px = -1;
+    _shown_second = -1;
+    _loop_a = _loop_b = -1;
+
+    _invalidate();
+}
+
 void Scrubber::draw(){
+
+    if ( !_wave_columns.empty() ){
+
+        // played part in the accent colour, the rest dimmed
+        SDL_SetRenderDrawColor(
+            _renderer,
+            globals._FOREGROUND_2.r,
+            globals._FOREGROUND_2.g,
+            globals._FOREGROUND_2.b,
+            110
+        );
+        SDL_RenderFillRectsF( _renderer, _wave_columns.data(), _wave_played );
+
+        SDL_SetRenderDrawColor(
+            _renderer,
+            globals._FOREGROUND_1.r,
+            globals._FOREGROUND_1.g,
+            globals._FOREGROUND_1.b,
+            70
+        );
+        SDL_RenderFillRectsF( 
+            _renderer, 
+            _wave_columns.data() + _wave_played, 
+            _wave_columns.size() - _wave_played );
+    }
+
+    // the track stays see-through so the waveform shows behind it
     SDL_SetRenderDrawColor(
         _renderer,
         globals._FOREGROUND_1.r,
         globals._FOREGROUND_1.g,
         globals._FOREGROUND_1.b,
-        globals._FOREGROUND_1.a
+        _wave_columns.empty() ? globals._FOREGROUND_1.a : 90
     );
 
     SDL_RenderFillRectF( _renderer, &_scrub_bar_rect_outer );
@@ -472,53 +898,129 @@ void Scrubber::draw(){
     );
     SDL_RenderFillRectF(_renderer, &_scrub_bar_rect_inner );
 
+    // the loop shaded between its markers, a lone marker on its own
+    if ( _loop_a >= 0 && _loop_b >= 0 ){
+        const float x_a = _xAt( std::min( _loop_a, _loop_b ) );
+        const float x_b = _xAt( std::max( _loop_a, _loop_b ) );
+        const SDL_FRect band = { x_a, _wave_rect.y, x_b - x_a, _wave_rect.h };
+
+        SDL_SetRenderDrawColor(
+            _renderer,
+            globals._FOREGROUND_2.r,
+            globals._FOREGROUND_2.g,
+            globals._FOREGROUND_2.b,
+            40
+        );
+        SDL_RenderFillRectF( _renderer, &band );
+    }
+
+    SDL_SetRenderDrawColor(
+        _renderer,
+        globals._FOREGROUND_2.r,
+        globals._FOREGROUND_2.g,
+        globals._FOREGROUND_2.b,
+        globals._FOREGROUND_2.a
+    );
+
+    const int64_t markers[2] = { _loop_a, _loop_b };
+    for ( int64_t m : markers ){
+        if ( m >= 0 ){
+            const SDL_FRect line = { _xAt( m ), _wave_rect.y, 1, _wave_rect.h };
+            SDL_RenderFillRectF( _renderer, &line );
+        }
+    }
+
     _draw_TimeText();
 }
 
-void Scrubber::update( int sc ){
+bool Scrubber::contains( int x, int y ) const
+{
+    return x >= _wave_rect.x && x < _wave_rect.x + _wave_rect.w
+        && y >= _wave_rect.y && y < _wave_rect.y + _wave_rect.h;
+}
+
+int64_t Scrubber::frameAt( int x ) const
+{
+    const float ratio = std::max( 0.0f, std::min( 1.0f, ( x - _wave_rect.x ) / _wave_rect.w ) );
+    return std::min<int64_t>( (int64_t)( ratio * _sf_info.frames ), std::max<int64_t>( 0, _sf_info.frames - 1 ) );
+}
+
+void Scrubber::setLoop( int64_t a, int64_t b )
+{
+    if ( a != _loop_a || b != _loop_b ){
+        _loop_a = a;
+        _loop_b = b;
+        _invalidate();
+    }
+}
+
+float Scrubber::_xAt( int64_t frame ) const
+{
+    return _wave_rect.x + floor( (float)frame / std::max<int64_t>( 1, _sf_info.frames ) * _wave_rect.w );
+}
+
+void Scrubber::update( int64_t sc ){
     _frame_counter = sc;
     // int _ellapsed_ms = sc / (_sf_info.channels * _sf_info.samplerate / 1000);
-    float gone_by_ratio = (float)(sc)
-        /(float)(_sf_info.frames);
+    float gone_by_ratio = (double)(sc)
+        /(double)(_sf_info.frames);
     
     // recalc play rect
     _scrub_bar_rect_inner.w = gone_by_ratio * _max_scrubber_bar_width;
 
+    // overview finished building -> lay out the columns once
+    if ( _wave_columns.empty() && _overview != NULL && _overview->isReady() ){
+
+        std::vector<Audio::OverviewBucket> buckets;
+        _overview->columns( (int)_wave_rect.w, buckets );
+
+        const float mid = _wave_rect.y + _wave_rect.h / 2;
+        const float half = _wave_rect.h / 2;
+
+        _wave_columns.resize( buckets.size() );
+        for ( size_t c = 0; c < buckets.size(); c++ ){
+            float top = std::max( -1.0f, std::min( 1.0f, buckets[c].max ) );
+            float bottom = std::max( -1.0f, std::min( 1.0f, buckets[c].min ) );
+            _wave_columns[c] = {
+                _wave_rect.x + c,
+                mid - top * half,
+                1,
+                std::max( 1.0f, (top - bottom) * half )
+            };
+        }
+
+        _invalidate();
+    }
+
+    _wave_played = std::min( 
+        _wave_columns.size(), 
+        (size_t)( gone_by_ratio * _wave_columns.size() ) );
+
+    const int bar_px = _scrub_bar_rect_inner.w;
+    const int second = (int)( sc / _sf_info.samplerate );
+
+    if ( bar_px != _shown_bar_px || second != _shown_second ){
+        _shown_bar_px = bar_px;
+        _shown_second = second;
+        _invalidate();
+    }
+
 }
 
 // privates:
 void Scrubber::_draw_TimeText(){
 
-    SDL_Surface* text;
-    
-    std::string _temp_text = _ms_to_time_string( 
-        1000 * (float)_frame_counter / (float)_sf_info.samplerate)
-        + " / "
-        + _ms_to_time_string( _total_ms );
-
-    text = TTF_RenderText_Shaded( 
-        _font, 
-        _temp_text.c_str(), 
-        globals._FOREGROUND_2,
-        globals._BACKGROUND_1 );
-
-    SDL_Texture* text_texture;
-    text_texture = SDL_CreateTextureFromSurface( _renderer, text );
-
-    SDL_Rect src = {
-        0,0,text->w, text->h
-    };
-
-    SDL_Rect dest = { 
-        (int)floor(_timeLabelPosition.x),
-        (int)floor(_timeLabelPosition.y),
-        text->w, text->h };
+    const int elapsed_s = (int)( _frame_counter / _sf_info.samplerate );
+    const int total_s = _total_ms / 1000;
 
-    SDL_RenderCopy( _renderer, text_texture, &src, &dest );
+    snprintf( _time_text, sizeof(_time_text), "%02d:%02d / %02d:%02d",
+        elapsed_s / 60, elapsed_s % 60, total_s / 60, total_s % 60 );
 
-    // cleanup
-    SDL_DestroyTexture( text_texture );
-    SDL_FreeSurface( text );
+    _glyphs->draw( 
+        _time_text, 
+        floor(_timeLabelPosition.x), 
+        floor(_timeLabelPosition.y), 
+        globals._FOREGROUND_2 );
 }
 
 
@@ -534,9 +1036,9 @@ Help::Help(
     const SDL_Rect &contentRect,
     SDL_Renderer *r,
     std::shared_ptr<spdlog::logger> logger,
-    TTF_Font *f )
+    GlyphAtlas *glyphs )
 :UIComponent(contentRect, r, logger),
-_font(f)
+_glyphs(glyphs)
 {
     _help_rect = {
         (float)_content_rect.x + 100,
@@ -550,6 +1052,13 @@ _font(f)
 
 void Help::toggle(){
     _visible = !_visible;
+
+    // the text runs taller than the panel
+    _invalidate( { 
+        (int)_help_rect.x, 
+        (int)_help_rect.y, 
+        (int)_help_rect.w, 
+        std::max( (int)_help_rect.h, _glyphs->height() ) } );
 }
 
 void Help::draw(){
@@ -572,36 +1081,83 @@ void Help::draw(){
             globals._FOREGROUND_1.b,
             globals._FOREGROUND_1.a );
 
-        SDL_Surface* text_surface;
-
-        text_surface = TTF_RenderText_Shaded( 
-            _font, 
+        _glyphs->draw( 
             _text.c_str(), 
-            globals._FOREGROUND_2,
-            globals._BACKGROUND_1 );
-                
-        SDL_Texture* text_texture;
+            floor(_help_rect.x), 
+            floor(_help_rect.y), 
+            globals._FOREGROUND_2 );
+    }
+}
 
-        text_texture = SDL_CreateTextureFromSurface( _renderer, 
-            text_surface );
 
-        SDL_Rect src = {
-            0,0,text_surface->w, text_surface->h
-        };
 
-        SDL_Rect dest = { 
-            (int)floor(_help_rect.x),
-            (int)floor(_help_rect.y),
-            text_surface->w, 
-            text_surface->h
-        };
+/***
+ * STATS OVERLAY
+*/
+StatsOverlay::StatsOverlay(
+    const SDL_Rect &contentRect,
+    SDL_Renderer *r,
+    std::shared_ptr<spdlog::logger> logger,
+    GlyphAtlas *glyphs )
+:UIComponent(contentRect, r, logger),
+_glyphs(glyphs)
+{
+    _box = { 
+        _content_rect.x + _content_rect.w - 340, 
+        _content_rect.y + 10, 
+        330, 
+        _LINES * _glyphs->height() + 2 * _INNER_PADDING 
+    };
+}
 
-        SDL_RenderCopy( _renderer, text_texture, &src, &dest );
-        
-        // cleanup
-        SDL_DestroyTexture( text_texture );
-        SDL_FreeSurface( text_surface );
-        
+void StatsOverlay::toggle(){
+    _visible = !_visible;
+    _invalidate( _box );
+}
+
+void StatsOverlay::update( const Bus::CallbackStats &stats, const FrameStats &frames )
+{
+    char text[_LINES][96] = {};
+
+    snprintf( text[0], sizeof(text[0]), "callback p50 %.0f  p99 %.0f  max %.0f us",
+        stats.p50_us, stats.p99_us, stats.max_us );
+    snprintf( text[1], sizeof(text[1]), "budget %.0f us   cpu load %.1f %%",
+        stats.budget_us, 100 * stats.cpu_load );
+    snprintf( text[2], sizeof(text[2]), "underflows %llu   overflows %llu",
+        (unsigned long long)stats.underflows, (unsigned long long)stats.overflows );
+    snprintf( text[3], sizeof(text[3]), "latency %.1f ms   dac drift %.2f ms",
+        stats.output_latency_ms, stats.dac_drift_ms );
+    snprintf( text[4], sizeof(text[4]), "ui %.0f Hz  frame p50 %.1f  p99 %.1f ms  late %llu",
+        frames.refresh_hz, frames.p50_ms, frames.p99_ms, (unsigned long long)frames.late );
+
+    // stats tick four times a second, the text moves less often
+    if ( memcmp( text, _text, sizeof(text) ) != 0 ){
+        memcpy( _text, text, sizeof(text) );
+        _invalidate( _box );
+    }
+}
+
+void StatsOverlay::draw()
+{
+    if ( !_visible ){
+        return;
+    }
+
+    SDL_SetRenderDrawColor(
+        _renderer,
+        globals._BACKGROUND_1.r,
+        globals._BACKGROUND_1.g,
+        globals._BACKGROUND_1.b,
+        200 );
+
+    SDL_RenderFillRect( _renderer, &_box );
+
+    for ( int i = 0; i < _LINES; i++ ){
+        _glyphs->draw( 
+            _text[i], 
+            _box.x + _INNER_PADDING, 
+            _box.y + _INNER_PADDING + i * _glyphs->height(), 
+            globals._FOREGROUND_2 );
     }
 }
 
@@ -616,55 +1172,45 @@ Label::Label(
     const SDL_Rect &contentRect,
     SDL_Renderer *r,
     std::shared_ptr<spdlog::logger> logger,
-    TTF_Font *font,
+    GlyphAtlas *glyphs,
     SDL_Color bg_color,
     SDL_Color fg_color,
     SDL_Point position
 ):UIComponent(contentRect, r, logger),
-_font(font),
+_glyphs(glyphs),
 _content(""),
 _fg_color(fg_color),
 _bg_color(bg_color),
 _position(position)
 {
-}
-
-Label::~Label(){
-    SDL_DestroyTexture( _texture );
-    SDL_FreeSurface( _surface );
+    _tgt = { _position.x, _position.y, 0, 0 };
 }
 
 void Label::draw(){
     if (_isVisible){
-        SDL_RenderCopy( _renderer, _texture, &_src, &_tgt );
-    }
-}
 
-void Label::updateContents( const std::string &_newContents ){
+        SDL_SetRenderDrawColor(
+            _renderer,
+            _bg_color.r,
+            _bg_color.g,
+            _bg_color.b,
+            _bg_color.a );
 
-    if (_surface != NULL){
-        SDL_DestroyTexture( _texture );
-        SDL_FreeSurface( _surface );
+        SDL_RenderFillRect( _renderer, &_tgt );
+
+        _glyphs->draw( _content.c_str(), _tgt.x, _tgt.y, _fg_color );
     }
+}
 
-    _surface = TTF_RenderText_Shaded( 
-        _font, 
-        _newContents.c_str(), 
-        _fg_color,
-        _bg_color );
-    
-    _texture = SDL_CreateTextureFromSurface( _renderer, 
-        _surface );
+void Label::updateContents( const std::string &_newContents ){
 
-    _src =  {
-        0,0,_surface->w, _surface->h
-    };
+    _content = _newContents;
 
     _tgt = {
         (int)floor(_position.x),
         (int)floor(_position.y),
-        _surface->w, 
-        _surface->h
+        _glyphs->width( _content.c_str() ), 
+        _glyphs->height()
     };
 }
 
@@ -686,20 +1232,203 @@ StaticInfo::StaticInfo(
     const std::string &filename,
     SDL_Color bg_color,
     SDL_Color fg_color,
-    TTF_Font *small_font,
-    TTF_Font *lrg_font
+    GlyphAtlas *small_glyphs,
+    GlyphAtlas *lrg_glyphs
 ):UIComponent(contentRect, r, logger),
-_filename_label( contentRect, r, logger, lrg_font, bg_color, fg_color, {contentRect.x, contentRect.y}),
-_channels_label( contentRect, r, logger, small_font, bg_color, fg_color, {contentRect.x, contentRect.y + 150} ),
-_framerate_label( contentRect, r, logger, small_font, bg_color, fg_color, {contentRect.x, contentRect.y + 200})
+_filename_label( contentRect, r, logger, lrg_glyphs, bg_color, fg_color, {contentRect.x, contentRect.y}),
+_channels_label( contentRect, r, logger, small_glyphs, bg_color, fg_color, {contentRect.x, contentRect.y + 150} ),
+_framerate_label( contentRect, r, logger, small_glyphs, bg_color, fg_color, {contentRect.x, contentRect.y + 200}),
+_speed_label( contentRect, r, logger, small_glyphs, bg_color, fg_color, {contentRect.x, contentRect.y + 250}),
+_tempo_label( contentRect, r, logger, small_glyphs, bg_color, fg_color, {contentRect.x, contentRect.y + 300})
 {
     _filename_label.updateContents(filename);
     _channels_label.updateContents( "Channels: " + std::to_string(sfi.channels) );
     _framerate_label.updateContents( "Sample Rate: " + std::to_string( sfi.samplerate ) + " Hz" );
+    setSpeed( 1 );
+    setTempo( 1 );
+
+    // a long file name runs past the info column
+    _invalidate( _filename_label.rect() );
+}
+
+void StaticInfo::setFile( const std::string &filename, const SF_INFO &sfi ){
+
+    // the old name may run further than the new one
+    _invalidate( _filename_label.rect() );
+
+    _filename_label.updateContents(filename);
+    _channels_label.updateContents( "Channels: " + std::to_string(sfi.channels) );
+    _framerate_label.updateContents( "Sample Rate: " + std::to_string( sfi.samplerate ) + " Hz" );
+
+    _invalidate();
+    _invalidate( _filename_label.rect() );
+}
+
+void StaticInfo::setSpeed( double speed ){
+
+    char text[32];
+    snprintf( text, sizeof(text), "Speed: %.2fx", speed );
+
+    _speed_label.updateContents( text );
+    _invalidate();
+}
+
+void StaticInfo::setTempo( double tempo ){
+
+    char text[32];
+    snprintf( text, sizeof(text), "Tempo: %.2fx", tempo );
+
+    _tempo_label.updateContents( text );
+    _invalidate();
 }
 
 void StaticInfo::draw(){
     _filename_label.draw();
     _channels_label.draw();
     _framerate_label.draw();
+    _speed_label.draw();
+    _tempo_label.draw();
+}
+
+
+
+
+/****
+ * Spectrum
+*/
+Spectrum::Spectrum(
+    const SDL_Rect &contentRect,
+    SDL_Renderer *r,
+    std::shared_ptr<spdlog::logger> logger,
+    int n,
+    float min_x,
+    float max_x
+):UIComponent(contentRect, r, logger),
+_min_x_value(min_x),
+_max_x_value(max_x)
+{
+    _spectrumBox_inCanvas = {
+        _content_rect.x + _INNER_PADDING,
+        _content_rect.y + _INNER_PADDING,
+        _content_rect.w - 2 * _INNER_PADDING,
+        _content_rect.h - 2 * _INNER_PADDING
+    };
+
+    // 1-2-5 divisions per decade, 20 Hz -> 20 kHz
+    const float steps[] = { 1, 2, 5 };
+    for ( float decade = 10; decade <= _max_x_value; decade *= 10 ){
+        for ( float step : steps ){
+            float hz = decade * step;
+            if ( hz >= _min_x_value && hz <= _max_x_value ){
+                _x_axis_grid_divisions.push_back( hz );
+            }
+        }
+    }
+
+    const float log_span = log10f( _max_x_value / _min_x_value );
+
+    for ( float hz : _x_axis_grid_divisions ){
+        float x = log10f( hz / _min_x_value ) / log_span;
+        grid_lines.push_back( { {x, 0}, {x, 1} } );
+    }
+
+    // n horizontal divisions
+    for ( int i = 1; i < n; i++ ){
+        float y = (float)i / n;
+        grid_lines.push_back( { {0, y}, {1, y} } );
+    }
+
+    // bands are log-spaced too, so bars are all the same width
+    _bars.resize( FFT_OUT_BANDS );
+    const float bar_w = (float)_spectrumBox_inCanvas.w / FFT_OUT_BANDS;
+
+    for ( int j = 0; j < FFT_OUT_BANDS; j++ ){
+        _bars[j] = {
+            _spectrumBox_inCanvas.x + j * bar_w + 1,
+            (float)(_spectrumBox_inCanvas.y + _spectrumBox_inCanvas.h),
+            bar_w - 2,
+            0
+        };
+    }
+}
+
+SDL_FPoint Spectrum::point_toWindowCoords( const SDL_FPoint &_point_in_grid ){
+    return {
+        _spectrumBox_inCanvas.x + _point_in_grid.x * _spectrumBox_inCanvas.w,
+        // grid y grows upwards
+        _spectrumBox_inCanvas.y + (1 - _point_in_grid.y) * _spectrumBox_inCanvas.h
+    };
+}
+
+SDL_FLine Spectrum::line_toWindowCoords( const SDL_FLine &_line ){
+    return {
+        point_toWindowCoords( _line.pa ),
+        point_toWindowCoords( _line.pb )
+    };
+}
+
+void Spectrum::update( const Bus::VisFrame &frame ){
+
+    const float bottom = _spectrumBox_inCanvas.y + _spectrumBox_inCanvas.h;
+
+    for ( int j = 0; j < FFT_OUT_BANDS; j++ ){
+        _bands[j] = frame.bands[j];
+        _bars[j].h = _bands[j] * _spectrumBox_inCanvas.h;
+        _bars[j].y = bottom - _bars[j].h;
+    }
+
+    _invalidate();
+}
+
+void Spectrum::setSummary( const float *bands ){
+
+    const float bar_w = (float)_spectrumBox_inCanvas.w / FFT_OUT_BANDS;
+    const float bottom = _spectrumBox_inCanvas.y + _spectrumBox_inCanvas.h;
+
+    _summary_line.resize( FFT_OUT_BANDS );
+    for ( int j = 0; j < FFT_OUT_BANDS; j++ ){
+        _summary_line[j] = {
+            _spectrumBox_inCanvas.x + (j + 0.5f) * bar_w,
+            bottom - bands[j] * _spectrumBox_inCanvas.h
+        };
+    }
+
+    _invalidate();
+}
+
+void Spectrum::draw(){
+
+    SDL_SetRenderDrawColor(
+        _renderer,
+        globals._FOREGROUND_1.r,
+        globals._FOREGROUND_1.g,
+        globals._FOREGROUND_1.b,
+        40
+    );
+
+    for ( const SDL_FLine &line : grid_lines ){
+        SDL_FLine l = line_toWindowCoords( line );
+        SDL_RenderDrawLineF( _renderer, l.pa.x, l.pa.y, l.pb.x, l.pb.y );
+    }
+
+    SDL_SetRenderDrawColor(
+        _renderer,
+        globals._FOREGROUND_2.r,
+        globals._FOREGROUND_2.g,
+        globals._FOREGROUND_2.b,
+        globals._FOREGROUND_2.a
+    );
+
+    SDL_RenderFillRectsF( _renderer, _bars.data(), _bars.size() );
+
+    if ( !_summary_line.empty() ){
+        SDL_SetRenderDrawColor(
+            _renderer,
+            globals._FOREGROUND_1.r,
+            globals._FOREGROUND_1.g,
+            globals._FOREGROUND_1.b,
+            140
+        );
+        SDL_RenderDrawLinesF( _renderer, _summary_line.data(), _summary_line.size() );
+    }
 }
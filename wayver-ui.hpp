@@ -1,10 +1,15 @@
 #pragma once
 
+#include <deque>
 #include <vector>
 
 #include <wayver-defines.hpp>
 #include <wayver-util.hpp>
 #include <wayver-bus.hpp>
+#include <wayver-overview.hpp>
+#include <wayver-glyphs.hpp>
+#include <wayver-compositor.hpp>
+#include <wayver-scheduler.hpp>
 
 #include <boost/lockfree/spsc_queue.hpp>
 #include <spdlog/spdlog.h>
@@ -40,6 +45,11 @@ namespace Wayver {
                 SDL_Renderer *_renderer = NULL;
                 std::shared_ptr<spdlog::logger> _logger;
 
+                // what needs redrawing, window coordinates - empty -> unchanged
+                SDL_Rect _dirty;
+                void _invalidate();
+                void _invalidate( const SDL_Rect &r );
+
             public:
                 SDL_Rect _content_rect;
                 const int _INNER_PADDING = 3;
@@ -50,8 +60,12 @@ namespace Wayver {
                     SDL_Renderer *r,
                     std::shared_ptr<spdlog::logger> logger
                 );
+                virtual ~UIComponent() {}
+
+                virtual void draw() {}
 
-                void draw();
+                // the damage since the last call - starts as the whole component
+                SDL_Rect takeDirty();
         };
 
         struct SDL_FLine  {
@@ -65,17 +79,14 @@ namespace Wayver {
         class Label: public UIComponent {
 
             std::string _content;
-            TTF_Font *_font;
+            GlyphAtlas *_glyphs;
             SDL_Color _bg_color,
              _fg_color;
             
             SDL_Point _position;
-            SDL_Rect _src, _tgt;
+            SDL_Rect _tgt;
             bool _isVisible = true;
 
-            SDL_Surface *_surface = NULL;
-            SDL_Texture *_texture = NULL;
-
             public:
                 // gets initted with "" as contents
                 // only shows text after updateContents()
@@ -83,18 +94,19 @@ namespace Wayver {
                     const SDL_Rect &contentRect,
                     SDL_Renderer *r,
                     std::shared_ptr<spdlog::logger> logger,
-                    TTF_Font *font,
+                    GlyphAtlas *glyphs,
                     SDL_Color bg_color,
                     SDL_Color fg_color,
                     SDL_Point position
                 );
 
-                ~Label();
-
-                void draw();
+                void draw() override;
                 void updateContents( const std::string &_newContents );
                 void toggleVisibility();
 
+                // where the text and its background land
+                const SDL_Rect &rect() const { return _tgt; }
+
         };
 
 
@@ -108,21 +120,21 @@ namespace Wayver {
 
             bool _visible = false;
 
-            TTF_Font *_font;
+            GlyphAtlas *_glyphs;
             SDL_FRect _help_rect;
             
             const std::string _text = 
-                "Q - Quit    SPACE - Play/Pause    ARROW UP/DWN - Volume";
+                "Q Quit  SPACE Play/Pause  UP/DWN Volume  LT/RT Speed  [/] Tempo  S Stats  A/B Loop  C Unloop";
             
             public:
                 Help(
                     const SDL_Rect &contentRect,
                     SDL_Renderer *r,
                     std::shared_ptr<spdlog::logger> logger,
-                    TTF_Font *f
+                    GlyphAtlas *glyphs
                 );
 
-                void draw();
+                void draw() override;
                 void toggle();
 
        };
@@ -131,6 +143,37 @@ namespace Wayver {
 
 
 
+        /***
+         * STATS OVERLAY
+         * how the audio callback is keeping up, toggled with S.
+         * Text is only formatted when new stats come in.
+        */
+        class StatsOverlay : public UIComponent {
+
+            static const int _LINES = 5;
+
+            bool _visible = false;
+            GlyphAtlas *_glyphs;
+
+            char _text[_LINES][96] = {};
+            SDL_Rect _box;
+
+            public:
+                StatsOverlay(
+                    const SDL_Rect &contentRect,
+                    SDL_Renderer *r,
+                    std::shared_ptr<spdlog::logger> logger,
+                    GlyphAtlas *glyphs
+                );
+
+                void toggle();
+                bool isVisible() const { return _visible; }
+
+                void update( const Bus::CallbackStats &stats, const FrameStats &frames );
+                void draw() override;
+        };
+
+
         /***
          * SCRUBBER
          * is the play bar
@@ -144,12 +187,32 @@ namespace Wayver {
 
             float _max_scrubber_bar_width = 0;
 
+            // waveform behind the bar, one rect per pixel column
+            const int _WAVE_HEIGHT = 28;
+            SDL_FRect _wave_rect;
+            const Audio::Overview *_overview = NULL;
+            std::vector<SDL_FRect> _wave_columns;
+            size_t _wave_played = 0;
+
             int _total_ms = 0;
-            int _frame_counter;
+            int64_t _frame_counter = 0;
+
+            // A/B markers on the waveform, -1 -> not set
+            int64_t _loop_a = -1;
+            int64_t _loop_b = -1;
+
+            float _xAt( int64_t frame ) const;
+
+            // what is on screen - redraw only when one moves
+            int _shown_bar_px = -1;
+            int _shown_second = -1;
 
-            TTF_Font *_font;
+            GlyphAtlas *_glyphs;
             SDL_FPoint _timeLabelPosition;
 
+            // "mm:ss / mm:ss", redone every frame without allocating
+            char _time_text[32];
+
             const std::string _ms_to_time_string(int time_ms);
 
             std::shared_ptr<spdlog::logger> _logger;
@@ -162,16 +225,31 @@ namespace Wayver {
                     SDL_Renderer *r,
                     std::shared_ptr<spdlog::logger> logger,
                     const SF_INFO &sfi,
-                    TTF_Font *f
+                    GlyphAtlas *glyphs
                 );
 
                 ~Scrubber();
 
+                // not owned - drawn once it reports ready
+                void setOverview( const Audio::Overview *overview );
+
+                // next playlist entry - starts over from its first frame
+                void setTrack( const SF_INFO &sfi, const Audio::Overview *overview );
+
                 void update(
-                    int sample_counter
+                    int64_t sample_counter
                 );
 
-                void draw();
+                // the waveform, where a click or a drag starts
+                bool contains( int x, int y ) const;
+
+                // file frame under x, clamped to the track
+                int64_t frameAt( int x ) const;
+
+                // loop markers, -1 hides one
+                void setLoop( int64_t a, int64_t b );
+
+                void draw() override;
         };
 
 
@@ -184,7 +262,9 @@ namespace Wayver {
 
             Label _filename_label,
             _channels_label,
-            _framerate_label;
+            _framerate_label,
+            _speed_label,
+            _tempo_label;
 
             public:
                 StaticInfo(
@@ -195,13 +275,21 @@ namespace Wayver {
                     const std::string &filename,
                     SDL_Color bg_color,
                     SDL_Color fg_color,
-                    TTF_Font *small_font,
-                    TTF_Font *lrg_font
+                    GlyphAtlas *small_glyphs,
+                    GlyphAtlas *lrg_glyphs
                 );
 
-                void draw();
+                void setFile( const std::string &filename, const SF_INFO &sfi );
+                void setSpeed( double speed );
+                void setTempo( double tempo );
+
+                void draw() override;
         };
 
+        /***
+         * SPECTRUM
+         * bars for the analyser bands over a log frequency grid
+        */
         class Spectrum : public UIComponent{
 
             float _min_x_value;
@@ -212,6 +300,13 @@ namespace Wayver {
             SDL_Rect _spectrumBox_inCanvas;
             std::vector<float> _x_axis_grid_divisions;
 
+            // latest analyser output, [0,1]
+            float _bands[FFT_OUT_BANDS] = {0};
+            std::vector<SDL_FRect> _bars;
+
+            // whole-file average from the analysis cache, if any
+            std::vector<SDL_FPoint> _summary_line;
+
             public:
 
                 SDL_FPoint point_toWindowCoords( const SDL_FPoint &_point_in_grid);
@@ -220,14 +315,18 @@ namespace Wayver {
                 Spectrum(
                     const SDL_Rect &contentRect,
                     SDL_Renderer *r,
+                    std::shared_ptr<spdlog::logger> logger,
                     int n = 10,
-                    float min_x = 20,
-                    float max_x = 20000
+                    float min_x = ANALYSIS_MIN_HZ,
+                    float max_x = ANALYSIS_MAX_HZ
                 );
                 
                 // in grid coords - ranged 0 to 1
                 std::vector<SDL_FLine> grid_lines;
-                void draw();
+
+                void update( const Bus::VisFrame &frame );
+                void setSummary( const float *bands );
+                void draw() override;
                     
         };
 
@@ -246,6 +345,7 @@ namespace Wayver {
 
 
 
+
         class WayverUi {
 
             Globals _globals;
@@ -255,10 +355,8 @@ namespace Wayver {
             // input from Audio thread
             Bus::Queues *_queues_ptr;
             
-            // array with samples we'll read from the queue
-            std::vector<float> _samples_in_vec;
-            int _n_samples_in;
-            int _n_frames_per_buffer;
+            // spectrum generation last handed to _spectrum
+            uint64_t _analysis_seq = 0;
 
             // computed layout stuff
             SDL_Rect _spectrum_rect;
@@ -268,9 +366,49 @@ namespace Wayver {
 
             SF_INFO _sfInfo;
             std::string path_to_file;
+
+            // what the engine plays through, and which entry the window shows
+            std::vector<std::string> _playlist;
+            int _track = 0;
+
+            // load the window shows, 0 -> no clock seen yet, and files
+            // dropped on the window the engine has not played yet
+            uint32_t _load = 0;
+            std::deque<std::string> _dropped;
             
-            // init frames counter to 0
-            int _frames_counter = 0;
+            // audible file frame, as of when this UI frame hits the screen
+            int64_t _frames_counter = 0;
+
+            // paced to the display, see run()
+            FrameScheduler *_scheduler = NULL;
+
+            // SDL_GetTicks() of the last key press - stay awake a while after
+            Uint32 _last_input_ms = 0;
+
+            // left button went down on the waveform, and where the
+            // pointer was at the last SCRUB - 0 ms until it moved
+            bool _dragging = false;
+            int64_t _drag_frame = 0;
+            Uint32 _drag_ms = 0;
+
+            void _scrubTo( int x );
+
+            // loop points as marked, file frames, -1 -> not marked
+            int64_t _loop_a = -1;
+            int64_t _loop_b = -1;
+
+            void _markLoop( bool at_b );
+            void _clearLoop();
+
+            // varispeed as last asked for, a semitone a step
+            double _speed = 1;
+
+            void _nudgeSpeed( bool up );
+
+            // time-stretch tempo, pitch kept, STRETCH_TEMPO_STEP a step
+            double _tempo = 1;
+
+            void _nudgeTempo( bool up );
 
             SDL_Window* window;
             SDL_Renderer* renderer;
@@ -281,9 +419,21 @@ namespace Wayver {
             TTF_Font *body_font = NULL;
             TTF_Font *labels_font = NULL;
 
+            // one per font, built once the renderer exists
+            GlyphAtlas *_title_glyphs = NULL;
+            GlyphAtlas *_body_glyphs = NULL;
+            GlyphAtlas *_labels_glyphs = NULL;
+
             // flags
             bool _QUIT = false;
 
+            /***
+             * Layers, bottom to top: live (scrubber, spectrum),
+             * file info (cached), overlays (cached). Composes into
+             * canvas, which holds the last frame between presents
+            */
+            Compositor *_compositor = NULL;
+
             // Throttle user events
             const int _THROTTLE_TIME_MS = 300;
             int _throttleTimer_start = 0;
@@ -291,20 +441,36 @@ namespace Wayver {
 
 
             // spectogram grid
-            // Spectrum *_spectrum = NULL;
+            Spectrum *_spectrum = NULL;
+            Audio::Overview *_overview = NULL;
+
+            // a track's overview can outlive it while its build finishes
+            std::vector<Audio::Overview*> _retired_overviews;
+
+            // earlier runs' analysis of this file
+            std::shared_ptr<Cache::Entry> _cache;
             Scrubber *_scrubber = NULL;
             Help *_help_component = NULL;
             StaticInfo *_static_info = NULL;
+            StatsOverlay *_stats_overlay = NULL;
 
             // private initializations
             void _initFonts();
 
-            // Draw
-            void _draw();
+            // Draw - false when nothing changed and nothing was presented
+            bool _draw();
 
             void _update();
 
             void _handleEvents();
+            void _handleEvent( const SDL_Event &e );
+
+            // nothing playing and nobody typing - no point ticking frames
+            bool _idle();
+
+            // the engine crossed into another playlist entry
+            void _onTrackChange( const Bus::AudioClock &clock );
+            void _loadAnalysis( const std::string &fpath );
 
             // Utils
             SDL_Point _getSize(SDL_Texture *texture);
@@ -322,6 +488,9 @@ namespace Wayver {
                 );
 
                 void setSfInfo( const SF_INFO &sfi);
+
+                // entry 0 is the file given to initUiState()
+                void setPlaylist( const std::vector<std::string> &playlist );
                 
                 void initWindow();
 